@@ -0,0 +1,64 @@
+/* SPDX-License-Identifier: MIT */
+/**
+ * @file api_server.h
+ * @brief REST API for monitoring and session queries
+ */
+
+#ifndef API_SERVER_H
+#define API_SERVER_H
+
+#include <stdint.h>
+
+struct nat_core_ctx;
+struct rte_rcu_qsbr;
+
+/*
+ * Binary session dump (GET /api/sessions?format=binary): a header, then
+ * one record per session up to the end of the body. Multi-byte fields are
+ * in network byte order, times in Unix seconds.
+ */
+#define SESSION_DUMP_MAGIC    "CGNS"
+#define SESSION_DUMP_VERSION  1
+
+struct session_dump_header {
+    char magic[4];                      /* SESSION_DUMP_MAGIC */
+    uint16_t version;
+    uint16_t record_size;               /* Skip unknown trailing fields */
+} __attribute__((__packed__));
+
+struct session_record {
+    uint32_t private_ip;
+    uint32_t public_ip;
+    uint32_t remote_ip;
+    uint16_t private_port;
+    uint16_t public_port;
+    uint16_t remote_port;
+    uint8_t protocol;
+    uint8_t state;                      /* enum nat_state */
+    uint16_t core;                      /* Worker index */
+    uint16_t reserved;
+    uint32_t created;
+    uint32_t last_active;
+    uint64_t packets;                   /* 0 without nat.session_accounting */
+    uint64_t bytes;
+} __attribute__((__packed__));
+
+/**
+ * Start the REST API
+ * Serves GET /api/stats and GET /api/sessions from the shared HTTP server
+ * (see http_server_poll). Sessions are read from the running workers'
+ * tables as a data plane RCU reader, online only while a part of a
+ * response is produced.
+ * 
+ * @param port TCP port
+ * @param cores Per-core NAT contexts
+ * @param num_cores Number of workers
+ * @param rcu Data plane QSBR variable
+ * @param rcu_thread_id Free RCU thread slot for the control thread
+ * @return 0 on success, negative on error
+ */
+int api_server_start(uint16_t port, const struct nat_core_ctx *cores,
+                     unsigned int num_cores, struct rte_rcu_qsbr *rcu,
+                     unsigned int rcu_thread_id);
+
+#endif /* API_SERVER_H */
@@ -15,28 +15,91 @@
 #include <rte_udp.h>
 #include <rte_hash.h>
 #include <rte_atomic.h>
+#include <rte_seqcount.h>
 
-/* Configuration constants */
-#define MAX_PUBLIC_IPS        10
-#define MAX_CORES             16
-#define MAX_NAT_ENTRIES       50000
-#define ENTRIES_PER_CORE      (MAX_NAT_ENTRIES / MAX_CORES)
+/* Configuration limits (tables themselves are sized at runtime) */
+#define MAX_PUBLIC_IPS        4096      /* pool_idx is 16 bits */
+#define MAX_CORES             128
+#define MAX_SESSIONS_DEFAULT  (4 * 1024 * 1024)
+#define MAX_SESSIONS_LIMIT    (TW_REF_BASE - 1) /* Indices stay below TW_REF_* */
+#define SESSION_INDEX_NONE    UINT32_MAX
 #define HASH_TABLE_BUCKETS    65536
 #define PORT_RANGE_START      1024
 #define PORT_RANGE_END        65535
 #define PORTS_PER_IP          (PORT_RANGE_END - PORT_RANGE_START + 1)
 
+/* Customer prefixes (rte_lpm next hop = prefix index) */
+#define MAX_CUSTOMER_PREFIXES 256
+#define CUSTOMER_PREFIX_LEN_MIN 8
+#define CUSTOMER_ADDRS_MAX    (1U << 24)  /* Subscriber records per worker */
+#define IP_POOL_SHARED        0         /* nat.public_ips */
+
+/* Port block allocation (per-customer leases) */
+#define PORT_BLOCK_SIZE_MIN   64
+#define PORT_BLOCK_SIZE_MAX   1024   /* Blocks stay aligned to PORT_RANGE_START */
+#define PORT_BLOCK_SIZE_DEFAULT 512
+#define PORT_BLOCKS_MAX       (PORTS_PER_IP / PORT_BLOCK_SIZE_MIN)
+#define PORT_BLOCK_NONE       UINT16_MAX
+
+/* RSS */
+#define RSS_KEY_MAX           52        /* Largest Toeplitz key (i40e/ice) */
+#define RSS_RETA_MAX          512       /* Largest redirection table */
+#define RSS_SELF_TEST_SAMPLES 4096      /* Tuples checked per worker at startup */
+#define RSS_PORT_TRIES        64        /* Candidate ports probed per public IP */
+
+/* Software handoff between workers */
+#define HANDOFF_RING_SIZE     1024      /* Per producer/consumer pair */
+
 /* Packet burst sizes */
 #define RX_BURST_SIZE         32
 #define TX_BURST_SIZE         32
 #define MBUF_CACHE_SIZE       512
 #define MBUF_POOL_SIZE        (512 * 1024)
+#define TX_DRAIN_US           100       /* Longest a partial TX buffer waits */
+
+/* Inside/outside topology (egress side = mbuf port after translation) */
+#define NAT_SIDE_INSIDE       0         /* Towards customers */
+#define NAT_SIDE_OUTSIDE      1         /* Towards the Internet */
+#define NAT_SIDES             2
+#define ARP_RETRY_MS          1000      /* Request interval while unresolved */
+#define ARP_REFRESH_S         30        /* Request interval once resolved */
+
+/* NAT event log */
+#define EVENT_BATCH_SIZE      64        /* Events staged per worker flush */
+#define EVENT_RING_DEFAULT    4096      /* Events per worker ring */
+#define EVENT_RING_MIN        64
+#define EVENT_RING_MAX        (1U << 24)
+#define EVENT_RATE_DEFAULT    0         /* Events written per second, 0 = off */
+
+/* Statistics */
+#define STATS_PUBLISH_US      1000      /* Worker snapshot period */
+#define STATS_COLLECT_S       2         /* Aggregation period of the collector */
+
+/* Latency histograms: 2^LAT_HIST_SUB_BITS linear buckets per power of two */
+#define LAT_HIST_SUB_BITS     2
+#define LAT_HIST_MIN_SHIFT    8         /* Bucket 0 holds < 2^8 cycles */
+#define LAT_HIST_MAX_SHIFT    28        /* Last bucket holds >= 2^28 cycles */
+#define LAT_HIST_BUCKETS      (((LAT_HIST_MAX_SHIFT - LAT_HIST_MIN_SHIFT) << \
+                                LAT_HIST_SUB_BITS) + 2)
+#define NAT_DIR_OUTBOUND      0
+#define NAT_DIR_INBOUND       1
+#define NAT_DIRS              2
 
 /* Protocol types */
 #define PROTO_TCP             6
 #define PROTO_UDP             17
 #define PROTO_ICMP            1
 
+/* ICMP message types handled by the translator (RFC 792) */
+#define ICMP_ECHO_REPLY       0
+#define ICMP_DEST_UNREACH     3
+#define ICMP_ECHO_REQUEST     8
+#define ICMP_TIME_EXCEEDED    11
+#define ICMP_PARAM_PROBLEM    12
+
+/* L4 bytes an ICMP error must quote after the inner IP header */
+#define ICMP_ERROR_QUOTE_MIN  8
+
 /* NAT session states (TCP) */
 enum nat_state {
     NAT_STATE_CLOSED = 0,
@@ -55,9 +118,55 @@ enum nat_state {
 #define TIMEOUT_TCP_FIN          120
 #define TIMEOUT_UDP              300
 #define TIMEOUT_ICMP             30
+#define TIMEOUT_TCP_RST          4      /* RFC 7857: linger for late segments */
+
+/* Session aging (timer wheel) */
+#define TW_TICK_HZ               1      /* Wheel resolution: 1 tick per second */
+#define TW_L0_BITS               8
+#define TW_L0_SLOTS              (1 << TW_L0_BITS)  /* 256 x 1 tick */
+#define TW_L1_BITS               8
+#define TW_L1_SLOTS              (1 << TW_L1_BITS)  /* 256 x 256 ticks */
+#define TW_EXPIRE_BUDGET         64     /* Max sessions examined per worker pass */
+
+/*
+ * Timer wheel back-links: nat_entry.prev holds the previous session index,
+ * or for a list head one of these references to the list itself
+ */
+#define TW_REF_BASE              0xFFFF0000U
+#define TW_REF_PENDING           (TW_REF_BASE | 0xFFFE)
+#define TW_REF_CASCADE           (TW_REF_BASE | 0xFFFD)
+#define TW_REF_SLOT(level, slot) (TW_REF_BASE | ((level) << TW_L0_BITS) | (slot))
+
+/* Coarse session clock (32-bit timestamps, wraps after ~49 days) */
+#define SESSION_CLOCK_HZ         1000   /* Approximate: TSC >> power of two */
+
+/* Fragment cache (per core, bounded; no reassembly) */
+#define FRAG_CACHE_BUCKETS       1024   /* Power of two */
+#define FRAG_CACHE_WAYS          4      /* Entries per bucket */
+#define FRAG_HOLD_MAX            4      /* Fragments held ahead of the first */
+#define FRAG_READY_MAX           64     /* Released fragments awaiting TX */
+#define FRAG_TIMEOUT_MS          2000
+#define FRAG_EXPIRE_BUDGET       16     /* Buckets swept per worker pass */
+
+/* Per-subscriber policer */
+#define POLICER_BURST_MS         50     /* Bucket depth in time at the rate */
+#define POLICER_DSCP_MARK        1      /* Lower Effort PHB (RFC 8622) */
+
+/* Outbound ACL */
+#define ACL_MAX_RULES            65536
+#define ACL_BLOCK_PORTS_MAX      64
+#define ACL_PROTO_TCP            0x01   /* cgnat_config.acl_allow_protocols */
+#define ACL_PROTO_UDP            0x02
+#define ACL_PROTO_ICMP           0x04
+#define ACL_PROTO_ALL            (ACL_PROTO_TCP | ACL_PROTO_UDP | ACL_PROTO_ICMP)
+
+/* Session flags (nat_entry.flags) */
+#define NAT_FLAG_FIN_OUT         0x01   /* Customer sent FIN */
+#define NAT_FLAG_FIN_IN          0x02   /* Remote sent FIN */
 
 /**
  * 5-tuple flow key for NAT lookup
+ * ICMP echo carries its identifier in src_port (request) or dst_port (reply).
  */
 struct flow_key {
     uint32_t src_ip;
@@ -70,35 +179,117 @@ struct flow_key {
 
 /**
  * NAT session entry (lockless per-core)
+ *
+ * Only what translation and aging read per packet: two entries share a
+ * cache line. Both lookup keys can be rebuilt from the three endpoints;
+ * the public IP is nat_core_ctx.public_ips[pool_idx].
  */
 struct nat_entry {
-    /* Original (private) flow */
-    struct flow_key private_flow;
+    /* Customer side */
+    uint32_t private_ip;
+    uint16_t private_port;
     
-    /* Translated (public) flow */
-    uint32_t public_ip;
+    /* Translated (public) side */
     uint16_t public_port;
-    uint16_t reserved;
-    
-    /* State tracking */
-    enum nat_state state;
-    uint64_t last_activity;  /* TSC timestamp */
-    uint32_t packet_count;
-    uint64_t byte_count;
     
-    /* Customer information */
-    uint32_t customer_id;    /* Hash of private IP for tracking */
+    /* Remote peer */
+    uint32_t remote_ip;
+    uint16_t remote_port;
     
-    /* Timer wheel linkage */
-    uint32_t timer_index;
-    
-    /* Hash table linkage */
-    struct nat_entry *next;
+    uint8_t  protocol;
+    uint8_t  state;          /* enum nat_state */
+    uint32_t last_active;    /* Session clock (SESSION_CLOCK_HZ) */
+    uint16_t pool_idx;       /* Index into nat_core_ctx.port_pools (stable) */
+    uint8_t  flags;          /* NAT_FLAG_* */
+    uint8_t  customer;       /* Customer prefix of private_ip */
     
-    /* Flags */
-    uint8_t flags;
-    uint8_t padding[7];
-} __attribute__((aligned(64)));  /* Cache line aligned */
+    /* Timer wheel slot list (session indices, see TW_REF_*) */
+    uint32_t next;
+    uint32_t prev;
+} __attribute__((aligned(32)));
+
+/**
+ * Per-session accounting, kept in an array parallel to the entries
+ * The counters are only kept with session_accounting, which costs a
+ * second cache line per packet.
+ */
+struct nat_entry_stats {
+    uint64_t packets;
+    uint64_t bytes;
+    uint32_t created;        /* Session clock at creation */
+    uint32_t reserved;
+};
+
+/**
+ * Per-core session store
+ *
+ * Sessions live in one preallocated, cache-line-aligned array. Both hash
+ * tables map a flow key to an index into that array, so a lookup yields
+ * the entry directly and the fast path never touches an allocator. Free
+ * slots are kept on an index stack.
+ */
+struct session_table {
+    struct rte_hash *outbound_hash;     /* Private flow -> session index */
+    struct rte_hash *inbound_hash;      /* Public flow -> session index */
+    struct nat_entry *entries;          /* Hot: read on every packet */
+    struct nat_entry_stats *stats;      /* Cold: same index as entries */
+    uint32_t *free_list;                /* Stack of unused indices */
+    uint32_t free_count;
+    uint32_t capacity;
+};
+
+/**
+ * NAT event types: the natEvent values of RFC 8158
+ */
+enum nat_event_type {
+    NAT_EVENT_SESSION_CREATE = 4,       /* NAT44 session create */
+    NAT_EVENT_SESSION_DELETE = 5,       /* NAT44 session delete */
+    NAT_EVENT_BLOCK_ALLOC = 16,         /* Port block allocation */
+    NAT_EVENT_BLOCK_FREE = 17,          /* Port block de-allocation */
+};
+
+/**
+ * NAT event as queued by a worker for the event logger
+ * Fixed size, two per cache line; addresses and ports in host byte order.
+ */
+struct nat_event {
+    uint64_t tsc;                       /* Worker's burst timestamp */
+    uint32_t private_ip;
+    uint32_t public_ip;
+    uint32_t remote_ip;                 /* Sessions only */
+    uint16_t private_port;              /* Sessions only */
+    uint16_t public_port;               /* Port block: first port */
+    uint16_t remote_port;               /* Sessions only */
+    uint16_t port_end;                  /* Port block: last port */
+    uint8_t type;                       /* enum nat_event_type */
+    uint8_t protocol;                   /* Sessions only */
+    uint16_t reserved;
+};
+
+/**
+ * Events staged by a worker, moved to its ring in one burst
+ */
+struct nat_event_batch {
+    uint16_t count;
+    struct nat_event events[EVENT_BATCH_SIZE];
+};
+
+/**
+ * Packets waiting to be handed off to one other worker
+ */
+struct handoff_queue {
+    uint16_t count;
+    struct rte_mbuf *pkts[RX_BURST_SIZE];
+};
+
+/**
+ * Port block leased to one customer
+ */
+struct port_block {
+    uint32_t owner;                     /* Customer private IP */
+    uint16_t in_use;                    /* Ports allocated from this block */
+    uint16_t reserved;
+};
 
 /**
  * Port pool for a single public IP (per-core)
@@ -107,10 +298,288 @@ struct port_pool {
     uint32_t public_ip;
     uint16_t cursor;                    /* Rotating allocation cursor */
     uint16_t ports_allocated;
+    uint16_t ports_owned;               /* Ports in this worker's slices */
     uint64_t bitmap[1024];              /* 64K bits for port tracking */
     rte_atomic32_t exhaustion_events;
+    bool draining;                      /* Removed by reload: no new sessions */
+    uint16_t ip_pool;                   /* Customers served (customer_prefix.ip_pool) */
+    
+    /* Block allocation mode (block_size == 0: per-session allocation) */
+    uint16_t block_size;
+    uint16_t num_blocks;
+    uint16_t free_block_count;
+    uint16_t free_blocks[PORT_BLOCKS_MAX];  /* Stack of unleased blocks */
+    struct port_block blocks[PORT_BLOCKS_MAX];
+} __attribute__((aligned(64)));
+
+/**
+ * Partition of every public IP's port range across workers
+ * Port p belongs to worker ((p >> shift) & (num_slices - 1)) % num_workers,
+ * so each worker owns interleaved runs of 2^shift contiguous ports and the
+ * owner can be matched by a single masked rule on the destination port.
+ * The worker count is a power of two (config_validate()), so num_slices
+ * equals it and every worker owns the same share.
+ */
+struct port_partition {
+    uint8_t shift;                      /* log2(contiguous ports per slice) */
+    uint16_t num_slices;                /* == num_workers, a power of two */
+    uint16_t num_workers;
+};
+
+/**
+ * Customer prefix and the public IP pool serving it
+ * Pool IP_POOL_SHARED is nat.public_ips; a range listing its own
+ * public_ips gets a dedicated pool. Subscriber records of all prefixes
+ * share one table, each prefix starting at sub_base.
+ */
+struct customer_prefix {
+    uint32_t addr;                      /* Network address, host byte order */
+    uint8_t len;
+    uint16_t ip_pool;
+    uint32_t sub_base;                  /* Index of addr's subscriber record */
+};
+
+/**
+ * Receive-side scaling mode
+ */
+enum rss_mode {
+    RSS_MODE_FLOW = 0,      /* NIC default key; rte_flow steers public ports */
+    RSS_MODE_SYMMETRIC,     /* Symmetric key; public port chosen by hash */
+    RSS_MODE_SOFTWARE,      /* NIC hash ignored; workers hand off over rings */
+};
+
+/**
+ * RSS layout programmed into the NIC (read-only after port init)
+ *
+ * In symmetric mode the key repeats a 16-bit pattern, which makes the
+ * Toeplitz hash a linear function of the XOR of all 16-bit words of the
+ * tuple. Workers exploit that to pick public ports whose translated
+ * tuple lands back on their own queue.
+ */
+struct rss_config {
+    enum rss_mode mode;
+    uint8_t key[RSS_KEY_MAX];
+    uint8_t key_len;
+    uint16_t reta_size;                 /* Power of two */
+    uint16_t reta[RSS_RETA_MAX];        /* Queue for each hash bucket */
+};
+
+/**
+ * NIC port serving one side of the NAT (dpdk.ports)
+ * Without a next hop, translated packets leave with the Ethernet header
+ * they arrived with (one-arm setups where the switch does the steering).
+ * Otherwise the source MAC becomes the port's own and the destination the
+ * next hop's, configured or resolved by ARP for next_hop_ip.
+ */
+struct nat_side_config {
+    uint16_t port_id;
+    uint32_t local_ip;                  /* Answered in ARP, 0 = none */
+    uint32_t next_hop_ip;               /* Resolved by ARP, 0 = none */
+    struct rte_ether_addr next_hop_mac;
+    bool next_hop_static;               /* next_hop_mac is configured */
+};
+
+/**
+ * Egress state of one side, shared by all workers
+ * Workers read next_hop_mac once per TX batch and store it when ARP from
+ * next_hop_ip arrives; the main lcore sends the requests.
+ */
+struct egress_side {
+    uint16_t port_id;
+    bool rewrite;                       /* Set both Ethernet addresses on TX */
+    bool arp;                           /* next_hop_mac is learned by ARP */
+    struct rte_ether_addr port_mac;
+    uint32_t local_ip;                  /* Network byte order, 0 = none */
+    uint32_t next_hop_ip;               /* Network byte order */
+    uint64_t next_hop_mac;              /* MAC in the first 6 bytes, 0 = unresolved */
+    uint64_t arp_next_tsc;              /* Main lcore: next request due */
+};
+
+/**
+ * Per-subscriber state (per-core, indexed by sub_base plus the private
+ * IP's offset in its customer prefix)
+ */
+struct subscriber {
+    uint16_t block;                     /* Current port block, or PORT_BLOCK_NONE */
+    uint16_t pool_idx;                  /* Public IP of current block */
+    uint32_t sessions;                  /* Live sessions on this core */
+    
+    /* Token buckets in bytes, [0] upstream, [1] downstream */
+    uint32_t tokens[2];
+    uint32_t refilled;                  /* Session clock of last refill */
+};
+
+/**
+ * Two-level hierarchical timer wheel for session aging (per-core)
+ *
+ * Entries are linked into a slot by their deadline and re-evaluated lazily
+ * when the slot fires: activity only refreshes nat_entry.last_active, so
+ * the fast path never touches the wheel. Links are session indices into
+ * the session table's entry array.
+ */
+struct timer_wheel {
+    uint64_t cycles_per_tick;
+    uint64_t current_tick;              /* Last tick fully processed */
+    uint64_t next_tick_tsc;             /* TSC at which current_tick + 1 is due */
+    struct nat_entry *entries;          /* Session array the indices refer to */
+    
+    uint32_t cascade;                   /* L1 slot being redistributed */
+    uint32_t pending;                   /* L0 slot being evaluated */
+    bool pull_pending;                  /* L0 slot not yet moved to pending */
+    uint32_t num_timers;
+    
+    uint32_t l0[TW_L0_SLOTS];
+    uint32_t l1[TW_L1_SLOTS];
+} __attribute__((aligned(64)));
+
+/**
+ * What later fragments of a datagram get (frag_entry.state)
+ */
+enum frag_state {
+    FRAG_FREE = 0,
+    FRAG_PENDING,                       /* First fragment not seen yet */
+    FRAG_TRANSLATE,                     /* Rewrite address to new_addr */
+    FRAG_FORWARD                        /* Hand off to worker owner */
+};
+
+/**
+ * Fragment cache entry, keyed by (src, dst, proto, IP ID) as received
+ * Non-first fragments carry no L4 header; they reuse the address rewrite
+ * decided for the first fragment. The L4 checksum lives in the first
+ * fragment, whose incremental update already covers the whole datagram.
+ */
+struct frag_entry {
+    uint32_t src_ip;                    /* Network byte order */
+    uint32_t dst_ip;
+    uint16_t ip_id;
+    uint8_t protocol;
+    uint8_t state;                      /* enum frag_state */
+    uint32_t new_addr;                  /* FRAG_TRANSLATE, network byte order */
+    uint16_t owner;                     /* FRAG_FORWARD worker index */
+    uint8_t outbound;
+    uint8_t nb_held;
+    uint32_t last_active;               /* Session clock */
+    struct rte_mbuf *held[FRAG_HOLD_MAX];
 } __attribute__((aligned(64)));
 
+/**
+ * Per-core fragment cache: set-associative table plus a TX queue for
+ * held fragments released by their first fragment
+ */
+struct frag_cache {
+    struct frag_entry *entries;         /* [FRAG_CACHE_BUCKETS * FRAG_CACHE_WAYS] */
+    uint32_t timeout;                   /* Session clock units */
+    uint32_t sweep_cursor;              /* Next bucket checked for expiry */
+    uint16_t nb_ready;
+    struct rte_mbuf *ready[FRAG_READY_MAX];
+};
+
+/**
+ * ACL rule actions
+ */
+enum acl_action {
+    ACL_ACTION_PERMIT = 0,
+    ACL_ACTION_DENY
+};
+
+/**
+ * ACL rule as configured (host byte order, first match wins)
+ */
+struct acl_rule_spec {
+    uint32_t src_ip;
+    uint32_t dst_ip;
+    uint8_t src_len;                    /* Prefix lengths, 0 = any */
+    uint8_t dst_len;
+    uint8_t protocol;                   /* 0 = any */
+    uint8_t action;                     /* enum acl_action */
+    uint16_t src_port_lo;               /* Inclusive ranges */
+    uint16_t src_port_hi;
+    uint16_t dst_port_lo;
+    uint16_t dst_port_hi;
+};
+
+/**
+ * Compiled, immutable ACL rule set
+ * Workers classify against whichever set is active; the control plane
+ * builds a new one and swaps it in, freeing the old one after an RCU grace
+ * period. Hit counters have one cache-aligned row per worker.
+ */
+struct acl_ruleset {
+    struct rte_acl_ctx *acx;
+    struct acl_rule_spec *rules;        /* [num_rules], userdata = index + 1 */
+    uint32_t num_rules;
+    uint32_t generation;
+    unsigned int num_workers;
+    uint32_t hits_stride;               /* Counters per worker row */
+    uint64_t *hits;                     /* [num_workers][hits_stride] */
+};
+
+/**
+ * Slot through which workers find the active ACL rule set
+ */
+struct acl_stage {
+    struct acl_ruleset *active;         /* NULL = no ACL; atomic access only */
+    uint32_t generation;                /* Last generation built */
+};
+
+/**
+ * One worker's public IP table for a new nat_params generation
+ * The worker swaps its current tables in here when it adopts the
+ * generation, so retired tables are freed together with the params.
+ */
+struct nat_pool_set {
+    struct port_pool **port_pools;      /* [num_public_ips], slots added last */
+    uint32_t *public_ips;               /* [num_public_ips] */
+    bool adopted;                       /* Worker owns the added pools */
+};
+
+/**
+ * Hot-reloadable worker parameters (immutable once published)
+ *
+ * Workers adopt a new generation at the top of their loop, right after
+ * reporting quiescence, by copying it into their context. Public IPs keep
+ * their pool index across generations: removed addresses stay as draining
+ * pools, so existing sessions keep translating, and added ones are
+ * appended. pools is NULL when no address was added.
+ */
+struct nat_params {
+    uint32_t generation;
+    
+    uint64_t timeout_cycles[NAT_STATE_ICMP_ACTIVE + 1];  /* By nat_state */
+    uint32_t max_sessions_per_subscriber;
+    uint32_t policer_rate;              /* Bytes per session clock unit */
+    uint32_t policer_depth;
+    bool policer_mark;
+    
+    /* Public IP layout in pool index order */
+    int num_public_ips;
+    int first_added;                    /* Slots from here are new */
+    uint32_t *public_ips;               /* [num_public_ips] */
+    bool *draining;                     /* [num_public_ips] */
+    uint16_t *ip_pools;                 /* [num_public_ips] Customer pool of each */
+    unsigned int num_workers;
+    struct nat_pool_set *pools;         /* [num_workers], or NULL */
+};
+
+/**
+ * Slot through which workers find the current parameters
+ */
+struct nat_params_stage {
+    struct nat_params *active;          /* Atomic access only */
+    uint32_t generation;                /* Last generation built */
+};
+
+/**
+ * Log-linear histogram of processing time in TSC cycles
+ * Bucket b > 0 covers [2^e + s * 2^(e-SUB), 2^e + (s+1) * 2^(e-SUB)) with
+ * e = LAT_HIST_MIN_SHIFT + (b-1) / 2^SUB and s = (b-1) % 2^SUB, so the
+ * relative error stays below 25% from 256 cycles to 2^28 cycles.
+ */
+struct latency_hist {
+    uint64_t buckets[LAT_HIST_BUCKETS]; /* Packets per bucket */
+    uint64_t sum;                       /* Cycles, summed per packet */
+};
+
 /**
  * Per-core NAT statistics (no locks needed)
  */
@@ -129,57 +598,167 @@ struct core_stats {
     uint64_t port_alloc_success;
     uint64_t port_alloc_fail;
     uint64_t port_freed;
+    uint64_t port_blocks_allocated;
+    uint64_t port_blocks_freed;
+    
+    uint64_t handoff_tx;                /* Forwarded to the owning worker */
+    uint64_t handoff_rx;                /* Received from other workers */
+    uint64_t handoff_dropped;           /* Owner's ring was full */
+    
+    uint64_t icmp_errors_translated;    /* Quoted inner packet rewritten */
+    
+    uint64_t frag_hits;                 /* Later fragment matched its first */
+    uint64_t frag_misses;               /* Later fragment arrived first */
+    uint64_t frag_evictions;            /* Entry displaced, or expired holding fragments */
     
     uint64_t errors_no_memory;
     uint64_t errors_invalid_packet;
     uint64_t errors_no_ports;
+    uint64_t errors_session_limit;      /* Subscriber at max_sessions_per_customer */
+    
+    uint64_t policer_dropped;           /* Over rate, dropped */
+    uint64_t policer_marked;            /* Over rate, DSCP set to lower effort */
+    uint64_t acl_denied;                /* Outbound packet matched a deny rule */
+    uint64_t neighbor_unresolved;       /* Next hop MAC not known yet, dropped */
+    
+    uint64_t events_logged;             /* Queued for the event logger */
+    uint64_t events_dropped;            /* Event ring full */
     
-    /* Latency tracking (in CPU cycles) */
-    uint64_t latency_sum;
-    uint64_t latency_count;
-    uint64_t latency_max;
+    /* Burst processing time per packet, by direction */
+    struct latency_hist latency[NAT_DIRS];
 } __attribute__((aligned(64)));
 
+/**
+ * Copy of a worker's counters for readers on other threads
+ * The worker updates its live core_stats without synchronization and
+ * copies them here every STATS_PUBLISH_US; readers retry until the
+ * sequence number is unchanged across their copy. The pool table is
+ * republished as soon as a reload replaces it.
+ */
+struct core_stats_snapshot {
+    rte_seqcount_t seq;                 /* Written by the worker only */
+    struct core_stats stats;
+    struct port_pool *const *port_pools;    /* RCU readers only */
+    int num_public_ips;
+};
+
 /**
  * Per-core NAT context (lockless design)
  */
 struct nat_core_ctx {
     unsigned int core_id;
+    unsigned int worker_id;             /* Index in worker list / queue id */
     unsigned int socket_id;
     
-    /* DPDK structures */
-    struct rte_hash *outbound_hash;     /* Private -> Public */
-    struct rte_hash *inbound_hash;      /* Public -> Private */
-    struct rte_mempool *entry_pool;     /* NAT entry allocator */
+    /* Sessions and their lookup tables */
+    struct session_table sessions;
     
-    /* Port pools (one per public IP) */
-    struct port_pool port_pools[MAX_PUBLIC_IPS];
+    /* Port pools (one per public IP, table grows on reload) */
+    struct port_pool **port_pools;
+    uint32_t *public_ips;               /* Dense copy of port_pools[i]->public_ip */
     int num_public_ips;
     
+    /* Customer prefixes: LPM next hop indexes customers */
+    const struct rte_lpm *customer_lpm; /* Shared per socket, read-only */
+    struct customer_prefix *customers;  /* [num_customers] */
+    uint32_t num_customers;
+    
+    /* Serving pools of IP pool p: ip_pool_order[ip_pool_start[p]..[p + 1]) */
+    uint16_t *ip_pool_order;            /* [MAX_PUBLIC_IPS] Pool indices */
+    uint16_t *ip_pool_start;            /* [num_ip_pools + 1] */
+    uint16_t num_ip_pools;
+    uint16_t port_block_size;           /* 0 = per-session allocation */
+    
+    /* Inside port RSS key and RETA, NULL if the NIC keeps its own */
+    const struct rss_config *rss;
+    
+    /* Symmetric RSS: port XOR-offsets that hash to this worker's queue */
+    uint16_t *rss_ports;
+    uint32_t num_rss_ports;
+    uint32_t rss_cursor;
+    
+    /* Subscribers (one per address in the customer prefixes) */
+    struct subscriber *subscribers;
+    uint32_t num_subscribers;
+    uint32_t max_sessions_per_subscriber;   /* 0 = unlimited */
+    uint32_t policer_rate;              /* Bytes per session clock unit, 0 = off */
+    uint32_t policer_depth;             /* Bucket size in bytes */
+    bool policer_mark;                  /* Mark instead of drop when over rate */
+    
+    /* Session aging */
+    uint64_t now_tsc;                   /* Sampled once per burst */
+    uint32_t now;                       /* now_tsc on the session clock */
+    uint8_t clock_shift;                /* TSC >> shift = session clock */
+    struct timer_wheel timers;
+    uint64_t timeout_cycles[NAT_STATE_ICMP_ACTIVE + 1];  /* By nat_state */
+    
+    /* Non-first fragments of translated datagrams */
+    struct frag_cache frags;
+    
+    /* Handoff: SPSC ring matrix shared by all workers (if more than one) */
+    bool handoff_enabled;               /* Software mode: for every flow */
+    unsigned int num_workers;
+    struct port_partition port_partition;
+    struct rte_ring **handoff_out;      /* [num_workers] This -> worker i */
+    struct rte_ring **handoff_in;       /* [num_workers] Worker i -> this */
+    struct handoff_queue *handoff_queues;   /* [num_workers] Staged for worker i */
+    
+    /* NAT event log: staged here, drained by the logger thread */
+    struct nat_event_batch *events;     /* NULL if event logging is off */
+    struct rte_ring *event_ring;        /* SPSC, struct nat_event elements */
+    
+    /* Shared with the control plane */
+    struct nat_params_stage *params;    /* Reloadable settings, NULL if fixed */
+    uint32_t params_generation;         /* Generation copied into this context */
+    struct acl_stage *acl;              /* Outbound ACL, NULL if disabled */
+    struct rte_rcu_qsbr *rcu;           /* Workers report quiescence per loop */
+    
     /* Statistics (lockless, per-core) */
-    struct core_stats stats;
+    struct core_stats stats;            /* Live, worker only */
+    struct core_stats_snapshot stats_snapshot;  /* Published for readers */
     
     /* Configuration */
-    uint32_t customer_subnet;
-    uint32_t customer_netmask;
+    bool cksum_offload;                 /* NIC computes IP/L4 checksums */
+    bool session_accounting;            /* Count packets/bytes per session */
 } __attribute__((aligned(64)));
 
 /**
- * Global CGNAT configuration (read-only after init)
+ * Encoding of the NAT event log
+ */
+enum event_log_format {
+    EVENT_LOG_IPFIX = 0,                /* RFC 7011 messages, RFC 8158 templates */
+    EVENT_LOG_BINARY,                   /* struct nat_log_record, see logger.h */
+    EVENT_LOG_JSON,                     /* One object per line */
+};
+
+/**
+ * Global CGNAT configuration
+ * Read-only after init, except that a reload replaces the settings that
+ * struct nat_params and the ACL carry to the workers.
  */
 struct cgnat_config {
     /* DPDK configuration */
-    uint16_t port_id;
+    struct nat_side_config sides[NAT_SIDES];    /* Same port_id = one-arm */
     uint16_t num_queues;
     unsigned int num_workers;
-    unsigned int worker_cores[MAX_CORES];
+    bool checksum_offload;              /* Use NIC TX checksum offload */
+    struct rss_config rss;              /* Mode in, key/RETA out of port init */
     
     /* NAT configuration */
-    uint32_t public_ips[MAX_PUBLIC_IPS];
+    uint32_t *public_ips;               /* num_public_ips addresses */
+    uint16_t *public_ip_pools;          /* IP pool of each public IP */
     int num_public_ips;
+    uint32_t max_sessions;              /* Split evenly across workers */
+    bool session_accounting;            /* Per-session packet/byte counters */
     
-    uint32_t customer_subnet;
-    uint32_t customer_netmask;
+    /* Customer prefixes (disjoint), each served by one IP pool */
+    struct customer_prefix customer_prefixes[MAX_CUSTOMER_PREFIXES];
+    uint32_t num_customer_prefixes;
+    uint16_t num_ip_pools;              /* Shared pool plus dedicated ones */
+    
+    /* Port allocation (0 = per-session, else ports per customer block) */
+    uint16_t port_block_size;
+    struct port_partition port_partition;   /* Derived from workers/blocks */
     
     /* Timeouts */
     uint32_t timeout_tcp_established;
@@ -190,11 +769,34 @@ struct cgnat_config {
     
     /* Limits */
     uint32_t max_sessions_per_customer;
+    uint32_t max_bandwidth_mbps;        /* Per customer and direction, 0 = off */
+    bool bandwidth_mark;                /* Over rate: mark DSCP instead of drop */
+    uint32_t port_alert_threshold;      /* Percent of a public IP's ports in use */
+    
+    /* Outbound ACL: explicit rules first, then the block policy */
+    struct acl_rule_spec *acl_rules;    /* malloc'd, policy.acl.rules */
+    uint32_t num_acl_rules;
+    uint16_t acl_block_ports[ACL_BLOCK_PORTS_MAX];  /* Destination ports, TCP/UDP */
+    uint32_t num_acl_block_ports;
+    uint8_t acl_allow_protocols;        /* ACL_PROTO_* bitmask */
     
     /* Monitoring */
     bool telemetry_enabled;
     uint16_t prometheus_port;
+    bool api_enabled;
     uint16_t api_port;
+    
+    /* NAT event log (logging.*) */
+    bool event_log_enabled;
+    uint8_t event_log_format;           /* enum event_log_format */
+    char event_log_path[256];           /* File target */
+    uint32_t event_log_collector_ip;    /* UDP target if non-zero */
+    uint16_t event_log_collector_port;
+    uint32_t event_ring_size;           /* Events per worker ring */
+    uint32_t event_rate_limit;          /* Events written per second, 0 = off */
+    
+    /* Operations */
+    bool hot_reload;                    /* Reload the config file on SIGHUP */
 };
 
 /**
@@ -213,10 +815,32 @@ struct cgnat_global_stats {
     
     uint64_t total_port_alloc_fail;
     
+    struct latency_hist latency[NAT_DIRS];
     double avg_latency_us;
-    uint64_t max_latency_us;
+    double p99_latency_us;              /* Upper bound of the p99 bucket */
     
     uint64_t timestamp;
 };
 
+/**
+ * Port usage of one public IP, summed over the workers' pools
+ */
+struct public_ip_stats {
+    uint32_t public_ip;
+    uint32_t ports_allocated;
+    uint64_t exhaustion_events;
+    bool draining;
+};
+
+/**
+ * Per-core and per-public-IP statistics behind the labeled series
+ */
+struct cgnat_detail_stats {
+    uint32_t port_alert_threshold;      /* Percent, from the configuration */
+    unsigned int num_cores;
+    int num_public_ips;
+    struct core_stats cores[MAX_CORES];
+    struct public_ip_stats public_ips[MAX_PUBLIC_IPS];
+};
+
 #endif /* CGNAT_TYPES_H */
@@ -0,0 +1,66 @@
+/* SPDX-License-Identifier: MIT */
+/**
+ * @file config.h
+ * @brief Configuration defaults, YAML loading and validation
+ */
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include "cgnat_types.h"
+
+/**
+ * Fill a configuration with the built-in defaults
+ * Frees nothing: call on an uninitialized or config_free()d structure.
+ *
+ * @param config Configuration to initialize
+ * @return 0 on success, negative on allocation failure
+ */
+int config_set_defaults(struct cgnat_config *config);
+
+/**
+ * Load a YAML configuration file (see config/cgnat.yaml)
+ * Keys present in the file override the values already in config; keys
+ * this build does not use are ignored.
+ *
+ * @param filename Path of the YAML file
+ * @param config Configuration to update
+ * @return 0 on success, negative on I/O, syntax or value errors
+ */
+int config_load(const char *filename, struct cgnat_config *config);
+
+/**
+ * Check a complete configuration for consistency
+ *
+ * @param config Configuration
+ * @return 0 if valid, negative otherwise
+ */
+int config_validate(const struct cgnat_config *config);
+
+/**
+ * Release memory owned by a configuration (public IPs, ACL rules)
+ *
+ * @param config Configuration
+ */
+void config_free(struct cgnat_config *config);
+
+/**
+ * Parse "A.B.C.D" or "A.B.C.D/len"
+ *
+ * @param str Address or prefix
+ * @param addr Output address (host byte order)
+ * @param len Output prefix length (32 without a "/len")
+ * @return 0 on success, negative if malformed
+ */
+int config_parse_prefix(const char *str, uint32_t *addr, uint8_t *len);
+
+/**
+ * Replace the public IP pool by the host addresses of a prefix
+ *
+ * @param config Configuration
+ * @param prefix "A.B.C.D/len" with len in 20..32
+ * @return 0 on success, negative if malformed or out of memory
+ */
+int config_set_public_prefix(struct cgnat_config *config, const char *prefix);
+
+#endif /* CONFIG_H */
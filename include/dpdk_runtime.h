@@ -12,6 +12,24 @@
 #include <rte_ethdev.h>
 #include <rte_mempool.h>
 
+/**
+ * Worker context passed to each core
+ * Each worker polls its queue on every distinct port and owns one TX
+ * buffer per port; in one-arm mode both sides share them.
+ */
+struct worker_ctx {
+    unsigned int core_id;
+    unsigned int queue_id;
+    uint16_t rx_ports[NAT_SIDES];
+    bool rx_arp[NAT_SIDES];             /* ARP to learn or answer on the port */
+    uint16_t num_rx_ports;
+    struct egress_side *egress;         /* [NAT_SIDES] Shared by all workers */
+    struct rte_eth_dev_tx_buffer *tx_buf[NAT_SIDES];    /* By egress side */
+    uint64_t tx_drain_tsc;              /* Last flush of partial buffers */
+    uint64_t stats_publish_tsc;         /* Last statistics snapshot */
+    struct nat_core_ctx *nat_ctx;
+};
+
 /**
  * Initialize DPDK EAL (Environment Abstraction Layer)
  * 
@@ -23,14 +41,35 @@ int dpdk_eal_init(int argc, char **argv);
 
 /**
  * Configure NIC port for DPDK
+ * Sets up one RX and TX queue per worker plus a TX queue for the main
+ * lcore (queue num_queues), which sends ARP requests. Inside and outside
+ * ports get the same symmetric key and RETA so that both directions of a
+ * flow land on the same queue number.
  * 
  * @param port_id Port identifier
  * @param num_queues Number of RX/TX queues (one per worker core)
  * @param mbuf_pool Memory pool for packet buffers
+ * @param config Global configuration; checksum_offload is cleared if the
+ *               NIC lacks it, rss key/RETA are filled in symmetric mode
  * @return 0 on success, negative on error
  */
 int dpdk_port_init(uint16_t port_id, uint16_t num_queues,
-                   struct rte_mempool *mbuf_pool);
+                   struct rte_mempool *mbuf_pool, struct cgnat_config *config);
+
+/**
+ * Verify symmetric RSS port selection against the NIC hash
+ * For random flows on every worker, checks with rte_softrss that the
+ * outbound tuple hash is symmetric and that the translated return tuple
+ * maps through the RETA back to the allocating worker's queue.
+ * 
+ * @param config Global configuration (symmetric RSS mode)
+ * @param cores Per-core NAT contexts
+ * @param num_cores Number of cores
+ * @return 0 if every sample maps correctly, negative otherwise
+ */
+int dpdk_rss_self_test(const struct cgnat_config *config,
+                       const struct nat_core_ctx *cores,
+                       unsigned int num_cores);
 
 /**
  * Create packet buffer memory pool
@@ -44,6 +83,23 @@ struct rte_mempool *dpdk_create_mbuf_pool(const char *name,
                                           unsigned int num_mbufs,
                                           unsigned int socket_id);
 
+/**
+ * Steer inbound TCP/UDP traffic to the queue owning its public port
+ * Installs rte_flow rules matching each public IP and the masked
+ * destination port (see struct port_partition). Called again for public
+ * IPs added by a reload; on failure only this call's rules are removed.
+ * 
+ * @param port_id Port identifier
+ * @param part Port partition across workers
+ * @param public_ips Public IPs to steer
+ * @param num_public_ips Number of public IPs
+ * @return 0 on success, negative if the NIC cannot express the rules
+ */
+int dpdk_port_steer_public_ports(uint16_t port_id,
+                                 const struct port_partition *part,
+                                 const uint32_t *public_ips,
+                                 int num_public_ips);
+
 /**
  * Start NIC port
  * 
@@ -68,6 +124,75 @@ void dpdk_port_stop(uint16_t port_id);
  */
 int dpdk_get_link_status(uint16_t port_id, struct rte_eth_link *link);
 
+/**
+ * Set up the egress state of both sides after their ports are configured
+ * 
+ * @param sides Output egress state, [NAT_SIDES]
+ * @param config Global configuration
+ * @return 0 on success, negative if a port MAC cannot be read
+ */
+int dpdk_egress_init(struct egress_side *sides, const struct cgnat_config *config);
+
+/**
+ * Handle an ARP frame received on a port
+ * Learns the MAC of a side's next hop from any ARP it sends and turns a
+ * request for a side's local_ip into the reply, in place.
+ * 
+ * @param sides Egress state, [NAT_SIDES]
+ * @param port_id Port the frame arrived on
+ * @param m ARP frame
+ * @return Side whose TX buffer takes the reply, or -1 if m was freed
+ */
+int dpdk_arp_input(struct egress_side *sides, uint16_t port_id,
+                   struct rte_mbuf *m);
+
+/**
+ * Send the ARP requests that are due (main lcore)
+ * Every ARP_RETRY_MS while a next hop is unresolved, every ARP_REFRESH_S
+ * once it is.
+ * 
+ * @param sides Egress state, [NAT_SIDES]
+ * @param mbuf_pool Pool for the requests
+ * @param tx_queue TX queue reserved for the main lcore
+ */
+void dpdk_arp_poll(struct egress_side *sides, struct rte_mempool *mbuf_pool,
+                   uint16_t tx_queue);
+
+/**
+ * Set up a worker's ports and TX buffers
+ * 
+ * @param ctx Worker context to fill
+ * @param core_id Worker lcore
+ * @param queue_id RX/TX queue of the worker on every port
+ * @param egress Egress state, [NAT_SIDES]
+ * @param nat Worker's NAT context (TX buffers go on its socket)
+ * @return 0 on success, negative on allocation failure
+ */
+int dpdk_worker_init(struct worker_ctx *ctx, unsigned int core_id,
+                     unsigned int queue_id, struct egress_side *egress,
+                     struct nat_core_ctx *nat);
+
+/**
+ * Free a worker's TX buffers (after the worker has stopped)
+ * 
+ * @param ctx Worker context
+ */
+void dpdk_worker_cleanup(struct worker_ctx *ctx);
+
+/**
+ * Check whether SIGINT or SIGTERM asked the application to stop
+ * 
+ * @return true once shutdown was requested
+ */
+bool dpdk_quit_requested(void);
+
+/**
+ * Consume a pending configuration reload request (SIGHUP)
+ * 
+ * @return true if SIGHUP arrived since the last call
+ */
+bool dpdk_reload_requested(void);
+
 /**
  * Worker core main loop (packet processing)
  * 
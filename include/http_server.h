@@ -0,0 +1,146 @@
+/* SPDX-License-Identifier: MIT */
+/**
+ * @file http_server.h
+ * @brief Event-driven HTTP/1.1 server shared by the exporter and the API
+ *
+ * One epoll set on the main lcore serves every listener. Connections are
+ * non-blocking and persistent; handlers run to completion and fill a
+ * growable body that is gzip-compressed when the client accepts it, or
+ * hand back a producer that streams an unbounded body in chunks.
+ */
+
+#ifndef HTTP_SERVER_H
+#define HTTP_SERVER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define HTTP_REQUEST_MAX      8192      /* Request line and headers */
+#define HTTP_MAX_CONNS        256       /* Over all listeners */
+#define HTTP_MAX_LISTENERS    4
+#define HTTP_IDLE_TIMEOUT_S   30        /* Keep-alive connections */
+#define HTTP_GZIP_MIN         1024      /* Smaller bodies are sent as is */
+#define HTTP_STREAM_BURST     8         /* Stream calls per connection event */
+
+/**
+ * Growable output buffer
+ */
+struct http_buf {
+    char *data;
+    size_t len;
+    size_t cap;
+};
+
+/**
+ * Parsed request line and the headers the server acts on
+ * Strings point into the connection's input buffer and are valid for the
+ * duration of the handler call only.
+ */
+struct http_request {
+    const char *method;
+    const char *path;                   /* Without the query */
+    const char *query;                  /* After '?', or NULL */
+    bool accept_gzip;
+    bool keep_alive;
+    bool http11;                        /* Else HTTP/1.0 */
+};
+
+/**
+ * Streamed body producer
+ * Called each time the connection has sent what was produced before.
+ * Appends the next part of the body (possibly nothing) and should return
+ * after a bounded amount of work, so that other connections are served.
+ *
+ * @param arg Handler's argument
+ * @param buf Output to append to
+ * @return 1 while more follows, 0 when the body is complete, negative
+ *   on failure (the connection is closed)
+ */
+typedef int (*http_stream_t)(void *arg, struct http_buf *buf);
+
+/**
+ * Response filled in by a handler
+ * The body buffer is the server's and is reused; it starts empty. Its
+ * data may be replaced through http_buf_reserve() or written directly
+ * up to cap.
+ *
+ * A handler setting stream gets its body sent first and the producer's
+ * output after it, with chunked transfer coding (HTTP/1.0: until the
+ * connection closes) and without compression. stream_done, if set, is
+ * called with stream_arg exactly once, when the body is complete or the
+ * connection goes away.
+ */
+struct http_response {
+    int status;
+    const char *content_type;
+    struct http_buf body;
+    http_stream_t stream;
+    void *stream_arg;
+    void (*stream_done)(void *arg);
+};
+
+/**
+ * Request handler
+ *
+ * @param req Parsed request
+ * @param resp Response to fill in (status defaults to 200)
+ * @return 0 on success, negative on failure (a 500 is sent instead)
+ */
+typedef int (*http_handler_t)(const struct http_request *req,
+                              struct http_response *resp);
+
+/**
+ * Route: GET (and HEAD) of an exact path
+ */
+struct http_route {
+    const char *path;
+    http_handler_t handler;
+};
+
+/**
+ * Append formatted text to a buffer, growing it as needed
+ *
+ * @param buf Buffer
+ * @param fmt printf format
+ * @return 0 on success, negative on allocation failure
+ */
+int http_buf_printf(struct http_buf *buf, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+/**
+ * Make room for at least n more bytes
+ *
+ * @param buf Buffer
+ * @param n Bytes needed after buf->len
+ * @return 0 on success, negative on allocation failure
+ */
+int http_buf_reserve(struct http_buf *buf, size_t n);
+
+/**
+ * Open a listener and serve its routes from http_server_poll()
+ *
+ * @param name Name used in log messages
+ * @param port TCP port, all addresses
+ * @param routes Route table (must stay valid while the server runs)
+ * @param num_routes Number of routes
+ * @return 0 on success, negative on error
+ */
+int http_server_listen(const char *name, uint16_t port,
+                       const struct http_route *routes,
+                       unsigned int num_routes);
+
+/**
+ * Serve ready connections, waiting up to timeout_ms for events
+ * Sleeps for timeout_ms when nothing listens, so it can pace a loop.
+ *
+ * @param timeout_ms Longest wait in milliseconds
+ */
+void http_server_poll(int timeout_ms);
+
+/**
+ * Close all listeners and connections
+ */
+void http_server_close(void);
+
+#endif /* HTTP_SERVER_H */
@@ -0,0 +1,129 @@
+/* SPDX-License-Identifier: MIT */
+/**
+ * @file logger.h
+ * @brief Structured logging and the NAT event log
+ *
+ * Workers record session and port block events into a per-core batch and
+ * move it to their own single-producer/single-consumer ring once per loop
+ * pass. A logger thread drains the rings and writes the records in large
+ * batches as IPFIX, fixed-size binary records or JSON lines. A full ring
+ * drops the events and counts them (core_stats.events_dropped); workers
+ * never wait on the logger.
+ */
+
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include "cgnat_types.h"
+#include <rte_branch_prediction.h>
+
+typedef enum {
+    LOG_DEBUG,
+    LOG_INFO,
+    LOG_WARN,
+    LOG_ERROR,
+    LOG_FATAL
+} log_level_t;
+
+/**
+ * Binary event log record (logging.nat_events.format: binary)
+ * Multi-byte fields in network byte order.
+ */
+struct nat_log_record {
+    uint64_t timestamp_ms;              /* Unix time in milliseconds */
+    uint8_t event;                      /* enum nat_event_type (natEvent) */
+    uint8_t protocol;
+    uint16_t reserved;
+    uint32_t private_ip;
+    uint32_t public_ip;
+    uint32_t remote_ip;
+    uint16_t private_port;
+    uint16_t public_port;               /* Port block: first port */
+    uint16_t remote_port;
+    uint16_t port_end;                  /* Port block: last port */
+} __attribute__((__packed__));
+
+/**
+ * Write a timestamped log line
+ *
+ * @param level Severity
+ * @param format printf-style format
+ */
+void cgnat_log(log_level_t level, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+/**
+ * Give a worker its event ring and staging batch
+ * Without them the worker records no events.
+ *
+ * @param ctx Per-core NAT context (worker not started)
+ * @param size Ring capacity in events
+ * @return 0 on success, negative on error
+ */
+int nat_event_ring_init(struct nat_core_ctx *ctx, uint32_t size);
+
+/**
+ * Free a worker's event ring and batch
+ *
+ * @param ctx Per-core NAT context (worker and logger stopped)
+ */
+void nat_event_ring_free(struct nat_core_ctx *ctx);
+
+/**
+ * Move a worker's staged events to its ring, dropping what does not fit
+ * Use nat_event_flush() from the fast path.
+ *
+ * @param ctx Per-core NAT context
+ */
+void nat_event_ring_flush(struct nat_core_ctx *ctx);
+
+/**
+ * Take a slot for one event in the worker's batch
+ * A full batch is flushed to the ring first.
+ *
+ * @param ctx Per-core NAT context
+ * @return Event to fill in (type and tsc included), NULL if logging is off
+ */
+static inline struct nat_event *
+nat_event_alloc(struct nat_core_ctx *ctx)
+{
+    struct nat_event_batch *batch = ctx->events;
+
+    if (batch == NULL)
+        return NULL;
+    if (unlikely(batch->count == EVENT_BATCH_SIZE))
+        nat_event_ring_flush(ctx);
+    return &batch->events[batch->count++];
+}
+
+/**
+ * Move staged events to the ring, if there are any
+ * Called once per worker loop pass.
+ *
+ * @param ctx Per-core NAT context
+ */
+static inline void
+nat_event_flush(struct nat_core_ctx *ctx)
+{
+    if (ctx->events != NULL && ctx->events->count != 0)
+        nat_event_ring_flush(ctx);
+}
+
+/**
+ * Start the logger thread draining the workers' event rings
+ *
+ * @param cores Per-core NAT contexts with rings
+ * @param num_cores Number of workers
+ * @param config Event log target, format and rate
+ * @return 0 on success, negative on error
+ */
+int event_logger_start(struct nat_core_ctx *cores, unsigned int num_cores,
+                       const struct cgnat_config *config);
+
+/**
+ * Stop the logger thread after writing what the rings still hold
+ * Call once the workers have stopped.
+ */
+void event_logger_stop(void);
+
+#endif /* LOGGER_H */
@@ -9,17 +9,19 @@
 
 #include "cgnat_types.h"
 #include <rte_mbuf.h>
+#include <rte_ip.h>
 
 /**
  * Initialize per-core NAT context
  * 
  * @param ctx Per-core NAT context to initialize
  * @param core_id Logical core ID
+ * @param worker_id Worker index (owns this slice of every port range)
  * @param config Global configuration
  * @return 0 on success, negative on error
  */
 int nat_core_init(struct nat_core_ctx *ctx, unsigned int core_id,
-                  const struct cgnat_config *config);
+                  unsigned int worker_id, const struct cgnat_config *config);
 
 /**
  * Cleanup per-core NAT context
@@ -28,6 +30,14 @@ int nat_core_init(struct nat_core_ctx *ctx, unsigned int core_id,
  */
 void nat_core_cleanup(struct nat_core_ctx *ctx);
 
+/**
+ * Print the memory footprint of a per-core NAT context
+ *
+ * @param ctx Initialized per-core NAT context
+ * @return Total bytes allocated for ctx
+ */
+size_t nat_core_report_memory(const struct nat_core_ctx *ctx);
+
 /**
  * Process outbound packet (private -> public translation)
  * 
@@ -46,28 +56,190 @@ int nat_process_outbound(struct nat_core_ctx *ctx, struct rte_mbuf *m);
  */
 int nat_process_inbound(struct nat_core_ctx *ctx, struct rte_mbuf *m);
 
+/**
+ * Process a received burst (both directions)
+ * Classifies the burst, resolves all flow keys with one bulk lookup per
+ * table and only sends outbound misses through session creation.
+ * Translated packets are compacted to the front of pkts, each with its
+ * egress side (NAT_SIDE_*) in mbuf port; dropped packets are freed and
+ * counted.
+ * 
+ * @param ctx Per-core NAT context
+ * @param pkts Packet mbufs (at most RX_BURST_SIZE)
+ * @param nb_pkts Number of packets
+ * @return Number of translated packets left in pkts
+ */
+uint16_t nat_process_burst(struct nat_core_ctx *ctx, struct rte_mbuf **pkts,
+                           uint16_t nb_pkts);
+
 /**
  * Age out expired NAT sessions
- * Called periodically by worker cores
+ * Called on every pass of the worker loop; examines at most
+ * TW_EXPIRE_BUDGET sessions so a mass expiry never stalls a burst
  * 
  * @param ctx Per-core NAT context
  * @return Number of sessions expired
  */
 int nat_expire_sessions(struct nat_core_ctx *ctx);
 
+/**
+ * Create the software handoff ring matrix
+ * One single-producer/single-consumer ring per ordered pair of workers.
+ * With all_flows, nat_process_burst forwards every packet whose session
+ * belongs to another worker instead of dropping it as a miss. Otherwise
+ * the NIC places flows and only ICMP echo replies, ICMP errors and first
+ * fragments, which it hashes on the addresses alone, are forwarded.
+ *
+ * @param cores Initialized per-core NAT contexts
+ * @param num_workers Number of contexts
+ * @param all_flows True for software handoff mode
+ * @return 0 on success, negative on error
+ */
+int nat_handoff_init(struct nat_core_ctx *cores, unsigned int num_workers,
+                     bool all_flows);
+
+/**
+ * Worker owning the session of a flow
+ * In software handoff mode outbound flows are owned by their subscriber
+ * (private source IP). Otherwise they live where RSS put them, computed
+ * from the RSS key and RETA when known (else ctx's worker is assumed).
+ * Inbound flows are owned by the worker whose slice holds the public port
+ * (the echo identifier for ICMP, the quoted port for ICMP errors), or
+ * under symmetric RSS, for TCP and UDP, by the queue their tuple hashes to.
+ *
+ * @param ctx Per-core NAT context
+ * @param key Flow key as received
+ * @param outbound True if the source is a customer address
+ * @return Owning worker index
+ */
+unsigned int nat_flow_owner(const struct nat_core_ctx *ctx,
+                            const struct flow_key *key, bool outbound);
+
+/**
+ * Get the n-th public port candidate for a flow under symmetric RSS
+ * The translated return tuple of every candidate hashes to ctx's queue.
+ * 
+ * @param ctx Per-core NAT context (symmetric RSS mode)
+ * @param key Outbound flow key
+ * @param public_ip Public IP the flow is translated to
+ * @param n Candidate index
+ * @return Candidate port (may fall below PORT_RANGE_START)
+ */
+uint16_t nat_rss_port_candidate(const struct nat_core_ctx *ctx,
+                                const struct flow_key *key,
+                                uint32_t public_ip, uint32_t n);
+
+/**
+ * Get the n-th ICMP echo identifier candidate under symmetric RSS
+ * Replies hash on the addresses only, so identifiers come from ctx's
+ * slices of the port partition and replies are handed to their owner.
+ * 
+ * @param ctx Per-core NAT context
+ * @param n Candidate index
+ * @return Candidate identifier (may fall below PORT_RANGE_START)
+ */
+uint16_t nat_icmp_ident_candidate(const struct nat_core_ctx *ctx, uint32_t n);
+
+/**
+ * Take held fragments released by their first fragment
+ * They are already translated, egress side in mbuf port; the caller
+ * transmits them.
+ * 
+ * @param ctx Per-core NAT context
+ * @param pkts Output packet array
+ * @param max Capacity of pkts
+ * @return Number of packets stored in pkts
+ */
+uint16_t nat_frag_drain(struct nat_core_ctx *ctx, struct rte_mbuf **pkts,
+                        uint16_t max);
+
+/**
+ * Publish the worker's counters for nat_get_stats (worker only)
+ * 
+ * @param ctx Per-core NAT context
+ */
+void nat_stats_publish(struct nat_core_ctx *ctx);
+
 /**
  * Get per-core statistics
+ * Returns the snapshot last published by the worker, consistent across
+ * all counters and at most STATS_PUBLISH_US old. Safe from any thread;
+ * never delays the worker.
  * 
  * @param ctx Per-core NAT context
  * @param stats Output statistics buffer
  */
 void nat_get_stats(const struct nat_core_ctx *ctx, struct core_stats *stats);
 
+/**
+ * Get the worker's public IP port pools as last published
+ * The table may be replaced by a reload at any time: the caller must be
+ * an online reader of the data plane RCU until it is done with it. The
+ * pools themselves live as long as the worker.
+ * 
+ * @param ctx Per-core NAT context
+ * @param pools Output pool table, indexed like the public IPs
+ * @return Number of entries in pools
+ */
+int nat_get_port_pools(const struct nat_core_ctx *ctx,
+                       struct port_pool *const **pools);
+
+/**
+ * Get the worker owning a public port
+ * 
+ * @param part Port partition
+ * @param port Port number
+ * @return Worker index
+ */
+static inline unsigned int
+port_partition_owner(const struct port_partition *part, uint16_t port)
+{
+    return ((port >> part->shift) & (part->num_slices - 1)) % part->num_workers;
+}
+
+/**
+ * Compute how public port ranges are split across workers
+ * 
+ * @param part Output partition
+ * @param block_size Ports per customer block, 0 for per-session allocation
+ * @param num_workers Number of worker cores
+ */
+void port_partition_init(struct port_partition *part, uint16_t block_size,
+                         unsigned int num_workers);
+
+/**
+ * Initialize port pool with only the worker's own slices available
+ * 
+ * @param pool Port pool
+ * @param public_ip Public IP served by the pool
+ * @param block_size Ports per customer block, 0 for per-session allocation
+ * @param part Port partition, NULL if every worker may use the whole range
+ * @param worker_id Worker owning the pool
+ */
+void port_pool_init(struct port_pool *pool, uint32_t public_ip,
+                    uint16_t block_size, const struct port_partition *part,
+                    unsigned int worker_id);
+
+/**
+ * Allocate and initialize a port pool on a worker's NUMA node
+ * 
+ * @param public_ip Public IP served by the pool
+ * @param block_size Ports per customer block, 0 for per-session allocation
+ * @param part Port partition, NULL if every worker may use the whole range
+ * @param worker_id Worker owning the pool
+ * @param socket_id NUMA socket of the worker
+ * @return Pool (free with rte_free), or NULL on allocation failure
+ */
+struct port_pool *port_pool_create(uint32_t public_ip, uint16_t block_size,
+                                   const struct port_partition *part,
+                                   unsigned int worker_id,
+                                   unsigned int socket_id);
+
 /**
  * Allocate port from pool
  * 
  * @param pool Port pool
- * @return Allocated port number, or 0 on failure
+ * @return Allocated port number, or 0 on failure (or if draining)
  */
 uint16_t port_pool_alloc(struct port_pool *pool);
 
@@ -79,6 +251,15 @@ uint16_t port_pool_alloc(struct port_pool *pool);
  */
 void port_pool_free(struct port_pool *pool, uint16_t port);
 
+/**
+ * Allocate a specific port if it is free
+ * 
+ * @param pool Port pool
+ * @param port Port number (PORT_RANGE_START..PORT_RANGE_END)
+ * @return true if the port was free and is now allocated
+ */
+bool port_pool_claim(struct port_pool *pool, uint16_t port);
+
 /**
  * Check if port is allocated
  * 
@@ -88,4 +269,496 @@ void port_pool_free(struct port_pool *pool, uint16_t port);
  */
 bool port_pool_is_allocated(const struct port_pool *pool, uint16_t port);
 
+/**
+ * Lease a free port block to a customer (logs one compliance record)
+ * 
+ * @param pool Port pool in block mode
+ * @param owner Customer private IP
+ * @return Block index, or negative if no block is free (or if draining)
+ */
+int port_block_lease(struct port_pool *pool, uint32_t owner);
+
+/**
+ * Allocate port from a leased block
+ * 
+ * @param pool Port pool in block mode
+ * @param block Block index
+ * @return Allocated port number, or 0 if the block is exhausted
+ */
+uint16_t port_block_alloc(struct port_pool *pool, uint16_t block);
+
+/**
+ * Return a drained block to the pool (logs one compliance record)
+ * 
+ * @param pool Port pool in block mode
+ * @param block Block index
+ */
+void port_block_release(struct port_pool *pool, uint16_t block);
+
+/**
+ * Get the block containing a port
+ * 
+ * @param pool Port pool in block mode
+ * @param port Port number
+ * @return Block index
+ */
+uint16_t port_block_index(const struct port_pool *pool, uint16_t port);
+
+/**
+ * Get the first port of a block
+ * 
+ * @param pool Port pool in block mode
+ * @param block Block index
+ * @return Port number
+ */
+uint16_t port_block_first(const struct port_pool *pool, uint16_t block);
+
+/**
+ * Create a per-core session store with both lookup tables
+ *
+ * @param st Session table
+ * @param core_id Logical core ID (used in object names)
+ * @param capacity Maximum number of concurrent sessions
+ * @param socket_id NUMA socket for all allocations
+ * @return 0 on success, negative on error
+ */
+int session_table_init(struct session_table *st, unsigned int core_id,
+                       uint32_t capacity, unsigned int socket_id);
+
+/**
+ * Release all memory of a session store
+ *
+ * @param st Session table
+ */
+void session_table_free(struct session_table *st);
+
+/**
+ * Let the control plane read a session store concurrently
+ * Deleted keys are then reclaimed once all readers of the data plane RCU
+ * have reported quiescence. Call before the owning worker starts.
+ *
+ * @param st Session table
+ * @param rcu Data plane QSBR variable
+ * @return 0 on success, negative on error
+ */
+int session_table_attach_rcu(struct session_table *st,
+                             struct rte_rcu_qsbr *rcu);
+
+/**
+ * Approximate memory held by a session store (entries, free list and
+ * both hash tables)
+ *
+ * @param st Session table
+ * @return Bytes
+ */
+size_t session_table_footprint(const struct session_table *st);
+
+/**
+ * Take a free session slot
+ *
+ * @param st Session table
+ * @return Session index, or SESSION_INDEX_NONE if the table is full
+ */
+static inline uint32_t
+session_table_alloc(struct session_table *st)
+{
+    if (unlikely(st->free_count == 0))
+        return SESSION_INDEX_NONE;
+    return st->free_list[--st->free_count];
+}
+
+/**
+ * Return a session slot to the free list
+ *
+ * @param st Session table
+ * @param idx Session index
+ */
+static inline void
+session_table_release(struct session_table *st, uint32_t idx)
+{
+    st->free_list[st->free_count++] = idx;
+}
+
+/**
+ * Index of a session entry
+ *
+ * @param st Session table
+ * @param entry Entry inside st->entries
+ * @return Session index
+ */
+static inline uint32_t
+session_table_index(const struct session_table *st,
+                    const struct nat_entry *entry)
+{
+    return (uint32_t)(entry - st->entries);
+}
+
+/**
+ * Publish a session under its outbound and inbound keys
+ * Either both keys are added or neither.
+ *
+ * @param st Session table
+ * @param idx Session index
+ * @param out_key Private-side flow key
+ * @param in_key Public-side flow key
+ * @return 0 on success, negative if a hash table is full
+ */
+int session_table_insert(struct session_table *st, uint32_t idx,
+                         const struct flow_key *out_key,
+                         const struct flow_key *in_key);
+
+/**
+ * Remove both keys of a session (the slot itself is not released)
+ *
+ * @param st Session table
+ * @param out_key Private-side flow key
+ * @param in_key Public-side flow key
+ */
+void session_table_remove(struct session_table *st,
+                          const struct flow_key *out_key,
+                          const struct flow_key *in_key);
+
+/**
+ * Look up one flow key
+ *
+ * @param st Session table
+ * @param hash st->outbound_hash or st->inbound_hash
+ * @param key Flow key
+ * @return Session entry, or NULL on miss
+ */
+struct nat_entry *session_table_lookup(const struct session_table *st,
+                                       const struct rte_hash *hash,
+                                       const struct flow_key *key);
+
+/**
+ * Look up a burst of flow keys with one bulk probe
+ *
+ * @param st Session table
+ * @param hash st->outbound_hash or st->inbound_hash
+ * @param keys Flow key pointers
+ * @param nb_keys Number of keys (at most RX_BURST_SIZE)
+ * @param hit_mask Output bitmask of keys found
+ * @param entries Output session entry for every hit
+ */
+void session_table_lookup_bulk(const struct session_table *st,
+                               const struct rte_hash *hash,
+                               const void **keys, uint32_t nb_keys,
+                               uint64_t *hit_mask, struct nat_entry **entries);
+
+/**
+ * Callback of session_table_walk()
+ *
+ * @param arg Caller's argument
+ * @param entry Copy of a live session
+ * @param stats Copy of its accounting
+ */
+typedef void (*session_walk_fn)(void *arg, const struct nat_entry *entry,
+                                const struct nat_entry_stats *stats);
+
+/**
+ * Visit the sessions of a store while its worker runs
+ * Resumes at *pos and passes a copy of each session to fn. The caller
+ * must be an online reader of the data plane RCU for the duration of a
+ * call (the store attached with session_table_attach_rcu()) and may go
+ * offline between calls. Sessions created, removed or moved by the worker
+ * during a walk may be missed or visited twice.
+ *
+ * @param st Session table
+ * @param pos Walk position, 0 to start; updated
+ * @param max Most keys to visit in this call
+ * @param fn Callback
+ * @param arg Callback argument
+ * @return 1 if more keys may follow, 0 once the walk is complete
+ */
+int session_table_walk(const struct session_table *st, uint32_t *pos,
+                       unsigned int max, session_walk_fn fn, void *arg);
+
+/**
+ * Allocate a per-core fragment cache
+ *
+ * @param fc Fragment cache
+ * @param core_id Logical core ID (used in object names)
+ * @param socket_id NUMA socket for the table
+ * @param timeout Idle lifetime of an entry in session clock units
+ * @return 0 on success, negative on error
+ */
+int frag_cache_init(struct frag_cache *fc, unsigned int core_id,
+                    unsigned int socket_id, uint32_t timeout);
+
+/**
+ * Release a fragment cache and every fragment it still holds
+ *
+ * @param fc Fragment cache
+ */
+void frag_cache_free(struct frag_cache *fc);
+
+/**
+ * Memory held by one fragment cache table
+ *
+ * @return Bytes
+ */
+size_t frag_cache_footprint(void);
+
+/**
+ * Find the entry of a fragment's datagram
+ * An expired match is released (dropping what it holds) and not returned.
+ *
+ * @param fc Fragment cache
+ * @param ip IPv4 header of the fragment, as received
+ * @param now Session clock
+ * @param stats Counters charged for released fragments
+ * @return Entry, or NULL on miss
+ */
+struct frag_entry *frag_cache_lookup(struct frag_cache *fc,
+                                     const struct rte_ipv4_hdr *ip,
+                                     uint32_t now, struct core_stats *stats);
+
+/**
+ * Create a FRAG_PENDING entry for a fragment's datagram
+ * Never fails: a full bucket evicts its least recently used entry.
+ *
+ * @param fc Fragment cache
+ * @param ip IPv4 header of the fragment, as received
+ * @param now Session clock
+ * @param stats Counters charged for evictions
+ * @return New entry
+ */
+struct frag_entry *frag_cache_add(struct frag_cache *fc,
+                                  const struct rte_ipv4_hdr *ip,
+                                  uint32_t now, struct core_stats *stats);
+
+/**
+ * Free expired entries, sweeping a bounded number of buckets
+ *
+ * @param fc Fragment cache
+ * @param now Session clock
+ * @param budget Buckets to examine
+ * @param stats Counters charged for dropped fragments
+ */
+void frag_cache_expire(struct frag_cache *fc, uint32_t now, unsigned int budget,
+                       struct core_stats *stats);
+
+/**
+ * Compile an ACL rule set
+ *
+ * @param rules Rules in priority order (first match wins)
+ * @param num_rules Number of rules (1..ACL_MAX_RULES)
+ * @param num_workers Workers that will classify against it
+ * @param socket_id NUMA socket for the compiled tries
+ * @param generation Version number (used in object names)
+ * @return Rule set, or NULL on error
+ */
+struct acl_ruleset *acl_ruleset_create(const struct acl_rule_spec *rules,
+                                       uint32_t num_rules,
+                                       unsigned int num_workers, int socket_id,
+                                       uint32_t generation);
+
+/**
+ * Compile the ACL described by a configuration
+ * Explicit rules come first, then the TCP/UDP port block list, then a deny
+ * rule for each translated protocol that is not allowed.
+ *
+ * @param config Configuration
+ * @param socket_id NUMA socket for the compiled tries
+ * @param generation Version number (used in object names)
+ * @return Rule set, or NULL if the configuration has no rules or on error
+ */
+struct acl_ruleset *acl_ruleset_from_config(const struct cgnat_config *config,
+                                            int socket_id, uint32_t generation);
+
+/**
+ * Free a rule set no worker can still be using
+ *
+ * @param rs Rule set (may be NULL)
+ */
+void acl_ruleset_free(struct acl_ruleset *rs);
+
+/**
+ * Matches of one rule summed over all workers
+ *
+ * @param rs Rule set
+ * @param rule Rule index
+ * @return Hit count
+ */
+uint64_t acl_ruleset_hits(const struct acl_ruleset *rs, uint32_t rule);
+
+/**
+ * Publish a rule set and free the previous one after an RCU grace period
+ * Workers are never stopped; the call blocks until all have moved on.
+ *
+ * @param stage Slot read by the workers
+ * @param rs New rule set, or NULL to disable the ACL
+ * @param rcu Workers' QSBR variable, NULL if workers are not running
+ */
+void acl_stage_swap(struct acl_stage *stage, struct acl_ruleset *rs,
+                    struct rte_rcu_qsbr *rcu);
+
+/**
+ * Classify a burst of outbound flow keys with one rte_acl call
+ * Counts a hit for the matching rule in this worker's row.
+ *
+ * @param rs Active rule set
+ * @param worker_id Caller's worker index
+ * @param keys Flow key pointers
+ * @param nb_keys Number of keys (at most RX_BURST_SIZE)
+ * @return Bitmask of keys matching a deny rule
+ */
+uint64_t acl_classify_burst(const struct acl_ruleset *rs, unsigned int worker_id,
+                            const void **keys, uint32_t nb_keys);
+
+/**
+ * Session clock divisor: largest power-of-two TSC divisor at or below
+ * SESSION_CLOCK_HZ
+ *
+ * @param hz TSC frequency
+ * @return Shift such that TSC >> shift is the session clock
+ */
+uint8_t nat_session_clock_shift(uint64_t hz);
+
+/**
+ * Convert configured timeouts and limits into worker units
+ * Fills only the scalar part of the parameters (no public IP layout).
+ *
+ * @param params Output parameters
+ * @param config Configuration
+ */
+void nat_params_derive(struct nat_params *params,
+                       const struct cgnat_config *config);
+
+/**
+ * Build a parameter generation for publishing to the workers
+ * Public IPs of prev keep their pool index; addresses missing from config
+ * become draining and new ones are appended, with their port pools created
+ * on each worker's NUMA node. Must not run while an earlier generation is
+ * still being adopted (nat_params_swap() waits for that).
+ *
+ * @param config New configuration
+ * @param prev Active generation, NULL for the first one
+ * @param cores Worker contexts (current pool tables)
+ * @param generation Generation number
+ * @return Parameters, or NULL on error
+ */
+struct nat_params *nat_params_create(const struct cgnat_config *config,
+                                     const struct nat_params *prev,
+                                     const struct nat_core_ctx *cores,
+                                     uint32_t generation);
+
+/**
+ * Free parameters, including pool tables the workers retired into them
+ *
+ * @param params Parameters (NULL is ignored)
+ */
+void nat_params_free(struct nat_params *params);
+
+/**
+ * Copy a parameter generation into a worker context (worker only)
+ * Swaps in the new pool tables, if any, and hands the old ones back to
+ * params for freeing.
+ *
+ * @param ctx Worker context
+ * @param params Published parameters
+ */
+void nat_params_apply(struct nat_core_ctx *ctx, struct nat_params *params);
+
+/**
+ * Publish parameters and free the previous generation once every worker
+ * has adopted the new one (two RCU grace periods)
+ *
+ * @param stage Slot read by the workers
+ * @param params New parameters, or NULL at shutdown
+ * @param rcu Workers' QSBR variable, NULL if workers are not running
+ */
+void nat_params_swap(struct nat_params_stage *stage, struct nat_params *params,
+                     struct rte_rcu_qsbr *rcu);
+
+/**
+ * Build the customer prefix table for one NUMA socket
+ * The next hop of each prefix is its index in config->customer_prefixes.
+ *
+ * @param config Validated configuration (prefixes are disjoint)
+ * @param socket_id NUMA socket of the workers using the table
+ * @return LPM table, or NULL on error
+ */
+struct rte_lpm *customer_lpm_create(const struct cgnat_config *config,
+                                    int socket_id);
+
+/**
+ * Sort a worker's public IPs by the IP pool they serve (worker only)
+ * Draining addresses are left out. Called whenever the pool table or the
+ * pools' ip_pool or draining flags change.
+ *
+ * @param ctx Worker context
+ */
+void nat_ip_pools_build(struct nat_core_ctx *ctx);
+
+/**
+ * Callback returning the current deadline (in wheel ticks) of a session
+ */
+typedef uint64_t (*timer_wheel_deadline_fn)(const struct nat_entry *entry,
+                                            void *arg);
+
+/**
+ * Callback releasing a session whose deadline has passed
+ */
+typedef void (*timer_wheel_expire_fn)(struct nat_entry *entry, void *arg);
+
+/**
+ * Initialize timer wheel
+ * 
+ * @param tw Timer wheel
+ * @param entries Session array that scheduled indices refer to
+ * @param cycles_per_tick TSC cycles per wheel tick
+ * @param now_tsc Current TSC
+ */
+void timer_wheel_init(struct timer_wheel *tw, struct nat_entry *entries,
+                      uint64_t cycles_per_tick, uint64_t now_tsc);
+
+/**
+ * Convert a TSC timestamp to a wheel tick (rounded up)
+ * 
+ * @param tw Timer wheel
+ * @param tsc TSC timestamp
+ * @return Wheel tick
+ */
+uint64_t timer_wheel_tsc_to_tick(const struct timer_wheel *tw, uint64_t tsc);
+
+/**
+ * Schedule entry on the wheel
+ * 
+ * @param tw Timer wheel
+ * @param idx Session index (must not already be linked)
+ * @param deadline_tick Tick at which the entry is due
+ */
+void timer_wheel_add(struct timer_wheel *tw, uint32_t idx,
+                     uint64_t deadline_tick);
+
+/**
+ * Move a scheduled entry to a new deadline
+ * Needed only when a deadline moves earlier; later deadlines are picked up
+ * lazily when the old slot fires.
+ * 
+ * @param tw Timer wheel
+ * @param idx Session index (must be linked)
+ * @param deadline_tick Tick at which the entry is due
+ */
+void timer_wheel_reschedule(struct timer_wheel *tw, uint32_t idx,
+                            uint64_t deadline_tick);
+
+/**
+ * Advance wheel to now_tsc, examining at most budget entries
+ * Entries whose deadline has not passed are rescheduled.
+ * 
+ * @param tw Timer wheel
+ * @param now_tsc Current TSC
+ * @param budget Maximum number of entries to examine
+ * @param deadline_fn Returns current deadline of an entry
+ * @param expire_fn Releases an expired entry
+ * @param arg Opaque argument passed to callbacks
+ * @return Number of entries expired
+ */
+int timer_wheel_advance(struct timer_wheel *tw, uint64_t now_tsc,
+                        unsigned int budget,
+                        timer_wheel_deadline_fn deadline_fn,
+                        timer_wheel_expire_fn expire_fn, void *arg);
+
 #endif /* NAT_ENGINE_H */
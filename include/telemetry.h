@@ -9,6 +9,8 @@
 
 #include "cgnat_types.h"
 
+struct rte_rcu_qsbr;
+
 /**
  * Initialize telemetry system
  * 
@@ -19,33 +21,88 @@ int telemetry_init(const struct cgnat_config *config);
 
 /**
  * Start Prometheus metrics exporter
- * Runs in separate thread
+ * Serves GET /metrics from the shared HTTP server (see http_server_poll)
  * 
  * @param port TCP port for HTTP server
  * @return 0 on success, negative on error
  */
 int telemetry_start_prometheus(uint16_t port);
 
+/**
+ * Start the statistics collector thread
+ * Every STATS_COLLECT_S it aggregates the workers' published snapshots,
+ * makes the result available to stats_collector_read() and logs it,
+ * along with public IPs crossing the port utilization alert threshold.
+ * 
+ * @param cores Array of per-core contexts
+ * @param num_cores Number of cores
+ * @param rcu Data plane RCU with room for num_cores + 1 threads; the
+ *            collector registers as thread num_cores to read port pools
+ * @param alert_threshold Port utilization alert, percent
+ * @return 0 on success, negative on error
+ */
+int stats_collector_start(const struct nat_core_ctx *cores,
+                          unsigned int num_cores, struct rte_rcu_qsbr *rcu,
+                          uint32_t alert_threshold);
+
+/**
+ * Change the port utilization alert threshold (after a reload)
+ * 
+ * @param alert_threshold Percent of a public IP's ports in use
+ */
+void stats_collector_set_alert_threshold(uint32_t alert_threshold);
+
+/**
+ * Stop the statistics collector thread and wait for it
+ */
+void stats_collector_stop(void);
+
+/**
+ * Get the latest aggregate (any thread, lock-free)
+ * 
+ * @param stats Output aggregated statistics (zero before the first pass)
+ */
+void stats_collector_read(struct cgnat_global_stats *stats);
+
+/**
+ * Get the latest aggregate with its per-core and per-public-IP detail
+ * 
+ * @param stats Output aggregated statistics
+ * @param detail Output detail (large: allocate it on the heap)
+ */
+void stats_collector_read_detail(struct cgnat_global_stats *stats,
+                                 struct cgnat_detail_stats *detail);
+
 /**
  * Aggregate statistics from all cores
+ * Reads each core's published snapshot (see nat_get_stats). Filling in
+ * the port pool detail requires being an online data plane RCU reader.
  * 
  * @param cores Array of per-core contexts
  * @param num_cores Number of cores
  * @param global_stats Output aggregated statistics
+ * @param detail Output per-core and per-public-IP statistics, or NULL
  */
 void telemetry_aggregate_stats(const struct nat_core_ctx *cores,
                                unsigned int num_cores,
-                               struct cgnat_global_stats *global_stats);
+                               struct cgnat_global_stats *global_stats,
+                               struct cgnat_detail_stats *detail);
 
 /**
  * Export metrics in Prometheus format
  * 
+ * Per-core and per-public-IP series carry core="N" and public_ip="a.b.c.d"
+ * labels. Like snprintf, the output is cut short when it does not fit and
+ * the full length is returned, so the caller can retry with more room.
+ * 
  * @param global_stats Aggregated statistics
+ * @param detail Per-core and per-public-IP statistics, or NULL
  * @param buffer Output buffer
  * @param buf_size Buffer size
- * @return Number of bytes written
+ * @return Length of the complete output, excluding the terminating NUL
  */
 int telemetry_export_prometheus(const struct cgnat_global_stats *global_stats,
+                                const struct cgnat_detail_stats *detail,
                                 char *buffer, size_t buf_size);
 
 /**
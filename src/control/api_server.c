@@ -2,49 +2,91 @@
 /**
  * @file api_server.c
  * @brief REST API server for control and monitoring
+ *
+ * /api/sessions lists the workers' live sessions, optionally filtered by
+ * private IP or public IP and port, as NDJSON or binary records. The
+ * response is streamed: every part walks at most SESSION_WALK_BATCH keys
+ * of one worker's outbound table as an RCU reader, so neither the table
+ * size nor a slow client ties up memory, the control loop or a worker.
+ * Filtered queries walk the same tables; no index is kept for them.
  */
 
+#include "api_server.h"
 #include "cgnat_types.h"
+#include "http_server.h"
+#include "nat_engine.h"
+#include "telemetry.h"
+#include <arpa/inet.h>
+#include <ctype.h>
+#include <rte_byteorder.h>
+#include <rte_common.h>
+#include <rte_cycles.h>
+#include <rte_rcu_qsbr.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <unistd.h>
-#include <pthread.h>
-#include <sys/socket.h>
-#include <netinet/in.h>
+#include <time.h>
 
-/* External references */
-extern struct cgnat_global_stats *g_global_stats;
-extern pthread_mutex_t g_stats_lock;
+#define SESSION_WALK_BATCH   1024      /* Keys visited per response part */
+#define QUERY_VALUE_MAX      64
 
-static int api_running = 0;
-static pthread_t api_thread;
+enum session_format {
+    SESSION_FORMAT_NDJSON,
+    SESSION_FORMAT_BINARY,
+};
 
-static void
-send_json_response(int client_fd, const char *json)
-{
-    char response[8192];
-    int response_len = snprintf(response, sizeof(response),
-                               "HTTP/1.1 200 OK\r\n"
-                               "Content-Type: application/json\r\n"
-                               "Content-Length: %lu\r\n"
-                               "Access-Control-Allow-Origin: *\r\n"
-                               "Connection: close\r\n"
-                               "\r\n"
-                               "%s",
-                               strlen(json), json);
-    
-    write(client_fd, response, response_len);
-}
+struct session_query {
+    bool by_private_ip;
+    bool by_public_ip;
+    bool by_public_port;
+    uint32_t private_ip;                /* Host byte order */
+    uint32_t public_ip;
+    uint16_t public_port;
+    enum session_format format;
+};
 
-static void
-handle_stats_request(int client_fd)
+/* State of one streamed session listing */
+struct session_walk {
+    struct session_query query;
+    unsigned int core;                  /* Worker being walked */
+    uint32_t pos;                       /* rte_hash_iterate position */
+    
+    /* Valid during one part */
+    struct http_buf *out;
+    struct port_pool *const *pools;
+    int num_pools;
+    uint32_t now;                       /* Worker's session clock */
+    uint64_t clock_hz;
+    uint64_t wall_now;
+    int error;
+};
+
+static const struct nat_core_ctx *api_cores;
+static unsigned int api_num_cores;
+static struct rte_rcu_qsbr *api_rcu;
+static unsigned int api_rcu_thread_id;
+
+static const char *const state_names[] = {
+    [NAT_STATE_CLOSED] = "closed",
+    [NAT_STATE_SYN_SENT] = "syn_sent",
+    [NAT_STATE_ESTABLISHED] = "established",
+    [NAT_STATE_FIN_WAIT] = "fin_wait",
+    [NAT_STATE_CLOSING] = "closing",
+    [NAT_STATE_TIME_WAIT] = "time_wait",
+    [NAT_STATE_UDP_ACTIVE] = "udp_active",
+    [NAT_STATE_ICMP_ACTIVE] = "icmp_active",
+};
+
+static int
+handle_stats_request(const struct http_request *req __rte_unused,
+                     struct http_response *resp)
 {
-    char json[4096];
+    struct cgnat_global_stats stats;
     
-    pthread_mutex_lock(&g_stats_lock);
+    stats_collector_read(&stats);
     
-    snprintf(json, sizeof(json),
+    resp->content_type = "application/json";
+    return http_buf_printf(&resp->body,
             "{\n"
             "  \"packets_rx\": %lu,\n"
             "  \"packets_tx\": %lu,\n"
@@ -56,108 +98,324 @@ handle_stats_request(int client_fd)
             "  \"sessions_expired\": %lu,\n"
             "  \"port_allocation_failures\": %lu,\n"
             "  \"avg_latency_us\": %.2f,\n"
-            "  \"max_latency_us\": %lu,\n"
+            "  \"p99_latency_us\": %.2f,\n"
             "  \"timestamp\": %lu\n"
             "}",
-            g_global_stats->total_packets_rx,
-            g_global_stats->total_packets_tx,
-            g_global_stats->total_packets_dropped,
-            g_global_stats->total_bytes_rx,
-            g_global_stats->total_bytes_tx,
-            g_global_stats->total_nat_sessions,
-            g_global_stats->total_nat_created,
-            g_global_stats->total_nat_expired,
-            g_global_stats->total_port_alloc_fail,
-            g_global_stats->avg_latency_us,
-            g_global_stats->max_latency_us,
-            g_global_stats->timestamp);
-    
-    pthread_mutex_unlock(&g_stats_lock);
-    
-    send_json_response(client_fd, json);
+            stats.total_packets_rx,
+            stats.total_packets_tx,
+            stats.total_packets_dropped,
+            stats.total_bytes_rx,
+            stats.total_bytes_tx,
+            stats.total_nat_sessions,
+            stats.total_nat_created,
+            stats.total_nat_expired,
+            stats.total_port_alloc_fail,
+            stats.avg_latency_us,
+            stats.p99_latency_us,
+            stats.timestamp);
 }
 
-static void *
-api_server_thread(void *arg)
+/* Helper: Percent-decode a query value of len bytes */
+static int
+query_decode(const char *in, size_t len, char *out, size_t size)
 {
-    uint16_t port = *(uint16_t *)arg;
-    int server_fd, client_fd;
-    struct sockaddr_in address;
-    int opt = 1;
-    char buffer[4096];
-    
-    server_fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (server_fd == 0) {
-        perror("socket failed");
-        return NULL;
+    size_t n = 0;
+    
+    for (size_t i = 0; i < len; i++) {
+        char c = in[i];
+        
+        if (c == '%') {
+            char hex[3] = { 0 };
+            
+            if (i + 2 >= len || !isxdigit((unsigned char)in[i + 1]) ||
+                !isxdigit((unsigned char)in[i + 2]))
+                return -1;
+            memcpy(hex, in + i + 1, 2);
+            c = (char)strtoul(hex, NULL, 16);
+            i += 2;
+        } else if (c == '+') {
+            c = ' ';
+        }
+        
+        if (n + 1 >= size)
+            return -1;
+        out[n++] = c;
     }
     
-    setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    out[n] = '\0';
+    return 0;
+}
+
+/* Helper: Parse a dotted-quad address to host byte order */
+static int
+parse_ipv4(const char *str, uint32_t *ip)
+{
+    struct in_addr addr;
     
-    address.sin_family = AF_INET;
-    address.sin_addr.s_addr = INADDR_ANY;
-    address.sin_port = htons(port);
+    if (inet_pton(AF_INET, str, &addr) != 1)
+        return -1;
+    *ip = ntohl(addr.s_addr);
+    return 0;
+}
+
+/* Helper: Parse "ip" or "ip:port" */
+static int
+parse_public(char *str, struct session_query *q)
+{
+    char *colon = strchr(str, ':');
     
-    if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
-        perror("bind failed");
-        close(server_fd);
-        return NULL;
+    if (colon) {
+        char *end;
+        unsigned long port;
+        
+        *colon = '\0';
+        port = strtoul(colon + 1, &end, 10);
+        if (end == colon + 1 || *end != '\0' || port == 0 || port > UINT16_MAX)
+            return -1;
+        q->by_public_port = true;
+        q->public_port = (uint16_t)port;
     }
     
-    if (listen(server_fd, 10) < 0) {
-        perror("listen failed");
-        close(server_fd);
-        return NULL;
+    q->by_public_ip = true;
+    return parse_ipv4(str, &q->public_ip);
+}
+
+/*
+ * Helper: Parse the sessions query string
+ * Unknown parameters are rejected rather than ignored, so that a typo
+ * cannot turn a lookup into a full dump. Errors are described in err.
+ */
+static int
+parse_session_query(const char *query, struct session_query *q,
+                    struct http_buf *err)
+{
+    memset(q, 0, sizeof(*q));
+    
+    while (query && *query != '\0') {
+        size_t len = strcspn(query, "&");
+        const char *eq = memchr(query, '=', len);
+        char value[QUERY_VALUE_MAX];
+        size_t name_len;
+        int rc;
+        
+        if (!eq || query_decode(eq + 1, query + len - eq - 1,
+                                value, sizeof(value)) < 0) {
+            http_buf_printf(err, "Malformed parameter: %.*s\n", (int)len, query);
+            return -1;
+        }
+        name_len = eq - query;
+        
+        if (name_len == strlen("private_ip") &&
+            strncmp(query, "private_ip", name_len) == 0) {
+            q->by_private_ip = true;
+            rc = parse_ipv4(value, &q->private_ip);
+        } else if (name_len == strlen("public") &&
+                   strncmp(query, "public", name_len) == 0) {
+            rc = parse_public(value, q);
+        } else if (name_len == strlen("format") &&
+                   strncmp(query, "format", name_len) == 0) {
+            rc = 0;
+            if (strcmp(value, "ndjson") == 0)
+                q->format = SESSION_FORMAT_NDJSON;
+            else if (strcmp(value, "binary") == 0)
+                q->format = SESSION_FORMAT_BINARY;
+            else
+                rc = -1;
+        } else {
+            http_buf_printf(err, "Unknown parameter: %.*s\n",
+                            (int)name_len, query);
+            return -1;
+        }
+        
+        if (rc < 0) {
+            http_buf_printf(err, "Invalid %.*s: %s\n", (int)name_len, query,
+                            value);
+            return -1;
+        }
+        
+        query += len;
+        if (*query == '&')
+            query++;
     }
     
-    printf("[API] REST API server listening on port %u\n", port);
+    return 0;
+}
+
+/* Helper: Unix time of a session clock value of the walked worker */
+static uint32_t
+session_wall_time(const struct session_walk *w, uint32_t t)
+{
+    int32_t age = (int32_t)(w->now - t);
+    
+    return (uint32_t)(w->wall_now - (age > 0 ? (uint64_t)age / w->clock_hz : 0));
+}
+
+/* Helper: Format a host byte order address */
+static const char *
+ip_str(uint32_t ip, char *buf, size_t size)
+{
+    snprintf(buf, size, "%u.%u.%u.%u",
+             (ip >> 24) & 0xFF, (ip >> 16) & 0xFF, (ip >> 8) & 0xFF, ip & 0xFF);
+    return buf;
+}
+
+/* Helper: Append one session matching the query (session_walk_fn) */
+static void
+session_emit(void *arg, const struct nat_entry *entry,
+             const struct nat_entry_stats *stats)
+{
+    struct session_walk *w = arg;
+    const struct session_query *q = &w->query;
+    uint32_t public_ip = 0;
     
-    while (api_running) {
-        socklen_t addrlen = sizeof(address);
-        client_fd = accept(server_fd, (struct sockaddr *)&address, &addrlen);
-        if (client_fd < 0) {
-            if (api_running)
-                perror("accept failed");
-            continue;
-        }
+    if (entry->pool_idx < w->num_pools)
+        public_ip = w->pools[entry->pool_idx]->public_ip;
+    
+    if ((q->by_private_ip && entry->private_ip != q->private_ip) ||
+        (q->by_public_ip && public_ip != q->public_ip) ||
+        (q->by_public_port && entry->public_port != q->public_port) ||
+        w->error)
+        return;
+    
+    if (q->format == SESSION_FORMAT_BINARY) {
+        struct session_record rec = {
+            .private_ip = rte_cpu_to_be_32(entry->private_ip),
+            .public_ip = rte_cpu_to_be_32(public_ip),
+            .remote_ip = rte_cpu_to_be_32(entry->remote_ip),
+            .private_port = rte_cpu_to_be_16(entry->private_port),
+            .public_port = rte_cpu_to_be_16(entry->public_port),
+            .remote_port = rte_cpu_to_be_16(entry->remote_port),
+            .protocol = entry->protocol,
+            .state = entry->state,
+            .core = rte_cpu_to_be_16(w->core),
+            .created = rte_cpu_to_be_32(session_wall_time(w, stats->created)),
+            .last_active = rte_cpu_to_be_32(session_wall_time(w, entry->last_active)),
+            .packets = rte_cpu_to_be_64(stats->packets),
+            .bytes = rte_cpu_to_be_64(stats->bytes),
+        };
         
-        /* Read HTTP request */
-        ssize_t bytes_read = read(client_fd, buffer, sizeof(buffer) - 1);
-        if (bytes_read > 0) {
-            buffer[bytes_read] = '\0';
-            
-            /* Parse request */
-            if (strstr(buffer, "GET /api/stats")) {
-                handle_stats_request(client_fd);
-            } else {
-                /* 404 Not Found */
-                char *response = "HTTP/1.1 404 Not Found\r\n"
-                                "Content-Length: 0\r\n"
-                                "Connection: close\r\n\r\n";
-                write(client_fd, response, strlen(response));
-            }
+        if (http_buf_reserve(w->out, sizeof(rec)) < 0) {
+            w->error = -1;
+            return;
         }
+        memcpy(w->out->data + w->out->len, &rec, sizeof(rec));
+        w->out->len += sizeof(rec);
+    } else {
+        char priv[16], pub[16], remote[16];
         
-        close(client_fd);
+        w->error = http_buf_printf(w->out,
+                "{\"core\":%u,\"protocol\":%u,\"state\":\"%s\","
+                "\"private_ip\":\"%s\",\"private_port\":%u,"
+                "\"public_ip\":\"%s\",\"public_port\":%u,"
+                "\"remote_ip\":\"%s\",\"remote_port\":%u,"
+                "\"created\":%u,\"last_active\":%u,"
+                "\"packets\":%lu,\"bytes\":%lu}\n",
+                w->core, entry->protocol,
+                entry->state < RTE_DIM(state_names) ? state_names[entry->state] : "unknown",
+                ip_str(entry->private_ip, priv, sizeof(priv)), entry->private_port,
+                ip_str(public_ip, pub, sizeof(pub)), entry->public_port,
+                ip_str(entry->remote_ip, remote, sizeof(remote)), entry->remote_port,
+                session_wall_time(w, stats->created),
+                session_wall_time(w, entry->last_active),
+                stats->packets, stats->bytes);
     }
+}
+
+/* Helper: Produce the next part of a session listing (http_stream_t) */
+static int
+session_stream(void *arg, struct http_buf *buf)
+{
+    struct session_walk *w = arg;
+    const struct nat_core_ctx *ctx;
+    int more;
+    
+    if (w->core == api_num_cores)
+        return 0;
+    
+    ctx = &api_cores[w->core];
+    w->out = buf;
+    w->now = (uint32_t)(rte_rdtsc() >> ctx->clock_shift);
+    w->clock_hz = rte_get_tsc_hz() >> ctx->clock_shift;
+    w->wall_now = time(NULL);
     
-    close(server_fd);
-    printf("[API] REST API server stopped\n");
-    return NULL;
+    /* Keys and the pool table stay valid until we are offline again */
+    if (api_rcu)
+        rte_rcu_qsbr_thread_online(api_rcu, api_rcu_thread_id);
+    w->num_pools = nat_get_port_pools(ctx, &w->pools);
+    more = session_table_walk(&ctx->sessions, &w->pos, SESSION_WALK_BATCH,
+                              session_emit, w);
+    if (api_rcu)
+        rte_rcu_qsbr_thread_offline(api_rcu, api_rcu_thread_id);
+    
+    if (w->error < 0)
+        return -1;
+    
+    if (!more) {
+        w->core++;
+        w->pos = 0;
+    }
+    return w->core < api_num_cores ? 1 : 0;
 }
 
-int
-api_server_start(uint16_t port)
+static int
+handle_sessions_request(const struct http_request *req, struct http_response *resp)
 {
-    static uint16_t server_port;
-    server_port = port;
+    struct session_walk *w;
+    struct session_query query;
     
-    api_running = 1;
+    if (parse_session_query(req->query, &query, &resp->body) < 0) {
+        resp->status = 400;
+        return 0;
+    }
     
-    if (pthread_create(&api_thread, NULL, api_server_thread, &server_port) != 0) {
-        fprintf(stderr, "Failed to create API server thread\n");
+    w = calloc(1, sizeof(*w));
+    if (!w)
         return -1;
+    w->query = query;
+    
+    if (query.format == SESSION_FORMAT_BINARY) {
+        struct session_dump_header hdr = {
+            .magic = SESSION_DUMP_MAGIC,
+            .version = rte_cpu_to_be_16(SESSION_DUMP_VERSION),
+            .record_size = rte_cpu_to_be_16(sizeof(struct session_record)),
+        };
+        
+        if (http_buf_reserve(&resp->body, sizeof(hdr)) < 0) {
+            free(w);
+            return -1;
+        }
+        memcpy(resp->body.data + resp->body.len, &hdr, sizeof(hdr));
+        resp->body.len += sizeof(hdr);
+        resp->content_type = "application/octet-stream";
+    } else {
+        resp->content_type = "application/x-ndjson";
     }
     
+    resp->stream = session_stream;
+    resp->stream_arg = w;
+    resp->stream_done = free;
     return 0;
 }
+
+static const struct http_route api_routes[] = {
+    { "/api/stats", handle_stats_request },
+    { "/api/sessions", handle_sessions_request },
+};
+
+int
+api_server_start(uint16_t port, const struct nat_core_ctx *cores,
+                 unsigned int num_cores, struct rte_rcu_qsbr *rcu,
+                 unsigned int rcu_thread_id)
+{
+    api_cores = cores;
+    api_num_cores = num_cores;
+    api_rcu = rcu;
+    api_rcu_thread_id = rcu_thread_id;
+    
+    if (rcu && rte_rcu_qsbr_thread_register(rcu, rcu_thread_id) != 0) {
+        fprintf(stderr, "Failed to register REST API with RCU\n");
+        return -1;
+    }
+    
+    return http_server_listen("REST API", port, api_routes, RTE_DIM(api_routes));
+}
@@ -2,22 +2,1024 @@
 /**
  * @file config.c
  * @brief Configuration file parsing (YAML)
+ *
+ * The file is loaded as a libyaml document and walked section by section.
+ * Only keys this build acts on are read; everything else in
+ * config/cgnat.yaml (HA, dashboard, text log targets) is ignored. Values
+ * are range-checked here, cross-field consistency in config_validate().
  */
 
+#include "config.h"
 #include "cgnat_types.h"
+#include <arpa/inet.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <rte_common.h>
+#include <yaml.h>
 
-/* Placeholder for YAML parsing */
-/* In production, use libyaml or similar */
+/* Longest accepted timeout (seconds) */
+#define CONFIG_TIMEOUT_MAX  (7 * 24 * 3600)
+
+/* Largest per-customer rate (Mbit/s) */
+#define CONFIG_MBPS_MAX     400000
+
+/* Iterate over the nodes of a sequence */
+#define YAML_SEQ_FOREACH(y, seq, item)                                      \
+    for (yaml_node_item_t *it_ = (seq)->data.sequence.items.start;          \
+         it_ < (seq)->data.sequence.items.top &&                            \
+         ((item) = yaml_document_get_node(&(y)->doc, *it_)) != NULL; it_++)
+
+/* One loaded document plus its name for error messages */
+struct yaml_ctx {
+    const char *filename;
+    yaml_document_t doc;
+};
+
+/* Helper: Fill the shared public IP pool with count addresses from first */
+static int
+set_public_ips(struct cgnat_config *config, uint32_t first, uint32_t count)
+{
+    uint32_t *ips = malloc(count * sizeof(uint32_t));
+    uint16_t *pools = calloc(count, sizeof(uint16_t));
+    
+    if (!ips || !pools) {
+        fprintf(stderr, "Error: Cannot allocate %u public IPs\n", count);
+        free(ips);
+        free(pools);
+        return -1;
+    }
+    for (uint32_t i = 0; i < count; i++)
+        ips[i] = first + i;
+    
+    free(config->public_ips);
+    free(config->public_ip_pools);
+    config->public_ips = ips;
+    config->public_ip_pools = pools;
+    config->num_public_ips = count;
+    return 0;
+}
+
+/* Helper: Network mask of a prefix length */
+static inline uint32_t
+prefix_mask(uint8_t len)
+{
+    return len ? ~0U << (32 - len) : 0;
+}
+
+int
+config_set_defaults(struct cgnat_config *config)
+{
+    static const uint16_t block_ports[] = { 25, 135, 139, 445 };
+    
+    memset(config, 0, sizeof(*config));
+    
+    /* One-arm on port 0, Ethernet headers left alone */
+    config->sides[NAT_SIDE_INSIDE].port_id = 0;
+    config->sides[NAT_SIDE_OUTSIDE].port_id = 0;
+    config->num_queues = 4;
+    config->num_workers = 4;
+    
+    /* Incremental software checksums unless offload is requested */
+    config->checksum_offload = false;
+    
+    /* NIC RSS plus rte_flow steering of public ports */
+    config->rss.mode = RSS_MODE_FLOW;
+    
+    /* Public IPs (default TEST-NET-3 range) */
+    if (set_public_ips(config, (203 << 24) | (0 << 16) | (113 << 8) | 1, 10) < 0)
+        return -1;
+    
+    /* Session capacity (preallocated per worker), no per-session counters */
+    config->max_sessions = MAX_SESSIONS_DEFAULT;
+    config->session_accounting = false;
+    
+    /* Customer network (10.0.0.0/16), served by the shared pool */
+    config->customer_prefixes[0].addr = (10 << 24);
+    config->customer_prefixes[0].len = 16;
+    config->customer_prefixes[0].ip_pool = IP_POOL_SHARED;
+    config->num_customer_prefixes = 1;
+    config->num_ip_pools = 1;
+    
+    /* Per-session port allocation unless block mode is requested */
+    config->port_block_size = 0;
+    
+    /* Timeouts */
+    config->timeout_tcp_established = TIMEOUT_TCP_ESTABLISHED;
+    config->timeout_tcp_syn = TIMEOUT_TCP_SYN;
+    config->timeout_tcp_fin = TIMEOUT_TCP_FIN;
+    config->timeout_udp = TIMEOUT_UDP;
+    config->timeout_icmp = TIMEOUT_ICMP;
+    
+    /* Limits */
+    config->max_sessions_per_customer = 100;
+    config->port_alert_threshold = 90;
+    
+    /* Outbound ACL: block common exploit ports (policy.acl) */
+    memcpy(config->acl_block_ports, block_ports, sizeof(block_ports));
+    config->num_acl_block_ports = sizeof(block_ports) / sizeof(block_ports[0]);
+    config->acl_allow_protocols = ACL_PROTO_ALL;
+    
+    /* Monitoring */
+    config->telemetry_enabled = true;
+    config->prometheus_port = 9091;
+    config->api_enabled = true;
+    config->api_port = 8080;
+    
+    /* NAT event log: off until a target is configured */
+    config->event_log_enabled = false;
+    config->event_log_format = EVENT_LOG_IPFIX;
+    config->event_ring_size = EVENT_RING_DEFAULT;
+    config->event_rate_limit = EVENT_RATE_DEFAULT;
+    
+    return 0;
+}
+
+void
+config_free(struct cgnat_config *config)
+{
+    free(config->public_ips);
+    free(config->public_ip_pools);
+    free(config->acl_rules);
+    config->public_ips = NULL;
+    config->public_ip_pools = NULL;
+    config->num_public_ips = 0;
+    config->acl_rules = NULL;
+    config->num_acl_rules = 0;
+}
+
+int
+config_parse_prefix(const char *str, uint32_t *addr, uint8_t *len)
+{
+    char buf[INET_ADDRSTRLEN];
+    const char *slash = strchr(str, '/');
+    size_t addr_len = slash ? (size_t)(slash - str) : strlen(str);
+    struct in_addr in;
+    
+    if (addr_len >= sizeof(buf))
+        return -1;
+    memcpy(buf, str, addr_len);
+    buf[addr_len] = '\0';
+    if (inet_pton(AF_INET, buf, &in) != 1)
+        return -1;
+    
+    *addr = ntohl(in.s_addr);
+    *len = 32;
+    if (slash) {
+        char *end;
+        unsigned long n = strtoul(slash + 1, &end, 10);
+    
+        if (end == slash + 1 || *end != '\0' || n > 32)
+            return -1;
+        *len = n;
+    }
+    return 0;
+}
+
+/* Helper: Host addresses of a prefix (network/broadcast skipped if real) */
+static void
+prefix_hosts(uint32_t addr, uint8_t len, uint32_t *first, uint32_t *count)
+{
+    *count = (len == 0) ? 0 : 1U << (32 - len);
+    *first = addr & ~(*count - 1);
+    
+    if (*count > 2) {
+        (*first)++;
+        *count -= 2;
+    }
+}
+
+int
+config_set_public_prefix(struct cgnat_config *config, const char *prefix)
+{
+    uint32_t addr, first, count;
+    uint8_t len;
+    
+    if (config_parse_prefix(prefix, &addr, &len) < 0 || len < 20)
+        return -1;
+    prefix_hosts(addr, len, &first, &count);
+    if (set_public_ips(config, first, count) < 0)
+        return -1;
+    
+    /* One pool for every customer prefix */
+    for (uint32_t i = 0; i < config->num_customer_prefixes; i++)
+        config->customer_prefixes[i].ip_pool = IP_POOL_SHARED;
+    config->num_ip_pools = 1;
+    return 0;
+}
+
+/* Helper: Report an invalid value at its line in the file */
+static int
+yaml_invalid(const struct yaml_ctx *y, const yaml_node_t *node,
+             const char *section, const char *key, const char *expected)
+{
+    fprintf(stderr, "Error: %s:%zu: %s.%s must be %s\n", y->filename,
+            node->start_mark.line + 1, section, key, expected);
+    return -1;
+}
+
+/* Helper: Value of key in a mapping node, NULL if absent */
+static yaml_node_t *
+yaml_get(struct yaml_ctx *y, yaml_node_t *map, const char *key)
+{
+    if (!map || map->type != YAML_MAPPING_NODE)
+        return NULL;
+    
+    for (yaml_node_pair_t *pair = map->data.mapping.pairs.start;
+         pair < map->data.mapping.pairs.top; pair++) {
+        yaml_node_t *k = yaml_document_get_node(&y->doc, pair->key);
+    
+        if (k && k->type == YAML_SCALAR_NODE &&
+            strcmp((const char *)k->data.scalar.value, key) == 0)
+            return yaml_document_get_node(&y->doc, pair->value);
+    }
+    return NULL;
+}
+
+/* Helper: Text of a scalar node, NULL for mappings and sequences */
+static const char *
+yaml_text(const yaml_node_t *node)
+{
+    if (node->type != YAML_SCALAR_NODE)
+        return NULL;
+    return (const char *)node->data.scalar.value;
+}
+
+/* Helper: Parse a decimal integer in [min, max] */
+static int
+parse_uint(const char *text, uint32_t min, uint32_t max, uint32_t *out)
+{
+    char *end;
+    unsigned long long v;
+    
+    if (!text || *text == '\0' || *text == '-')
+        return -1;
+    errno = 0;
+    v = strtoull(text, &end, 10);
+    if (errno != 0 || *end != '\0' || v < min || v > max)
+        return -1;
+    *out = (uint32_t)v;
+    return 0;
+}
+
+/* Helper: Integer at map[key] in [min, max], left unchanged if absent */
+static int
+get_uint(struct yaml_ctx *y, yaml_node_t *map, const char *section,
+         const char *key, uint32_t min, uint32_t max, uint32_t *out)
+{
+    yaml_node_t *node = yaml_get(y, map, key);
+    char expected[64];
+    
+    if (!node)
+        return 0;
+    if (parse_uint(yaml_text(node), min, max, out) == 0)
+        return 0;
+    
+    snprintf(expected, sizeof(expected), "an integer in [%u, %u]", min, max);
+    return yaml_invalid(y, node, section, key, expected);
+}
+
+/* Helper: 16-bit integer at map[key], left unchanged if absent */
+static int
+get_u16(struct yaml_ctx *y, yaml_node_t *map, const char *section,
+        const char *key, uint16_t min, uint16_t max, uint16_t *out)
+{
+    uint32_t v = *out;
+    
+    if (get_uint(y, map, section, key, min, max, &v) < 0)
+        return -1;
+    *out = v;
+    return 0;
+}
+
+/* Helper: Boolean at map[key], left unchanged if absent */
+static int
+get_bool(struct yaml_ctx *y, yaml_node_t *map, const char *section,
+         const char *key, bool *out)
+{
+    yaml_node_t *node = yaml_get(y, map, key);
+    const char *text;
+    
+    if (!node)
+        return 0;
+    
+    text = yaml_text(node);
+    if (text && (!strcasecmp(text, "true") || !strcasecmp(text, "yes") ||
+                 !strcasecmp(text, "on"))) {
+        *out = true;
+        return 0;
+    }
+    if (text && (!strcasecmp(text, "false") || !strcasecmp(text, "no") ||
+                 !strcasecmp(text, "off"))) {
+        *out = false;
+        return 0;
+    }
+    return yaml_invalid(y, node, section, key, "true or false");
+}
+
+/* Helper: Index of the string at map[key] in names, -1 if absent */
+static int
+get_choice(struct yaml_ctx *y, yaml_node_t *map, const char *section,
+           const char *key, const char *const *names, int num_names,
+           const char *expected, int *out)
+{
+    yaml_node_t *node = yaml_get(y, map, key);
+    const char *text;
+    
+    *out = -1;
+    if (!node)
+        return 0;
+    
+    text = yaml_text(node);
+    for (int i = 0; text && i < num_names; i++) {
+        if (strcasecmp(text, names[i]) == 0) {
+            *out = i;
+            return 0;
+        }
+    }
+    return yaml_invalid(y, node, section, key, expected);
+}
+
+/* Helper: Sequence at map[key], NULL if absent; error if not a sequence */
+static int
+get_seq(struct yaml_ctx *y, yaml_node_t *map, const char *section,
+        const char *key, yaml_node_t **out)
+{
+    yaml_node_t *node = yaml_get(y, map, key);
+    
+    *out = NULL;
+    if (!node)
+        return 0;
+    if (node->type != YAML_SEQUENCE_NODE)
+        return yaml_invalid(y, node, section, key, "a list");
+    *out = node;
+    return 0;
+}
+
+/* Helper: IPv4 address at map[key], left unchanged if absent */
+static int
+get_ipv4(struct yaml_ctx *y, yaml_node_t *map, const char *section,
+         const char *key, uint32_t *out)
+{
+    yaml_node_t *node = yaml_get(y, map, key);
+    uint32_t addr;
+    uint8_t len;
+    
+    if (!node)
+        return 0;
+    if (config_parse_prefix(yaml_text(node), &addr, &len) < 0 || len != 32 ||
+        addr == 0)
+        return yaml_invalid(y, node, section, key, "an address A.B.C.D");
+    *out = addr;
+    return 0;
+}
+
+/* Helper: MAC address "xx:xx:xx:xx:xx:xx" at map[key], false if absent */
+static int
+get_mac(struct yaml_ctx *y, yaml_node_t *map, const char *section,
+        const char *key, struct rte_ether_addr *out, bool *present)
+{
+    yaml_node_t *node = yaml_get(y, map, key);
+    const char *text;
+    uint8_t *b = out->addr_bytes;
+    int end = 0;
+    
+    *present = false;
+    if (!node)
+        return 0;
+    
+    text = yaml_text(node);
+    if (!text || sscanf(text, "%2hhx:%2hhx:%2hhx:%2hhx:%2hhx:%2hhx%n",
+                        &b[0], &b[1], &b[2], &b[3], &b[4], &b[5], &end) != 6 ||
+        text[end] != '\0' || (b[0] & 0x01))
+        return yaml_invalid(y, node, section, key,
+                            "a unicast MAC address xx:xx:xx:xx:xx:xx");
+    *present = true;
+    return 0;
+}
+
+/* Helper: Parse "A.B.C.D:port" */
+static int
+parse_endpoint(const char *text, uint32_t *ip, uint16_t *port)
+{
+    char addr[INET_ADDRSTRLEN];
+    const char *colon = text ? strrchr(text, ':') : NULL;
+    uint32_t p;
+    uint8_t len;
+    
+    if (!colon || (size_t)(colon - text) >= sizeof(addr) ||
+        parse_uint(colon + 1, 1, UINT16_MAX, &p) < 0)
+        return -1;
+    
+    memcpy(addr, text, colon - text);
+    addr[colon - text] = '\0';
+    if (config_parse_prefix(addr, ip, &len) < 0 || len != 32 || *ip == 0)
+        return -1;
+    *port = p;
+    return 0;
+}
+
+/* Helper: Parse "N" or "N-M" into an inclusive port range */
+static int
+parse_port_range(const char *text, uint16_t *lo, uint16_t *hi)
+{
+    char buf[16];
+    const char *dash;
+    uint32_t a, b;
+    
+    if (!text || strlen(text) >= sizeof(buf))
+        return -1;
+    strcpy(buf, text);
+    
+    dash = strchr(text, '-');
+    if (dash) {
+        buf[dash - text] = '\0';
+        if (parse_uint(buf, 0, UINT16_MAX, &a) < 0 ||
+            parse_uint(dash + 1, 0, UINT16_MAX, &b) < 0 || a > b)
+            return -1;
+    } else {
+        if (parse_uint(buf, 0, UINT16_MAX, &a) < 0)
+            return -1;
+        b = a;
+    }
+    
+    *lo = a;
+    *hi = b;
+    return 0;
+}
+
+/* Helper: One dpdk.ports entry, assigned to the side(s) its role names */
+static int
+parse_port(struct yaml_ctx *y, yaml_node_t *port, bool *assigned,
+           struct cgnat_config *config)
+{
+    static const char *const roles[] = { "inside", "outside", "both" };
+    struct nat_side_config side;
+    int rc = 0, role;
+    
+    memset(&side, 0, sizeof(side));
+    rc |= get_u16(y, port, "dpdk.ports", "id", 0, RTE_MAX_ETHPORTS - 1,
+                  &side.port_id);
+    rc |= get_u16(y, port, "dpdk.ports", "queues", 1, MAX_CORES,
+                  &config->num_queues);
+    rc |= get_choice(y, port, "dpdk.ports", "role", roles, 3,
+                     "\"inside\", \"outside\" or \"both\"", &role);
+    rc |= get_ipv4(y, port, "dpdk.ports", "local_ip", &side.local_ip);
+    rc |= get_ipv4(y, port, "dpdk.ports", "next_hop_ip", &side.next_hop_ip);
+    rc |= get_mac(y, port, "dpdk.ports", "next_hop_mac", &side.next_hop_mac,
+                  &side.next_hop_static);
+    if (rc)
+        return -1;
+    config->num_workers = config->num_queues;
+    
+    /* Roles index like NAT_SIDE_*; "both" or no role makes a one-arm port */
+    for (int s = 0; s < NAT_SIDES; s++) {
+        if (role >= 0 && role < NAT_SIDES && role != s)
+            continue;
+        if (assigned[s]) {
+            fprintf(stderr, "Error: %s:%zu: more than one %s port\n",
+                    y->filename, port->start_mark.line + 1,
+                    s == NAT_SIDE_INSIDE ? "inside" : "outside");
+            return -1;
+        }
+        assigned[s] = true;
+        config->sides[s] = side;
+    }
+    return 0;
+}
+
+/* Section dpdk: ports, checksum offload, RSS mode */
+static int
+parse_dpdk(struct yaml_ctx *y, yaml_node_t *sec, struct cgnat_config *config)
+{
+    static const char *const rss_modes[] = { "flow", "symmetric", "software" };
+    yaml_node_t *ports, *port;
+    int rc = 0, mode;
+    
+    rc |= get_bool(y, sec, "dpdk", "checksum_offload", &config->checksum_offload);
+    rc |= get_choice(y, sec, "dpdk", "rss_mode", rss_modes, 3,
+                     "\"flow\", \"symmetric\" or \"software\"", &mode);
+    if (mode >= 0)
+        config->rss.mode = (enum rss_mode)mode;
+    
+    rc |= get_seq(y, sec, "dpdk", "ports", &ports);
+    if (ports) {
+        bool assigned[NAT_SIDES] = { false, false };
+    
+        YAML_SEQ_FOREACH(y, ports, port)
+            rc |= parse_port(y, port, assigned, config);
+        if (rc == 0 && (!assigned[NAT_SIDE_INSIDE] || !assigned[NAT_SIDE_OUTSIDE])) {
+            fprintf(stderr, "Error: %s: dpdk.ports needs an inside and an outside "
+                    "port, or one port with role \"both\"\n", y->filename);
+            rc = -1;
+        }
+    }
+    
+    return rc;
+}
+
+/* Helper: Append a list of addresses and prefixes to the public IPs */
+static int
+parse_public_ips(struct yaml_ctx *y, yaml_node_t *list, const char *section,
+                 uint16_t ip_pool, struct cgnat_config *config)
+{
+    uint32_t *ips = realloc(config->public_ips, MAX_PUBLIC_IPS * sizeof(uint32_t));
+    uint16_t *pools;
+    yaml_node_t *item;
+    uint32_t n = config->num_public_ips;
+    
+    if (!ips)
+        return -1;
+    config->public_ips = ips;
+    pools = realloc(config->public_ip_pools, MAX_PUBLIC_IPS * sizeof(uint16_t));
+    if (!pools)
+        return -1;
+    config->public_ip_pools = pools;
+    
+    YAML_SEQ_FOREACH(y, list, item) {
+        const char *text = yaml_text(item);
+        uint32_t addr, first, count;
+        uint8_t len;
+    
+        if (!text || config_parse_prefix(text, &addr, &len) < 0)
+            return yaml_invalid(y, item, section, "public_ips",
+                                "a list of A.B.C.D or A.B.C.D/len");
+        prefix_hosts(addr, len, &first, &count);
+        if (count > MAX_PUBLIC_IPS - n)
+            return yaml_invalid(y, item, section, "public_ips",
+                                "at most " RTE_STR(MAX_PUBLIC_IPS)
+                                " addresses in all pools");
+        for (uint32_t i = 0; i < count; i++) {
+            ips[n] = first + i;
+            pools[n++] = ip_pool;
+        }
+        config->num_public_ips = n;
+    }
+    
+    return 0;
+}
+
+/*
+ * Helper: One nat.customer_ranges entry
+ * Either a prefix served by nat.public_ips, or a mapping with the prefix
+ * and the public_ips of its own pool.
+ */
+static int
+parse_customer_range(struct yaml_ctx *y, yaml_node_t *item,
+                     struct cgnat_config *config)
+{
+    const char *const section = "nat.customer_ranges";
+    struct customer_prefix *cp;
+    yaml_node_t *node = item, *list = NULL;
+    const char *text;
+    uint32_t addr;
+    uint8_t len;
+    
+    if (item->type == YAML_MAPPING_NODE) {
+        node = yaml_get(y, item, "prefix");
+        if (!node)
+            return yaml_invalid(y, item, section, "prefix", "given");
+        if (get_seq(y, item, section, "public_ips", &list) < 0)
+            return -1;
+    }
+    
+    text = yaml_text(node);
+    if (!text || config_parse_prefix(text, &addr, &len) < 0 ||
+        len < CUSTOMER_PREFIX_LEN_MIN)
+        return yaml_invalid(y, node, "nat", "customer_ranges",
+                            "a list of prefixes, /8 or longer");
+    if (config->num_customer_prefixes == MAX_CUSTOMER_PREFIXES)
+        return yaml_invalid(y, node, "nat", "customer_ranges",
+                            "at most " RTE_STR(MAX_CUSTOMER_PREFIXES) " prefixes");
+    
+    cp = &config->customer_prefixes[config->num_customer_prefixes++];
+    cp->addr = addr & prefix_mask(len);
+    cp->len = len;
+    cp->ip_pool = IP_POOL_SHARED;
+    
+    if (list) {
+        cp->ip_pool = config->num_ip_pools++;
+        return parse_public_ips(y, list, section, cp->ip_pool, config);
+    }
+    return 0;
+}
+
+/* Section nat: public pool, customers, port allocation, capacity, timeouts */
+static int
+parse_nat(struct yaml_ctx *y, yaml_node_t *sec, struct cgnat_config *config)
+{
+    static const char *const alloc_modes[] = { "dynamic", "block" };
+    yaml_node_t *list, *item, *node;
+    int rc = 0, mode;
+    
+    /* Shared pool first: dedicated pools are appended behind it */
+    rc |= get_seq(y, sec, "nat", "public_ips", &list);
+    if (list) {
+        config->num_public_ips = 0;
+        rc |= parse_public_ips(y, list, "nat", IP_POOL_SHARED, config);
+    }
+    
+    rc |= get_seq(y, sec, "nat", "customer_ranges", &list);
+    if (list) {
+        config->num_customer_prefixes = 0;
+        config->num_ip_pools = 1;
+        YAML_SEQ_FOREACH(y, list, item)
+            rc |= parse_customer_range(y, item, config);
+    }
+    
+    /* The port range is fixed at build time; reject a different one */
+    node = yaml_get(y, sec, "port_range");
+    if (node) {
+        uint32_t start = PORT_RANGE_START, end = PORT_RANGE_END;
+    
+        rc |= get_uint(y, node, "nat.port_range", "start", 1, UINT16_MAX, &start);
+        rc |= get_uint(y, node, "nat.port_range", "end", 1, UINT16_MAX, &end);
+        if (start != PORT_RANGE_START || end != PORT_RANGE_END)
+            rc |= yaml_invalid(y, node, "nat", "port_range",
+                               RTE_STR(PORT_RANGE_START) "-" RTE_STR(PORT_RANGE_END)
+                               " (fixed at build time)");
+    }
+    
+    node = yaml_get(y, sec, "port_allocation");
+    if (node) {
+        uint16_t block_size = PORT_BLOCK_SIZE_DEFAULT;
+    
+        rc |= get_choice(y, node, "nat.port_allocation", "mode", alloc_modes, 2,
+                         "\"dynamic\" or \"block\"", &mode);
+        rc |= get_u16(y, node, "nat.port_allocation", "block_size",
+                      PORT_BLOCK_SIZE_MIN, PORT_BLOCK_SIZE_MAX, &block_size);
+        if (mode == 0)
+            config->port_block_size = 0;
+        else if (mode == 1)
+            config->port_block_size = block_size;
+    }
+    
+    rc |= get_uint(y, sec, "nat", "max_sessions", 1, MAX_SESSIONS_LIMIT,
+                   &config->max_sessions);
+    rc |= get_bool(y, sec, "nat", "session_accounting",
+                   &config->session_accounting);
+    
+    node = yaml_get(y, sec, "timeouts");
+    rc |= get_uint(y, node, "nat.timeouts", "tcp_established", 1,
+                   CONFIG_TIMEOUT_MAX, &config->timeout_tcp_established);
+    rc |= get_uint(y, node, "nat.timeouts", "tcp_syn", 1,
+                   CONFIG_TIMEOUT_MAX, &config->timeout_tcp_syn);
+    rc |= get_uint(y, node, "nat.timeouts", "tcp_fin", 1,
+                   CONFIG_TIMEOUT_MAX, &config->timeout_tcp_fin);
+    rc |= get_uint(y, node, "nat.timeouts", "udp_active", 1,
+                   CONFIG_TIMEOUT_MAX, &config->timeout_udp);
+    rc |= get_uint(y, node, "nat.timeouts", "icmp", 1,
+                   CONFIG_TIMEOUT_MAX, &config->timeout_icmp);
+    
+    return rc;
+}
+
+/* Helper: One policy.acl.rules entry */
+static int
+parse_acl_rule(struct yaml_ctx *y, yaml_node_t *node, struct acl_rule_spec *rule)
+{
+    static const char *const actions[] = { "permit", "deny" };
+    static const char *const protos[] = { "any", "tcp", "udp", "icmp" };
+    static const uint8_t proto_numbers[] = { 0, PROTO_TCP, PROTO_UDP, PROTO_ICMP };
+    const char *const section = "policy.acl.rules";
+    const char *const fields[] = { "src", "dst" };
+    int rc = 0, action, proto;
+    
+    memset(rule, 0, sizeof(*rule));
+    rule->src_port_hi = UINT16_MAX;
+    rule->dst_port_hi = UINT16_MAX;
+    
+    if (node->type != YAML_MAPPING_NODE)
+        return yaml_invalid(y, node, "policy.acl", "rules", "a list of mappings");
+    
+    rc |= get_choice(y, node, section, "action", actions, 2,
+                     "\"permit\" or \"deny\"", &action);
+    if (rc == 0 && action < 0)
+        return yaml_invalid(y, node, section, "action", "given");
+    rule->action = (action == 1) ? ACL_ACTION_DENY : ACL_ACTION_PERMIT;
+    
+    rc |= get_choice(y, node, section, "protocol", protos, 4,
+                     "\"tcp\", \"udp\", \"icmp\" or \"any\"", &proto);
+    if (proto > 0)
+        rule->protocol = proto_numbers[proto];
+    
+    for (int f = 0; f < 2; f++) {
+        yaml_node_t *value = yaml_get(y, node, fields[f]);
+        const char *text;
+        uint32_t addr;
+        uint8_t len;
+    
+        if (!value)
+            continue;
+        text = yaml_text(value);
+        if (text && strcasecmp(text, "any") == 0)
+            continue;
+        if (!text || config_parse_prefix(text, &addr, &len) < 0) {
+            rc |= yaml_invalid(y, value, section, fields[f],
+                               "\"any\", A.B.C.D or A.B.C.D/len");
+            continue;
+        }
+        addr &= len ? ~0U << (32 - len) : 0;
+        if (f == 0) {
+            rule->src_ip = addr;
+            rule->src_len = len;
+        } else {
+            rule->dst_ip = addr;
+            rule->dst_len = len;
+        }
+    }
+    
+    yaml_node_t *ports = yaml_get(y, node, "src_ports");
+    if (ports && parse_port_range(yaml_text(ports), &rule->src_port_lo,
+                                  &rule->src_port_hi) < 0)
+        rc |= yaml_invalid(y, ports, section, "src_ports", "a port or N-M");
+    ports = yaml_get(y, node, "dst_ports");
+    if (ports && parse_port_range(yaml_text(ports), &rule->dst_port_lo,
+                                  &rule->dst_port_hi) < 0)
+        rc |= yaml_invalid(y, ports, section, "dst_ports", "a port or N-M");
+    
+    return rc;
+}
+
+/* Section policy: port exhaustion, per-customer limits and the outbound ACL */
+static int
+parse_policy(struct yaml_ctx *y, yaml_node_t *sec, struct cgnat_config *config)
+{
+    static const char *const bw_actions[] = { "drop", "mark" };
+    yaml_node_t *node, *list, *item;
+    int rc = 0, action;
+    
+    node = yaml_get(y, sec, "port_exhaustion");
+    rc |= get_uint(y, node, "policy.port_exhaustion", "alert_threshold", 1, 100,
+                   &config->port_alert_threshold);
+    
+    node = yaml_get(y, sec, "per_customer");
+    rc |= get_uint(y, node, "policy.per_customer", "max_sessions", 0,
+                   MAX_SESSIONS_LIMIT, &config->max_sessions_per_customer);
+    rc |= get_uint(y, node, "policy.per_customer", "max_bandwidth_mbps", 0,
+                   CONFIG_MBPS_MAX, &config->max_bandwidth_mbps);
+    rc |= get_choice(y, node, "policy.per_customer", "bandwidth_action",
+                     bw_actions, 2, "\"drop\" or \"mark\"", &action);
+    if (action >= 0)
+        config->bandwidth_mark = (action == 1);
+    
+    node = yaml_get(y, sec, "acl");
+    if (!node)
+        return rc;
+    
+    rc |= get_seq(y, node, "policy.acl", "block_ports", &list);
+    if (list) {
+        config->num_acl_block_ports = 0;
+        YAML_SEQ_FOREACH(y, list, item) {
+            uint32_t port;
+    
+            if (parse_uint(yaml_text(item), 1, UINT16_MAX, &port) < 0 ||
+                config->num_acl_block_ports == ACL_BLOCK_PORTS_MAX) {
+                rc |= yaml_invalid(y, item, "policy.acl", "block_ports",
+                                   "at most " RTE_STR(ACL_BLOCK_PORTS_MAX)
+                                   " ports in [1, 65535]");
+                break;
+            }
+            config->acl_block_ports[config->num_acl_block_ports++] = port;
+        }
+    }
+    
+    rc |= get_seq(y, node, "policy.acl", "allow_protocols", &list);
+    if (list) {
+        static const char *const names[] = { "tcp", "udp", "icmp" };
+        static const uint8_t bits[] = { ACL_PROTO_TCP, ACL_PROTO_UDP, ACL_PROTO_ICMP };
+    
+        config->acl_allow_protocols = 0;
+        YAML_SEQ_FOREACH(y, list, item) {
+            const char *text = yaml_text(item);
+            int i;
+    
+            for (i = 0; text && i < 3; i++)
+                if (strcasecmp(text, names[i]) == 0)
+                    break;
+            if (!text || i == 3) {
+                rc |= yaml_invalid(y, item, "policy.acl", "allow_protocols",
+                                   "a list of \"tcp\", \"udp\" and \"icmp\"");
+                continue;
+            }
+            config->acl_allow_protocols |= bits[i];
+        }
+    }
+    
+    rc |= get_seq(y, node, "policy.acl", "rules", &list);
+    if (list) {
+        size_t n = list->data.sequence.items.top - list->data.sequence.items.start;
+        struct acl_rule_spec *rules = NULL;
+        uint32_t count = 0;
+    
+        if (n > ACL_MAX_RULES)
+            return yaml_invalid(y, list, "policy.acl", "rules",
+                                "at most " RTE_STR(ACL_MAX_RULES) " rules");
+        if (n > 0) {
+            rules = calloc(n, sizeof(*rules));
+            if (!rules)
+                return -1;
+        }
+        YAML_SEQ_FOREACH(y, list, item)
+            rc |= parse_acl_rule(y, item, &rules[count++]);
+    
+        free(config->acl_rules);
+        config->acl_rules = rules;
+        config->num_acl_rules = count;
+    }
+    
+    return rc;
+}
+
+/* Section monitoring: Prometheus exporter and API ports */
+static int
+parse_monitoring(struct yaml_ctx *y, yaml_node_t *sec, struct cgnat_config *config)
+{
+    yaml_node_t *node;
+    int rc = 0;
+    
+    node = yaml_get(y, sec, "prometheus");
+    rc |= get_bool(y, node, "monitoring.prometheus", "enabled",
+                   &config->telemetry_enabled);
+    rc |= get_u16(y, node, "monitoring.prometheus", "port", 1, UINT16_MAX,
+                  &config->prometheus_port);
+    
+    node = yaml_get(y, sec, "api");
+    rc |= get_bool(y, node, "monitoring.api", "enabled", &config->api_enabled);
+    rc |= get_u16(y, node, "monitoring.api", "port", 1, UINT16_MAX,
+                  &config->api_port);
+    
+    return rc;
+}
+
+/* Section logging: NAT event records, their rings and rate */
+static int
+parse_logging(struct yaml_ctx *y, yaml_node_t *sec, struct cgnat_config *config)
+{
+    static const char *const formats[] = { "ipfix", "binary", "json" };
+    yaml_node_t *node, *events;
+    bool rate_enabled = true;
+    uint32_t rate = 0;
+    int rc = 0, format;
+    
+    rc |= get_uint(y, sec, "logging", "ring_buffer_size", EVENT_RING_MIN,
+                   EVENT_RING_MAX, &config->event_ring_size);
+    
+    node = yaml_get(y, sec, "rate_limit");
+    rc |= get_bool(y, node, "logging.rate_limit", "enabled", &rate_enabled);
+    rc |= get_uint(y, node, "logging.rate_limit", "max_per_second", 1,
+                   UINT32_MAX, &rate);
+    if (node)
+        config->event_rate_limit = rate_enabled ? rate : 0;
+    
+    events = yaml_get(y, sec, "nat_events");
+    rc |= get_bool(y, events, "logging.nat_events", "enabled",
+                   &config->event_log_enabled);
+    rc |= get_choice(y, events, "logging.nat_events", "format", formats, 3,
+                     "\"ipfix\", \"binary\" or \"json\"", &format);
+    if (format >= 0)
+        config->event_log_format = format;
+    
+    node = yaml_get(y, events, "path");
+    if (node) {
+        const char *text = yaml_text(node);
+    
+        if (!text || *text == '\0' ||
+            strlen(text) >= sizeof(config->event_log_path))
+            rc |= yaml_invalid(y, node, "logging.nat_events", "path",
+                               "a file name");
+        else
+            strcpy(config->event_log_path, text);
+    }
+    
+    node = yaml_get(y, events, "collector");
+    if (node && parse_endpoint(yaml_text(node), &config->event_log_collector_ip,
+                               &config->event_log_collector_port) < 0)
+        rc |= yaml_invalid(y, node, "logging.nat_events", "collector",
+                           "an address and port A.B.C.D:port");
+    
+    return rc;
+}
 
 int
 config_load(const char *filename, struct cgnat_config *config)
 {
+    struct yaml_ctx y = { .filename = filename };
+    yaml_parser_t parser;
+    yaml_node_t *root;
+    FILE *file;
+    int rc = 0;
+    
     printf("[CONFIG] Loading configuration from %s\n", filename);
     
-    /* TODO: Implement YAML parsing */
-    /* For now, use default configuration */
+    file = fopen(filename, "rb");
+    if (!file) {
+        fprintf(stderr, "Error: Cannot open %s: %s\n", filename, strerror(errno));
+        return -1;
+    }
+    
+    if (!yaml_parser_initialize(&parser)) {
+        fclose(file);
+        return -1;
+    }
+    yaml_parser_set_input_file(&parser, file);
+    
+    if (!yaml_parser_load(&parser, &y.doc)) {
+        fprintf(stderr, "Error: %s:%zu: %s\n", filename,
+                parser.problem_mark.line + 1,
+                parser.problem ? parser.problem : "YAML syntax error");
+        yaml_parser_delete(&parser);
+        fclose(file);
+        return -1;
+    }
+    
+    root = yaml_document_get_root_node(&y.doc);
+    if (!root || root->type != YAML_MAPPING_NODE) {
+        fprintf(stderr, "Error: %s: top level must be a mapping\n", filename);
+        rc = -1;
+    } else {
+        yaml_node_t *node;
+    
+        rc |= parse_dpdk(&y, yaml_get(&y, root, "dpdk"), config);
+        rc |= parse_nat(&y, yaml_get(&y, root, "nat"), config);
+        rc |= parse_policy(&y, yaml_get(&y, root, "policy"), config);
+        rc |= parse_monitoring(&y, yaml_get(&y, root, "monitoring"), config);
+        rc |= parse_logging(&y, yaml_get(&y, root, "logging"), config);
+    
+        node = yaml_get(&y, root, "operations");
+        rc |= get_bool(&y, node, "operations", "hot_reload", &config->hot_reload);
+    }
+    
+    yaml_document_delete(&y.doc);
+    yaml_parser_delete(&parser);
+    fclose(file);
+    return rc;
+}
+
+/* Helper: Customer prefix containing an address, -1 if none */
+static int
+customer_prefix_of(const struct cgnat_config *config, uint32_t ip)
+{
+    for (uint32_t i = 0; i < config->num_customer_prefixes; i++) {
+        const struct customer_prefix *cp = &config->customer_prefixes[i];
+    
+        if ((ip & prefix_mask(cp->len)) == cp->addr)
+            return i;
+    }
+    return -1;
+}
+
+/* Helper: Prefixes disjoint, subscriber table bounded, every pool non-empty */
+static int
+validate_customer_prefixes(const struct cgnat_config *config)
+{
+    uint32_t pool_ips[MAX_CUSTOMER_PREFIXES + 1] = { 0 };
+    uint64_t addrs = 0;
+    
+    if (config->num_customer_prefixes == 0) {
+        fprintf(stderr, "Error: No customer ranges configured\n");
+        return -1;
+    }
+    
+    for (int i = 0; i < config->num_public_ips; i++)
+        if (config->public_ip_pools[i] < config->num_ip_pools)
+            pool_ips[config->public_ip_pools[i]]++;
+    
+    for (uint32_t i = 0; i < config->num_customer_prefixes; i++) {
+        const struct customer_prefix *cp = &config->customer_prefixes[i];
+    
+        for (uint32_t j = 0; j < i; j++) {
+            const struct customer_prefix *other = &config->customer_prefixes[j];
+            uint8_t len = RTE_MIN(cp->len, other->len);
+    
+            if (((cp->addr ^ other->addr) & prefix_mask(len)) == 0) {
+                fprintf(stderr, "Error: Customer ranges %u.%u.%u.%u/%u and "
+                        "%u.%u.%u.%u/%u overlap\n",
+                        (other->addr >> 24) & 0xFF, (other->addr >> 16) & 0xFF,
+                        (other->addr >> 8) & 0xFF, other->addr & 0xFF, other->len,
+                        (cp->addr >> 24) & 0xFF, (cp->addr >> 16) & 0xFF,
+                        (cp->addr >> 8) & 0xFF, cp->addr & 0xFF, cp->len);
+                return -1;
+            }
+        }
+    
+        if (cp->ip_pool >= config->num_ip_pools || pool_ips[cp->ip_pool] == 0) {
+            fprintf(stderr, "Error: Customer range %u.%u.%u.%u/%u has no public IPs\n",
+                    (cp->addr >> 24) & 0xFF, (cp->addr >> 16) & 0xFF,
+                    (cp->addr >> 8) & 0xFF, cp->addr & 0xFF, cp->len);
+            return -1;
+        }
+        addrs += 1ULL << (32 - cp->len);
+    }
+    
+    /* Each worker keeps one subscriber record per customer address */
+    if (addrs > CUSTOMER_ADDRS_MAX) {
+        fprintf(stderr, "Error: Customer ranges cover %lu addresses (max %u)\n",
+                (unsigned long)addrs, CUSTOMER_ADDRS_MAX);
+        return -1;
+    }
     
     return 0;
 }
@@ -30,10 +1032,88 @@ config_validate(const struct cgnat_config *config)
         return -1;
     }
     
+    if (config->num_public_ips > MAX_PUBLIC_IPS) {
+        fprintf(stderr, "Error: Too many public IPs (%d, max %d)\n",
+                config->num_public_ips, MAX_PUBLIC_IPS);
+        return -1;
+    }
+    
+    if (validate_customer_prefixes(config) < 0)
+        return -1;
+    
+    for (int i = 0; i < config->num_public_ips; i++) {
+        int cust = customer_prefix_of(config, config->public_ips[i]);
+    
+        if (cust >= 0) {
+            fprintf(stderr, "Error: Public IP %u.%u.%u.%u lies in customer range "
+                    "%u.%u.%u.%u/%u\n",
+                    (config->public_ips[i] >> 24) & 0xFF,
+                    (config->public_ips[i] >> 16) & 0xFF,
+                    (config->public_ips[i] >> 8) & 0xFF,
+                    config->public_ips[i] & 0xFF,
+                    (config->customer_prefixes[cust].addr >> 24) & 0xFF,
+                    (config->customer_prefixes[cust].addr >> 16) & 0xFF,
+                    (config->customer_prefixes[cust].addr >> 8) & 0xFF,
+                    config->customer_prefixes[cust].addr & 0xFF,
+                    config->customer_prefixes[cust].len);
+            return -1;
+        }
+    }
+    
+    if (config->max_sessions < config->num_workers ||
+        config->max_sessions > MAX_SESSIONS_LIMIT) {
+        fprintf(stderr, "Error: Invalid max_sessions %u\n",
+                config->max_sessions);
+        return -1;
+    }
+    
+    if (config->port_block_size != 0 &&
+        (config->port_block_size < PORT_BLOCK_SIZE_MIN ||
+         config->port_block_size > PORT_BLOCK_SIZE_MAX ||
+         (config->port_block_size & (config->port_block_size - 1)) != 0)) {
+        fprintf(stderr, "Error: Invalid port block size %u\n",
+                config->port_block_size);
+        return -1;
+    }
+    
+    if (config->rss.mode == RSS_MODE_SYMMETRIC && config->port_block_size != 0) {
+        fprintf(stderr, "Error: Port blocks cannot be combined with rss_mode \"symmetric\"\n");
+        return -1;
+    }
+    
     if (config->num_workers == 0 || config->num_workers > MAX_CORES) {
         fprintf(stderr, "Error: Invalid number of workers\n");
         return -1;
     }
     
+    /* Port slices are matched by a power-of-two mask; other counts would
+     * give some workers twice the ports of others */
+    if ((config->num_workers & (config->num_workers - 1)) != 0) {
+        fprintf(stderr, "Error: Number of workers (queues) must be a power of two, "
+                "got %u\n", config->num_workers);
+        return -1;
+    }
+    
+    if (config->event_log_enabled && config->event_log_path[0] == '\0' &&
+        config->event_log_collector_ip == 0) {
+        fprintf(stderr, "Error: NAT event log needs a path or a collector\n");
+        return -1;
+    }
+
+    if (config->timeout_tcp_established == 0 || config->timeout_tcp_syn == 0 ||
+        config->timeout_tcp_fin == 0 || config->timeout_udp == 0 ||
+        config->timeout_icmp == 0) {
+        fprintf(stderr, "Error: Session timeouts must be nonzero\n");
+        return -1;
+    }
+    
+    /* Explicit rules plus two per blocked port and three protocol denies */
+    if (config->num_acl_rules + 2 * config->num_acl_block_ports + 3 > ACL_MAX_RULES) {
+        fprintf(stderr, "Error: Too many ACL rules (%u, max %u)\n",
+                config->num_acl_rules + 2 * config->num_acl_block_ports,
+                ACL_MAX_RULES - 3);
+        return -1;
+    }
+    
     return 0;
 }
@@ -0,0 +1,720 @@
+/* SPDX-License-Identifier: MIT */
+/**
+ * @file http_server.c
+ * @brief Event-driven HTTP/1.1 server (epoll, keep-alive, gzip)
+ *
+ * Listeners and connections share one level-triggered epoll set that the
+ * main lcore polls between its control tasks. Sockets are non-blocking:
+ * a slow client only holds its own connection, whose pending response
+ * waits for EPOLLOUT while the others are served. A connection handles
+ * one request at a time; pipelined requests are parsed once the previous
+ * response has been sent. Idle or stuck connections are closed after
+ * HTTP_IDLE_TIMEOUT_S.
+ *
+ * A streamed body is produced one part at a time, each once the previous
+ * one has been sent, so its size is bounded by the producer's step rather
+ * than the body. After HTTP_STREAM_BURST parts the connection waits for
+ * its next EPOLLOUT, giving the others their turn.
+ */
+
+#include "http_server.h"
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#define HTTP_EVENTS_MAX   64            /* Events taken per epoll_wait */
+#define HTTP_BUF_MIN      4096
+#define HTTP_CHUNK_HEAD   10            /* "%08x\r\n" */
+
+/* What an epoll event's data.ptr points at: both start with the type */
+enum http_fd_type {
+    HTTP_FD_LISTENER,
+    HTTP_FD_CONN,
+};
+
+struct http_listener {
+    enum http_fd_type type;
+    int fd;
+    const char *name;
+    const struct http_route *routes;
+    unsigned int num_routes;
+};
+
+struct http_conn {
+    enum http_fd_type type;
+    int fd;
+    const struct http_listener *listener;
+    uint32_t events;                    /* Currently registered */
+    time_t last_active;                 /* Monotonic seconds */
+    bool close_after;                   /* Close once out is sent */
+    struct http_buf out;                /* Response being sent */
+    size_t out_sent;
+    http_stream_t stream;               /* Body still being produced */
+    void *stream_arg;
+    void (*stream_done)(void *arg);
+    bool chunked;                       /* Stream framed as chunks */
+    size_t in_len;
+    char in[HTTP_REQUEST_MAX + 1];      /* Room for a terminating NUL */
+};
+
+static int epoll_fd = -1;
+static struct http_listener listeners[HTTP_MAX_LISTENERS];
+static unsigned int num_listeners;
+static struct http_conn *conns[HTTP_MAX_CONNS];
+static unsigned int num_conns;
+static time_t last_sweep;
+
+/* Handler output and its compressed form, reused by every request */
+static struct http_buf body_buf;
+static struct http_buf gzip_buf;
+static z_stream gzip_stream;
+static bool gzip_ready;
+
+int
+http_buf_reserve(struct http_buf *buf, size_t n)
+{
+    size_t cap = buf->cap ? buf->cap : HTTP_BUF_MIN;
+    char *data;
+
+    if (buf->len + n <= buf->cap)
+        return 0;
+
+    while (cap < buf->len + n)
+        cap *= 2;
+    data = realloc(buf->data, cap);
+    if (!data)
+        return -1;
+
+    buf->data = data;
+    buf->cap = cap;
+    return 0;
+}
+
+int
+http_buf_printf(struct http_buf *buf, const char *fmt, ...)
+{
+    va_list ap;
+    size_t room;
+    int n;
+
+    for (;;) {
+        room = buf->cap - buf->len;
+        va_start(ap, fmt);
+        n = vsnprintf(room ? buf->data + buf->len : NULL, room, fmt, ap);
+        va_end(ap);
+
+        if (n < 0)
+            return -1;
+        if ((size_t)n < room) {
+            buf->len += n;
+            return 0;
+        }
+        if (http_buf_reserve(buf, n + 1) < 0)
+            return -1;
+    }
+}
+
+static time_t
+monotonic_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec;
+}
+
+static const char *
+status_text(int status)
+{
+    switch (status) {
+    case 200: return "OK";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 413: return "Payload Too Large";
+    case 431: return "Request Header Fields Too Large";
+    case 503: return "Service Unavailable";
+    default:  return "Internal Server Error";
+    }
+}
+
+/* Helper: Compress a body into gzip_buf (gzip framing, fastest level) */
+static int
+gzip_compress(const struct http_buf *in)
+{
+    int rc;
+
+    if (!gzip_ready) {
+        if (deflateInit2(&gzip_stream, Z_BEST_SPEED, Z_DEFLATED, 15 + 16, 8,
+                         Z_DEFAULT_STRATEGY) != Z_OK)
+            return -1;
+        gzip_ready = true;
+    } else if (deflateReset(&gzip_stream) != Z_OK) {
+        return -1;
+    }
+
+    gzip_buf.len = 0;
+    if (http_buf_reserve(&gzip_buf, deflateBound(&gzip_stream, in->len)) < 0)
+        return -1;
+
+    gzip_stream.next_in = (Bytef *)in->data;
+    gzip_stream.avail_in = in->len;
+    gzip_stream.next_out = (Bytef *)gzip_buf.data;
+    gzip_stream.avail_out = gzip_buf.cap;
+    rc = deflate(&gzip_stream, Z_FINISH);
+    gzip_buf.len = gzip_stream.total_out;
+
+    return rc == Z_STREAM_END ? 0 : -1;
+}
+
+/* Helper: Release a connection's stream producer */
+static void
+conn_stream_end(struct http_conn *c)
+{
+    if (c->stream_done)
+        c->stream_done(c->stream_arg);
+    c->stream = NULL;
+    c->stream_arg = NULL;
+    c->stream_done = NULL;
+}
+
+static void
+conn_close(struct http_conn *c)
+{
+    for (unsigned int i = 0; i < num_conns; i++) {
+        if (conns[i] == c) {
+            conns[i] = conns[--num_conns];
+            break;
+        }
+    }
+
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    conn_stream_end(c);
+    free(c->out.data);
+    free(c);
+}
+
+/* Helper: Register interest in events, if it changed */
+static int
+conn_want(struct http_conn *c, uint32_t events)
+{
+    struct epoll_event ev = { .events = events, .data.ptr = c };
+
+    if (c->events == events)
+        return 0;
+    c->events = events;
+    return epoll_ctl(epoll_fd, EPOLL_CTL_MOD, c->fd, &ev);
+}
+
+/* Helper: Send what the socket takes: 1 when done, 0 if blocked, -1 on error */
+static int
+conn_flush(struct http_conn *c)
+{
+    while (c->out_sent < c->out.len) {
+        ssize_t n = send(c->fd, c->out.data + c->out_sent,
+                         c->out.len - c->out_sent, MSG_NOSIGNAL);
+
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+        }
+        c->out_sent += n;
+    }
+    return 1;
+}
+
+/*
+ * Helper: Parse a request head ending in "\r\n" followed by a NUL
+ * Returns 0, or the error status to answer with.
+ */
+static int
+parse_request(char *head, struct http_request *req)
+{
+    char *line_end = strstr(head, "\r\n");
+    char *target, *version, *hdr, *query;
+
+    *line_end = '\0';
+
+    /* Request line: method SP request-target SP HTTP-version */
+    req->method = head;
+    target = strchr(head, ' ');
+    if (!target)
+        return 400;
+    *target++ = '\0';
+    version = strchr(target, ' ');
+    if (!version || *target != '/')
+        return 400;
+    *version++ = '\0';
+    if (strcmp(version, "HTTP/1.1") == 0)
+        req->http11 = true;
+    else if (strcmp(version, "HTTP/1.0") == 0)
+        req->http11 = false;
+    else
+        return 400;
+    req->keep_alive = req->http11;
+
+    query = strchr(target, '?');
+    if (query)
+        *query++ = '\0';
+    req->path = target;
+    req->query = query;
+    req->accept_gzip = false;
+
+    /* Headers the server acts on; no request bodies are accepted */
+    for (hdr = line_end + 2; *hdr != '\0'; ) {
+        char *end = strstr(hdr, "\r\n");
+        char *value;
+
+        *end = '\0';
+        value = strchr(hdr, ':');
+        if (!value)
+            return 400;
+        *value++ = '\0';
+        value += strspn(value, " \t");
+
+        if (strcasecmp(hdr, "Connection") == 0) {
+            if (strcasestr(value, "close"))
+                req->keep_alive = false;
+            else if (strcasestr(value, "keep-alive"))
+                req->keep_alive = true;
+        } else if (strcasecmp(hdr, "Accept-Encoding") == 0) {
+            req->accept_gzip = (strcasestr(value, "gzip") != NULL);
+        } else if ((strcasecmp(hdr, "Content-Length") == 0 &&
+                    strtoul(value, NULL, 10) != 0) ||
+                   strcasecmp(hdr, "Transfer-Encoding") == 0) {
+            return 413;
+        }
+        hdr = end + 2;
+    }
+
+    return 0;
+}
+
+/* Helper: Queue a response on the connection */
+static int
+conn_respond(struct http_conn *c, const struct http_response *resp,
+             bool head_only, bool gzip, bool keep_alive, bool http11)
+{
+    const struct http_buf *body = &resp->body;
+    bool stream = resp->stream && !head_only;
+    char length[48];
+
+    /* From here on the connection owns the producer */
+    if (stream) {
+        c->stream = resp->stream;
+        c->stream_arg = resp->stream_arg;
+        c->stream_done = resp->stream_done;
+        c->chunked = http11;
+        keep_alive = keep_alive && http11;
+        gzip = false;
+    } else if (resp->stream && resp->stream_done) {
+        resp->stream_done(resp->stream_arg);
+    }
+
+    gzip = gzip && body->len >= HTTP_GZIP_MIN && gzip_compress(body) == 0;
+    if (gzip)
+        body = &gzip_buf;
+
+    /* HEAD of a streamed body: its length is not known */
+    if (!resp->stream)
+        snprintf(length, sizeof(length), "Content-Length: %zu\r\n", body->len);
+    else
+        snprintf(length, sizeof(length), "%s",
+                 http11 ? "Transfer-Encoding: chunked\r\n" : "");
+
+    c->out.len = 0;
+    c->out_sent = 0;
+    c->close_after = !keep_alive;
+    if (http_buf_printf(&c->out,
+                        "HTTP/1.1 %d %s\r\n"
+                        "Content-Type: %s\r\n"
+                        "%s%s%s"
+                        "Access-Control-Allow-Origin: *\r\n"
+                        "Connection: %s\r\n"
+                        "\r\n",
+                        resp->status, status_text(resp->status),
+                        resp->content_type, length,
+                        gzip ? "Content-Encoding: gzip\r\nVary: Accept-Encoding\r\n" : "",
+                        resp->status == 405 ? "Allow: GET, HEAD\r\n" : "",
+                        keep_alive ? "keep-alive" : "close") < 0)
+        return -1;
+
+    if (head_only || body->len == 0)
+        return 0;
+    if (c->chunked && stream &&
+        http_buf_printf(&c->out, "%zx\r\n", body->len) < 0)
+        return -1;
+    if (http_buf_reserve(&c->out, body->len) < 0)
+        return -1;
+    memcpy(c->out.data + c->out.len, body->data, body->len);
+    c->out.len += body->len;
+    if (c->chunked && stream && http_buf_printf(&c->out, "\r\n") < 0)
+        return -1;
+    return 0;
+}
+
+/* Helper: Produce the next part of a streamed body into the empty output */
+static int
+conn_stream(struct http_conn *c)
+{
+    size_t head = c->chunked ? HTTP_CHUNK_HEAD : 0;
+    char size[HTTP_CHUNK_HEAD + 1];
+    size_t n;
+    int rc;
+
+    if (http_buf_reserve(&c->out, head) < 0)
+        return -1;
+    c->out.len = head;
+    rc = c->stream(c->stream_arg, &c->out);
+    if (rc < 0)
+        return -1;
+
+    if (c->chunked) {
+        /* A zero-size chunk would end the body: skip empty parts */
+        n = c->out.len - head;
+        if (n == 0) {
+            c->out.len = 0;
+        } else {
+            snprintf(size, sizeof(size), "%08x\r\n", (unsigned int)n);
+            memcpy(c->out.data, size, HTTP_CHUNK_HEAD);
+            if (http_buf_printf(&c->out, "\r\n") < 0)
+                return -1;
+        }
+        if (rc == 0 && http_buf_printf(&c->out, "0\r\n\r\n") < 0)
+            return -1;
+    }
+
+    if (rc == 0)
+        conn_stream_end(c);
+    return 0;
+}
+
+/* Helper: Route a parsed request and run its handler */
+static void
+dispatch(const struct http_listener *l, const struct http_request *req,
+         struct http_response *resp)
+{
+    const struct http_route *route = NULL;
+
+    for (unsigned int i = 0; i < l->num_routes; i++) {
+        if (strcmp(l->routes[i].path, req->path) == 0) {
+            route = &l->routes[i];
+            break;
+        }
+    }
+
+    if (!route) {
+        resp->status = 404;
+    } else if (strcmp(req->method, "GET") != 0 &&
+               strcmp(req->method, "HEAD") != 0) {
+        resp->status = 405;
+    } else if (route->handler(req, resp) < 0) {
+        if (resp->stream && resp->stream_done)
+            resp->stream_done(resp->stream_arg);
+        resp->stream = NULL;
+        resp->status = 500;
+        resp->content_type = "text/plain";
+        resp->body.len = 0;
+    }
+}
+
+/*
+ * Helper: Answer the first complete request in the input buffer
+ * Returns 1 if a response was queued, 0 if no request is complete yet
+ * and -1 on failure.
+ */
+static int
+conn_serve(struct http_conn *c)
+{
+    struct http_request req = { 0 };
+    struct http_response resp = {
+        .status = 200,
+        .content_type = "text/plain",
+        .body = body_buf,
+    };
+    size_t head_len;
+    char *end;
+    int status, rc;
+
+    c->in[c->in_len] = '\0';
+    end = strstr(c->in, "\r\n\r\n");
+    if (!end && c->in_len < HTTP_REQUEST_MAX)
+        return 0;
+
+    resp.body.len = 0;
+    if (!end) {
+        head_len = c->in_len;
+        status = 431;
+    } else {
+        head_len = end + 4 - c->in;
+        end[2] = '\0';
+        status = parse_request(c->in, &req);
+    }
+
+    if (status == 0)
+        dispatch(c->listener, &req, &resp);
+    else
+        resp.status = status;
+
+    if (resp.status != 200 && resp.body.len == 0) {
+        resp.content_type = "text/plain";
+        http_buf_printf(&resp.body, "%s\n", status_text(resp.status));
+    }
+
+    /* Malformed requests leave the stream in an unknown state: close */
+    rc = conn_respond(c, &resp, status == 0 && strcmp(req.method, "HEAD") == 0,
+                      req.accept_gzip, status == 0 && req.keep_alive,
+                      req.http11);
+    body_buf = resp.body;
+    if (rc < 0)
+        return -1;
+
+    /* Pipelined bytes move to the front */
+    memmove(c->in, c->in + head_len, c->in_len - head_len);
+    c->in_len -= head_len;
+    return 1;
+}
+
+/* Helper: Send pending output and serve queued requests until blocked */
+static void
+conn_progress(struct http_conn *c, bool peer_closed)
+{
+    unsigned int parts = 0;
+
+    for (;;) {
+        int rc = conn_flush(c);
+
+        if (rc < 0 || (rc > 0 && c->close_after && !c->stream)) {
+            conn_close(c);
+            return;
+        }
+        if (rc == 0) {
+            if (conn_want(c, EPOLLOUT) < 0)
+                conn_close(c);
+            return;
+        }
+
+        c->out.len = 0;
+        c->out_sent = 0;
+        if (c->stream) {
+            if (parts++ == HTTP_STREAM_BURST) {
+                if (conn_want(c, EPOLLOUT) < 0)
+                    conn_close(c);
+                return;
+            }
+            if (conn_stream(c) < 0) {
+                conn_close(c);
+                return;
+            }
+            continue;
+        }
+
+        rc = conn_serve(c);
+        if (rc < 0) {
+            conn_close(c);
+            return;
+        }
+        if (rc == 0)
+            break;
+    }
+
+    if (peer_closed || conn_want(c, EPOLLIN | EPOLLRDHUP) < 0)
+        conn_close(c);
+}
+
+static void
+conn_event(struct http_conn *c, uint32_t events, time_t now)
+{
+    bool peer_closed = false;
+
+    c->last_active = now;
+    if (events & (EPOLLERR | EPOLLHUP)) {
+        conn_close(c);
+        return;
+    }
+
+    if (events & (EPOLLIN | EPOLLRDHUP)) {
+        while (c->in_len < HTTP_REQUEST_MAX) {
+            ssize_t n = recv(c->fd, c->in + c->in_len,
+                             HTTP_REQUEST_MAX - c->in_len, 0);
+
+            if (n > 0) {
+                c->in_len += n;
+            } else if (n == 0) {
+                peer_closed = true;
+                break;
+            } else if (errno == EINTR) {
+                continue;
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            } else {
+                conn_close(c);
+                return;
+            }
+        }
+    }
+
+    conn_progress(c, peer_closed);
+}
+
+static void
+accept_conns(struct http_listener *l, time_t now)
+{
+    for (;;) {
+        struct epoll_event ev;
+        struct http_conn *c;
+        int fd = accept4(l->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+        if (fd < 0)
+            return;
+
+        c = (num_conns < HTTP_MAX_CONNS) ? calloc(1, sizeof(*c)) : NULL;
+        if (!c) {
+            close(fd);
+            continue;
+        }
+
+        c->type = HTTP_FD_CONN;
+        c->fd = fd;
+        c->listener = l;
+        c->events = EPOLLIN | EPOLLRDHUP;
+        c->last_active = now;
+        ev.events = c->events;
+        ev.data.ptr = c;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            close(fd);
+            free(c);
+            continue;
+        }
+        conns[num_conns++] = c;
+    }
+}
+
+int
+http_server_listen(const char *name, uint16_t port,
+                   const struct http_route *routes, unsigned int num_routes)
+{
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+        .sin_port = htons(port),
+    };
+    struct http_listener *l;
+    struct epoll_event ev;
+    int fd, opt = 1;
+
+    if (num_listeners == HTTP_MAX_LISTENERS)
+        return -1;
+
+    if (epoll_fd < 0) {
+        epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (epoll_fd < 0) {
+            perror("epoll_create1 failed");
+            return -1;
+        }
+    }
+
+    fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("socket failed");
+        return -1;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(fd, SOMAXCONN) < 0) {
+        fprintf(stderr, "[HTTP] %s: cannot listen on port %u: %s\n",
+                name, port, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    l = &listeners[num_listeners];
+    l->type = HTTP_FD_LISTENER;
+    l->fd = fd;
+    l->name = name;
+    l->routes = routes;
+    l->num_routes = num_routes;
+
+    ev.events = EPOLLIN;
+    ev.data.ptr = l;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        perror("epoll_ctl failed");
+        close(fd);
+        return -1;
+    }
+    num_listeners++;
+
+    printf("[HTTP] %s listening on port %u\n", name, port);
+    return 0;
+}
+
+void
+http_server_poll(int timeout_ms)
+{
+    struct epoll_event events[HTTP_EVENTS_MAX];
+    time_t now;
+    int n;
+
+    if (epoll_fd < 0) {
+        usleep(timeout_ms * 1000);
+        return;
+    }
+
+    /* A signal (SIGHUP reload) ends the wait early: n < 0 */
+    n = epoll_wait(epoll_fd, events, HTTP_EVENTS_MAX, timeout_ms);
+    now = monotonic_now();
+
+    for (int i = 0; i < n; i++) {
+        enum http_fd_type *type = events[i].data.ptr;
+
+        if (*type == HTTP_FD_LISTENER)
+            accept_conns((struct http_listener *)type, now);
+        else
+            conn_event((struct http_conn *)type, events[i].events, now);
+    }
+
+    /* Once a second: drop idle keep-alives and clients that stopped reading */
+    if (now != last_sweep) {
+        last_sweep = now;
+        for (unsigned int i = num_conns; i > 0; i--)
+            if (now - conns[i - 1]->last_active > HTTP_IDLE_TIMEOUT_S)
+                conn_close(conns[i - 1]);
+    }
+}
+
+void
+http_server_close(void)
+{
+    while (num_conns > 0)
+        conn_close(conns[num_conns - 1]);
+
+    for (unsigned int i = 0; i < num_listeners; i++)
+        close(listeners[i].fd);
+    num_listeners = 0;
+
+    if (epoll_fd >= 0) {
+        close(epoll_fd);
+        epoll_fd = -1;
+    }
+
+    if (gzip_ready) {
+        deflateEnd(&gzip_stream);
+        gzip_ready = false;
+    }
+    free(body_buf.data);
+    free(gzip_buf.data);
+    memset(&body_buf, 0, sizeof(body_buf));
+    memset(&gzip_buf, 0, sizeof(gzip_buf));
+}
@@ -0,0 +1,189 @@
+/* SPDX-License-Identifier: MIT */
+/**
+ * @file neighbor.c
+ * @brief Next hop MAC addresses of the inside and outside ports
+ *
+ * A side's next hop is either configured or resolved by ARP. The main
+ * lcore sends the requests on the TX queue reserved for it; whichever
+ * worker receives an ARP frame from the next hop stores its MAC, and all
+ * workers pick it up with their next TX batch. Workers also answer
+ * requests for the sides' local addresses, so that neighbors can route
+ * customer and public prefixes to the NAT.
+ */
+
+#include "dpdk_runtime.h"
+#include <rte_arp.h>
+#include <rte_byteorder.h>
+#include <rte_cycles.h>
+#include <rte_ethdev.h>
+#include <rte_mbuf.h>
+#include <stdio.h>
+#include <string.h>
+
+static const char *const side_names[NAT_SIDES] = { "inside", "outside" };
+
+int
+dpdk_egress_init(struct egress_side *sides, const struct cgnat_config *config)
+{
+    for (int s = 0; s < NAT_SIDES; s++) {
+        const struct nat_side_config *sc = &config->sides[s];
+        struct egress_side *eg = &sides[s];
+        int ret;
+
+        memset(eg, 0, sizeof(*eg));
+        eg->port_id = sc->port_id;
+        eg->local_ip = rte_cpu_to_be_32(sc->local_ip);
+        eg->next_hop_ip = rte_cpu_to_be_32(sc->next_hop_ip);
+
+        ret = rte_eth_macaddr_get(sc->port_id, &eg->port_mac);
+        if (ret != 0) {
+            fprintf(stderr, "Error getting MAC address of port %u: %s\n",
+                    sc->port_id, rte_strerror(-ret));
+            return ret;
+        }
+
+        if (sc->next_hop_static) {
+            eg->rewrite = true;
+            memcpy(&eg->next_hop_mac, &sc->next_hop_mac, RTE_ETHER_ADDR_LEN);
+            printf("[DPDK] %s: port %u, next hop " RTE_ETHER_ADDR_PRT_FMT "\n",
+                   side_names[s], sc->port_id,
+                   RTE_ETHER_ADDR_BYTES(&sc->next_hop_mac));
+        } else if (sc->next_hop_ip != 0) {
+            eg->rewrite = true;
+            eg->arp = true;
+            printf("[DPDK] %s: port %u, next hop %u.%u.%u.%u (ARP)\n",
+                   side_names[s], sc->port_id,
+                   (sc->next_hop_ip >> 24) & 0xFF, (sc->next_hop_ip >> 16) & 0xFF,
+                   (sc->next_hop_ip >> 8) & 0xFF, sc->next_hop_ip & 0xFF);
+        } else {
+            printf("[DPDK] %s: port %u, Ethernet header kept\n",
+                   side_names[s], sc->port_id);
+        }
+    }
+
+    return 0;
+}
+
+/* Helper: Store a next hop MAC seen in ARP */
+static void
+arp_learn(struct egress_side *eg, int side, const struct rte_ether_addr *mac)
+{
+    uint64_t addr = 0;
+
+    memcpy(&addr, mac, RTE_ETHER_ADDR_LEN);
+    if (addr == 0 ||
+        addr == __atomic_load_n(&eg->next_hop_mac, __ATOMIC_RELAXED))
+        return;
+
+    __atomic_store_n(&eg->next_hop_mac, addr, __ATOMIC_RELAXED);
+    printf("[ARP] %s next hop is at " RTE_ETHER_ADDR_PRT_FMT "\n",
+           side_names[side], RTE_ETHER_ADDR_BYTES(mac));
+}
+
+int
+dpdk_arp_input(struct egress_side *sides, uint16_t port_id, struct rte_mbuf *m)
+{
+    struct rte_ether_hdr *eth = rte_pktmbuf_mtod(m, struct rte_ether_hdr *);
+    struct rte_arp_hdr *arp = (struct rte_arp_hdr *)(eth + 1);
+    struct rte_ether_addr sha;
+    int reply = -1;
+
+    if (rte_pktmbuf_data_len(m) < sizeof(*eth) + sizeof(*arp) ||
+        arp->arp_hardware != rte_cpu_to_be_16(RTE_ARP_HRD_ETHER) ||
+        arp->arp_protocol != rte_cpu_to_be_16(RTE_ETHER_TYPE_IPV4) ||
+        arp->arp_hlen != RTE_ETHER_ADDR_LEN || arp->arp_plen != sizeof(uint32_t)) {
+        rte_pktmbuf_free(m);
+        return -1;
+    }
+    sha = arp->arp_data.arp_sha;
+
+    for (int s = 0; s < NAT_SIDES; s++) {
+        struct egress_side *eg = &sides[s];
+
+        if (eg->port_id != port_id)
+            continue;
+
+        /* Requests and replies alike carry the sender's current MAC */
+        if (eg->arp && arp->arp_data.arp_sip == eg->next_hop_ip)
+            arp_learn(eg, s, &sha);
+
+        if (eg->local_ip != 0 && arp->arp_data.arp_tip == eg->local_ip &&
+            arp->arp_opcode == rte_cpu_to_be_16(RTE_ARP_OP_REQUEST))
+            reply = s;
+    }
+
+    if (reply < 0) {
+        rte_pktmbuf_free(m);
+        return -1;
+    }
+
+    /* Turn the request around */
+    arp->arp_opcode = rte_cpu_to_be_16(RTE_ARP_OP_REPLY);
+    arp->arp_data.arp_tha = sha;
+    arp->arp_data.arp_tip = arp->arp_data.arp_sip;
+    arp->arp_data.arp_sha = sides[reply].port_mac;
+    arp->arp_data.arp_sip = sides[reply].local_ip;
+    eth->dst_addr = sha;
+    eth->src_addr = sides[reply].port_mac;
+    return reply;
+}
+
+/* Helper: Broadcast a request for a side's next hop */
+static void
+arp_send_request(const struct egress_side *eg, struct rte_mempool *mbuf_pool,
+                 uint16_t tx_queue)
+{
+    struct rte_mbuf *m = rte_pktmbuf_alloc(mbuf_pool);
+    struct rte_ether_hdr *eth;
+    struct rte_arp_hdr *arp;
+
+    if (!m)
+        return;
+
+    eth = (struct rte_ether_hdr *)rte_pktmbuf_append(m, sizeof(*eth) +
+                                                        sizeof(*arp));
+    if (!eth) {
+        rte_pktmbuf_free(m);
+        return;
+    }
+    arp = (struct rte_arp_hdr *)(eth + 1);
+
+    memset(&eth->dst_addr, 0xFF, RTE_ETHER_ADDR_LEN);
+    eth->src_addr = eg->port_mac;
+    eth->ether_type = rte_cpu_to_be_16(RTE_ETHER_TYPE_ARP);
+
+    /* Without a local_ip the sender address is 0.0.0.0 (an ARP probe) */
+    arp->arp_hardware = rte_cpu_to_be_16(RTE_ARP_HRD_ETHER);
+    arp->arp_protocol = rte_cpu_to_be_16(RTE_ETHER_TYPE_IPV4);
+    arp->arp_hlen = RTE_ETHER_ADDR_LEN;
+    arp->arp_plen = sizeof(uint32_t);
+    arp->arp_opcode = rte_cpu_to_be_16(RTE_ARP_OP_REQUEST);
+    arp->arp_data.arp_sha = eg->port_mac;
+    arp->arp_data.arp_sip = eg->local_ip;
+    memset(&arp->arp_data.arp_tha, 0, RTE_ETHER_ADDR_LEN);
+    arp->arp_data.arp_tip = eg->next_hop_ip;
+
+    if (rte_eth_tx_burst(eg->port_id, tx_queue, &m, 1) == 0)
+        rte_pktmbuf_free(m);
+}
+
+void
+dpdk_arp_poll(struct egress_side *sides, struct rte_mempool *mbuf_pool,
+              uint16_t tx_queue)
+{
+    uint64_t now = rte_rdtsc();
+    uint64_t hz = rte_get_tsc_hz();
+
+    for (int s = 0; s < NAT_SIDES; s++) {
+        struct egress_side *eg = &sides[s];
+        bool resolved;
+
+        if (!eg->arp || now < eg->arp_next_tsc)
+            continue;
+
+        resolved = __atomic_load_n(&eg->next_hop_mac, __ATOMIC_RELAXED) != 0;
+        eg->arp_next_tsc = now + (resolved ? ARP_REFRESH_S * hz :
+                                             ARP_RETRY_MS * hz / 1000);
+        arp_send_request(eg, mbuf_pool, tx_queue);
+    }
+}
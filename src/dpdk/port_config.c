@@ -0,0 +1,200 @@
+/* SPDX-License-Identifier: MIT */
+/**
+ * @file port_config.c
+ * @brief NIC flow steering for per-core public port ownership
+ *
+ * Return traffic must reach the worker that created the session. In flow
+ * mode each worker owns a fixed set of slices of every public IP's port
+ * range (struct port_partition), so one masked rte_flow rule per public
+ * IP, protocol and slice steers inbound packets straight to the owning
+ * queue. In symmetric RSS mode workers pick ports whose return tuple
+ * hashes to their own queue, which dpdk_rss_self_test() verifies.
+ *
+ * Neither covers ICMP, which RSS hashes on the addresses only, nor
+ * fragments; the receiving worker hands those to the owner (see
+ * nat_flow_owner()). Echo identifiers always come from the owner's slices.
+ */
+
+#include "dpdk_runtime.h"
+#include "nat_engine.h"
+#include <rte_ethdev.h>
+#include <rte_flow.h>
+#include <rte_thash.h>
+#include <rte_random.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * Helper: Install one ingress rule matching dst IP and masked dst port
+ * Fragments are left to RSS: it hashes a datagram's fragments together on
+ * the addresses, and the worker receiving them forwards them by the first.
+ */
+static struct rte_flow *
+create_steering_rule(uint16_t port_id, uint32_t public_ip, uint8_t proto,
+                     uint16_t port_spec, uint16_t port_mask, uint16_t queue,
+                     struct rte_flow_error *error)
+{
+    struct rte_flow_attr attr = { .ingress = 1 };
+    struct rte_flow_item_ipv4 ip_spec = {
+        .hdr.dst_addr = rte_cpu_to_be_32(public_ip),
+        .hdr.next_proto_id = proto,
+    };
+    struct rte_flow_item_ipv4 ip_mask = {
+        .hdr.dst_addr = RTE_BE32(0xFFFFFFFF),
+        .hdr.fragment_offset = RTE_BE16(RTE_IPV4_HDR_MF_FLAG |
+                                        RTE_IPV4_HDR_OFFSET_MASK),
+        .hdr.next_proto_id = 0xFF,
+    };
+    struct rte_flow_item_tcp tcp_spec = { .hdr.dst_port = rte_cpu_to_be_16(port_spec) };
+    struct rte_flow_item_tcp tcp_mask = { .hdr.dst_port = rte_cpu_to_be_16(port_mask) };
+    struct rte_flow_item_udp udp_spec = { .hdr.dst_port = rte_cpu_to_be_16(port_spec) };
+    struct rte_flow_item_udp udp_mask = { .hdr.dst_port = rte_cpu_to_be_16(port_mask) };
+    
+    struct rte_flow_item pattern[] = {
+        { .type = RTE_FLOW_ITEM_TYPE_ETH },
+        { .type = RTE_FLOW_ITEM_TYPE_IPV4, .spec = &ip_spec, .mask = &ip_mask },
+        { .type = RTE_FLOW_ITEM_TYPE_END },
+        { .type = RTE_FLOW_ITEM_TYPE_END },
+    };
+    if (proto == PROTO_TCP) {
+        pattern[2].type = RTE_FLOW_ITEM_TYPE_TCP;
+        pattern[2].spec = &tcp_spec;
+        pattern[2].mask = &tcp_mask;
+    } else {
+        pattern[2].type = RTE_FLOW_ITEM_TYPE_UDP;
+        pattern[2].spec = &udp_spec;
+        pattern[2].mask = &udp_mask;
+    }
+    
+    struct rte_flow_action_queue queue_conf = { .index = queue };
+    struct rte_flow_action actions[] = {
+        { .type = RTE_FLOW_ACTION_TYPE_QUEUE, .conf = &queue_conf },
+        { .type = RTE_FLOW_ACTION_TYPE_END },
+    };
+    
+    if (rte_flow_validate(port_id, &attr, pattern, actions, error) != 0)
+        return NULL;
+    
+    return rte_flow_create(port_id, &attr, pattern, actions, error);
+}
+
+int
+dpdk_port_steer_public_ports(uint16_t port_id, const struct port_partition *part,
+                             const uint32_t *public_ips, int num_public_ips)
+{
+    const uint8_t protos[] = { PROTO_TCP, PROTO_UDP };
+    uint16_t port_mask = (part->num_slices - 1) << part->shift;
+    struct rte_flow_error error;
+    struct rte_flow **flows;
+    unsigned int rules = 0;
+    
+    /* A single worker owns everything - RSS placement is already correct */
+    if (part->num_workers <= 1)
+        return 0;
+    
+    /* Handles of this call's rules, so a failure leaves earlier ones alone */
+    flows = malloc((size_t)num_public_ips * RTE_DIM(protos) * part->num_slices *
+                   sizeof(*flows));
+    if (!flows)
+        return -1;
+    
+    for (int i = 0; i < num_public_ips; i++) {
+        for (unsigned int p = 0; p < RTE_DIM(protos); p++) {
+            for (uint16_t slice = 0; slice < part->num_slices; slice++) {
+                uint16_t queue = slice % part->num_workers;
+                
+                flows[rules] = create_steering_rule(port_id, public_ips[i],
+                                                    protos[p], slice << part->shift,
+                                                    port_mask, queue, &error);
+                if (!flows[rules]) {
+                    fprintf(stderr, "[DPDK] Port %u: cannot install public port "
+                            "steering rule: %s\n", port_id,
+                            error.message ? error.message : "unknown error");
+                    while (rules > 0)
+                        rte_flow_destroy(port_id, flows[--rules], &error);
+                    free(flows);
+                    return -1;
+                }
+                rules++;
+            }
+        }
+    }
+    free(flows);
+    
+    printf("[DPDK] Port %u: %u steering rules installed (%u slices of %u ports)\n",
+           port_id, rules, part->num_slices, 1U << part->shift);
+    return 0;
+}
+
+int
+dpdk_rss_self_test(const struct cgnat_config *config,
+                   const struct nat_core_ctx *cores, unsigned int num_cores)
+{
+    const struct rss_config *rss = &config->rss;
+    uint16_t mask = rss->reta_size - 1;
+    unsigned int failures = 0;
+    
+    for (unsigned int c = 0; c < num_cores; c++) {
+        const struct nat_core_ctx *ctx = &cores[c];
+        
+        for (unsigned int s = 0; s < RSS_SELF_TEST_SAMPLES; s++) {
+            const struct customer_prefix *cp =
+                &config->customer_prefixes[s % config->num_customer_prefixes];
+            uint64_t r = rte_rand();
+            struct flow_key key = {
+                .src_ip = cp->addr | ((uint32_t)r & ((1U << (32 - cp->len)) - 1)),
+                .dst_ip = (uint32_t)(r >> 32),
+                .src_port = (uint16_t)(r >> 8),
+                .dst_port = (uint16_t)(r >> 40),
+                .protocol = (r & 1) ? PROTO_TCP : PROTO_UDP,
+            };
+            uint32_t public_ip = config->public_ips[s % config->num_public_ips];
+            uint16_t public_port = nat_rss_port_candidate(ctx, &key, public_ip, s);
+            
+            /* Both directions of the private flow share a queue */
+            uint32_t fwd[3] = { key.src_ip, key.dst_ip,
+                                ((uint32_t)key.src_port << 16) | key.dst_port };
+            uint32_t rev[3] = { key.dst_ip, key.src_ip,
+                                ((uint32_t)key.dst_port << 16) | key.src_port };
+            if (rte_softrss(fwd, 3, rss->key) != rte_softrss(rev, 3, rss->key))
+                failures++;
+            
+            /* Translated return traffic comes back to this worker */
+            uint32_t ret[3] = { key.dst_ip, public_ip,
+                                ((uint32_t)key.dst_port << 16) | public_port };
+            if (rss->reta[rte_softrss(ret, 3, rss->key) & mask] != ctx->worker_id)
+                failures++;
+            
+            /* ICMP errors about it hash on the addresses: handed back here */
+            struct flow_key error = {
+                .src_ip = key.dst_ip,
+                .dst_ip = public_ip,
+                .src_port = key.dst_port,
+                .dst_port = public_port,
+                .protocol = key.protocol,
+            };
+            if (nat_flow_owner(ctx, &error, false) != ctx->worker_id)
+                failures++;
+            
+            /* Echo replies to an identifier this worker would pick, too */
+            struct flow_key reply = {
+                .src_ip = key.dst_ip,
+                .dst_ip = public_ip,
+                .dst_port = nat_icmp_ident_candidate(ctx, s),
+                .protocol = PROTO_ICMP,
+            };
+            if (nat_flow_owner(ctx, &reply, false) != ctx->worker_id)
+                failures++;
+        }
+    }
+    
+    if (failures) {
+        fprintf(stderr, "[DPDK] RSS self-test FAILED: %u of %u checks\n",
+                failures, num_cores * RSS_SELF_TEST_SAMPLES * 4);
+        return -1;
+    }
+    
+    printf("[DPDK] RSS self-test passed (%u flows and echo identifiers per worker)\n",
+           RSS_SELF_TEST_SAMPLES);
+    return 0;
+}
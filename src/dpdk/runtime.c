@@ -6,17 +6,25 @@
 
 #include "dpdk_runtime.h"
 #include "nat_engine.h"
+#include "logger.h"
 #include <rte_eal.h>
 #include <rte_ethdev.h>
 #include <rte_mempool.h>
 #include <rte_mbuf.h>
+#include <rte_ring.h>
 #include <rte_cycles.h>
+#include <rte_malloc.h>
+#include <rte_rcu_qsbr.h>
 #include <stdio.h>
+#include <string.h>
 #include <signal.h>
 
 /* Global flag for graceful shutdown */
 static volatile bool force_quit = false;
 
+/* Set by SIGHUP, consumed by the control loop on the main lcore */
+static volatile sig_atomic_t reload_pending = 0;
+
 /* Signal handler */
 static void
 signal_handler(int signum)
@@ -24,9 +32,26 @@ signal_handler(int signum)
     if (signum == SIGINT || signum == SIGTERM) {
         printf("\n\nSignal %d received, preparing to exit...\n", signum);
         force_quit = true;
+    } else if (signum == SIGHUP) {
+        reload_pending = 1;
     }
 }
 
+bool
+dpdk_quit_requested(void)
+{
+    return force_quit;
+}
+
+bool
+dpdk_reload_requested(void)
+{
+    if (!reload_pending)
+        return false;
+    reload_pending = 0;
+    return true;
+}
+
 int
 dpdk_eal_init(int argc, char **argv)
 {
@@ -40,6 +65,7 @@ dpdk_eal_init(int argc, char **argv)
     /* Register signal handlers */
     signal(SIGINT, signal_handler);
     signal(SIGTERM, signal_handler);
+    signal(SIGHUP, signal_handler);
     
     printf("[DPDK] EAL initialized successfully\n");
     printf("[DPDK] Available lcores: %u\n", rte_lcore_count());
@@ -72,12 +98,55 @@ dpdk_create_mbuf_pool(const char *name, unsigned int num_mbufs,
     return mbuf_pool;
 }
 
+/* Helper: Program symmetric key and round-robin RETA into config->rss */
+static int
+setup_symmetric_rss(uint16_t num_queues, const struct rte_eth_dev_info *dev_info,
+                    struct rss_config *rss)
+{
+    if (dev_info->hash_key_size == 0 || dev_info->hash_key_size > RSS_KEY_MAX ||
+        dev_info->reta_size == 0 || dev_info->reta_size > RSS_RETA_MAX ||
+        (dev_info->reta_size & (dev_info->reta_size - 1)) != 0)
+        return -1;
+    
+    /* 0x6D5A repeated: every 16-bit tuple word sees the same key window */
+    rss->key_len = dev_info->hash_key_size;
+    for (uint8_t i = 0; i < rss->key_len; i++)
+        rss->key[i] = (i & 1) ? 0x5A : 0x6D;
+    
+    rss->reta_size = dev_info->reta_size;
+    for (uint16_t i = 0; i < rss->reta_size; i++)
+        rss->reta[i] = i % num_queues;
+    
+    return 0;
+}
+
+/* Helper: Write config->rss.reta to the NIC */
+static int
+program_reta(uint16_t port_id, const struct rss_config *rss)
+{
+    struct rte_eth_rss_reta_entry64 reta_conf[RSS_RETA_MAX / RTE_ETH_RETA_GROUP_SIZE];
+    
+    memset(reta_conf, 0, sizeof(reta_conf));
+    for (uint16_t i = 0; i < rss->reta_size; i++) {
+        uint16_t group = i / RTE_ETH_RETA_GROUP_SIZE;
+        uint16_t shift = i % RTE_ETH_RETA_GROUP_SIZE;
+        reta_conf[group].mask |= 1ULL << shift;
+        reta_conf[group].reta[shift] = rss->reta[i];
+    }
+    
+    return rte_eth_dev_rss_reta_update(port_id, reta_conf, rss->reta_size);
+}
+
 int
 dpdk_port_init(uint16_t port_id, uint16_t num_queues,
-               struct rte_mempool *mbuf_pool)
+               struct rte_mempool *mbuf_pool, struct cgnat_config *config)
 {
+    const uint64_t cksum_capa = RTE_ETH_TX_OFFLOAD_IPV4_CKSUM |
+                                RTE_ETH_TX_OFFLOAD_TCP_CKSUM |
+                                RTE_ETH_TX_OFFLOAD_UDP_CKSUM;
     struct rte_eth_conf port_conf = {
         .rxmode = {
+            .mq_mode = RTE_ETH_MQ_RX_RSS,
             .mtu = RTE_ETHER_MTU,
             .max_lro_pkt_size = RTE_ETHER_MAX_LEN,
         },
@@ -103,8 +172,59 @@ dpdk_port_init(uint16_t port_id, uint16_t num_queues,
         return ret;
     }
     
-    /* Configure port */
-    ret = rte_eth_dev_configure(port_id, num_queues, num_queues, &port_conf);
+    /* Hash only on what the NIC supports */
+    port_conf.rx_adv_conf.rss_conf.rss_hf &= dev_info.flow_type_rss_offloads;
+    
+    if (config->rss.mode == RSS_MODE_SYMMETRIC) {
+        /* A second port must hash exactly like the first */
+        if (config->rss.key_len != 0 &&
+            (dev_info.hash_key_size != config->rss.key_len ||
+             dev_info.reta_size != config->rss.reta_size)) {
+            fprintf(stderr, "Error: Port %u RSS (key %u bytes, RETA %u entries) "
+                    "differs from the other port's\n", port_id,
+                    dev_info.hash_key_size, dev_info.reta_size);
+            return -1;
+        }
+        if (setup_symmetric_rss(num_queues, &dev_info, &config->rss) < 0) {
+            fprintf(stderr, "Error: Port %u cannot use symmetric RSS "
+                    "(key %u bytes, RETA %u entries)\n", port_id,
+                    dev_info.hash_key_size, dev_info.reta_size);
+            return -1;
+        }
+        port_conf.rx_adv_conf.rss_conf.rss_key = config->rss.key;
+        port_conf.rx_adv_conf.rss_conf.rss_key_len = config->rss.key_len;
+    } else if (config->rss.mode == RSS_MODE_FLOW && num_queues > 1 &&
+               port_id == config->sides[NAT_SIDE_INSIDE].port_id) {
+        /*
+         * Steering rules place return traffic; a known key and RETA on the
+         * inside port let workers tell where RSS put an outbound flow, for
+         * the ICMP errors and fragments that the NIC hashes differently.
+         * Without them those are translated where they arrive.
+         */
+        if (setup_symmetric_rss(num_queues, &dev_info, &config->rss) == 0) {
+            port_conf.rx_adv_conf.rss_conf.rss_key = config->rss.key;
+            port_conf.rx_adv_conf.rss_conf.rss_key_len = config->rss.key_len;
+        } else {
+            printf("[DPDK] Port %u: RSS key and RETA not settable; outbound "
+                   "ICMP errors and fragments stay on the receiving worker\n",
+                   port_id);
+        }
+    }
+    
+    /* Enable TX checksum offload if requested and supported */
+    if (config->checksum_offload) {
+        if ((dev_info.tx_offload_capa & cksum_capa) == cksum_capa) {
+            port_conf.txmode.offloads |= cksum_capa;
+            printf("[DPDK] Port %u: TX checksum offload enabled\n", port_id);
+        } else {
+            printf("[DPDK] Port %u: TX checksum offload not supported, "
+                   "using incremental checksums\n", port_id);
+            config->checksum_offload = false;
+        }
+    }
+    
+    /* Configure port (the extra TX queue belongs to the main lcore) */
+    ret = rte_eth_dev_configure(port_id, num_queues, num_queues + 1, &port_conf);
     if (ret != 0) {
         fprintf(stderr, "Error configuring port %u: %s\n",
                 port_id, rte_strerror(-ret));
@@ -124,10 +244,12 @@ dpdk_port_init(uint16_t port_id, uint16_t num_queues,
     }
     
     /* Setup TX queues */
-    for (uint16_t q = 0; q < num_queues; q++) {
+    for (uint16_t q = 0; q <= num_queues; q++) {
+        struct rte_eth_txconf txconf = dev_info.default_txconf;
+        txconf.offloads = port_conf.txmode.offloads;
         ret = rte_eth_tx_queue_setup(port_id, q, 1024,
                                      rte_eth_dev_socket_id(port_id),
-                                     NULL);
+                                     &txconf);
         if (ret < 0) {
             fprintf(stderr, "Error setting up TX queue %u on port %u: %s\n",
                     q, port_id, rte_strerror(-ret));
@@ -135,7 +257,24 @@ dpdk_port_init(uint16_t port_id, uint16_t num_queues,
         }
     }
     
-    printf("[DPDK] Port %u configured with %u RX/TX queues\n", port_id, num_queues);
+    if (config->rss.mode == RSS_MODE_SYMMETRIC) {
+        ret = program_reta(port_id, &config->rss);
+        if (ret != 0) {
+            fprintf(stderr, "Error updating RETA on port %u: %s\n",
+                    port_id, rte_strerror(-ret));
+            return ret;
+        }
+        printf("[DPDK] Port %u: symmetric RSS (%u-byte key, %u RETA entries)\n",
+               port_id, config->rss.key_len, config->rss.reta_size);
+    } else if (port_conf.rx_adv_conf.rss_conf.rss_key != NULL &&
+               program_reta(port_id, &config->rss) != 0) {
+        printf("[DPDK] Port %u: RETA not settable; outbound ICMP errors and "
+               "fragments stay on the receiving worker\n", port_id);
+        config->rss.key_len = 0;
+    }
+    
+    printf("[DPDK] Port %u configured with %u RX/TX queues (+1 TX for control)\n",
+           port_id, num_queues);
     return 0;
 }
 
@@ -182,13 +321,226 @@ dpdk_get_link_status(uint16_t port_id, struct rte_eth_link *link)
     return rte_eth_link_get_nowait(port_id, link);
 }
 
-/* Worker context passed to each core */
-struct worker_ctx {
-    unsigned int core_id;
-    unsigned int queue_id;
-    uint16_t port_id;
-    struct nat_core_ctx *nat_ctx;
-};
+/* Helper: TX buffer error callback: count and free what the NIC refused */
+static void
+worker_tx_dropped(struct rte_mbuf **pkts, uint16_t unsent, void *userdata)
+{
+    struct core_stats *stats = userdata;
+    
+    for (uint16_t i = 0; i < unsent; i++) {
+        stats->bytes_tx -= pkts[i]->pkt_len;
+        rte_pktmbuf_free(pkts[i]);
+    }
+    stats->packets_dropped += unsent;
+}
+
+int
+dpdk_worker_init(struct worker_ctx *ctx, unsigned int core_id,
+                 unsigned int queue_id, struct egress_side *egress,
+                 struct nat_core_ctx *nat)
+{
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->core_id = core_id;
+    ctx->queue_id = queue_id;
+    ctx->egress = egress;
+    ctx->nat_ctx = nat;
+    
+    for (int s = 0; s < NAT_SIDES; s++) {
+        bool arp = egress[s].arp || egress[s].local_ip != 0;
+        
+        /* One-arm: the outside shares the inside's queue and buffer */
+        if (s > 0 && egress[s].port_id == egress[0].port_id) {
+            ctx->tx_buf[s] = ctx->tx_buf[0];
+            ctx->rx_arp[0] |= arp;
+            continue;
+        }
+        
+        ctx->tx_buf[s] = rte_zmalloc_socket("tx_buffer",
+                                            RTE_ETH_TX_BUFFER_SIZE(TX_BURST_SIZE),
+                                            RTE_CACHE_LINE_SIZE, nat->socket_id);
+        if (!ctx->tx_buf[s]) {
+            dpdk_worker_cleanup(ctx);
+            return -1;
+        }
+        rte_eth_tx_buffer_init(ctx->tx_buf[s], TX_BURST_SIZE);
+        rte_eth_tx_buffer_set_err_callback(ctx->tx_buf[s], worker_tx_dropped,
+                                           &nat->stats);
+        
+        ctx->rx_ports[ctx->num_rx_ports] = egress[s].port_id;
+        ctx->rx_arp[ctx->num_rx_ports++] = arp;
+    }
+    
+    return 0;
+}
+
+void
+dpdk_worker_cleanup(struct worker_ctx *ctx)
+{
+    for (int s = NAT_SIDES - 1; s >= 0; s--) {
+        if (s == 0 || ctx->tx_buf[s] != ctx->tx_buf[0])
+            rte_free(ctx->tx_buf[s]);
+        ctx->tx_buf[s] = NULL;
+    }
+}
+
+/*
+ * Helper: Queue translated packets on the port of their egress side
+ * Sides with a next hop get their Ethernet addresses set first; packets
+ * leave when a buffer fills or at the next drain (worker_tx_flush).
+ */
+static inline void
+worker_tx(struct worker_ctx *ctx, struct rte_mbuf **pkts, uint16_t tx_count)
+{
+    struct core_stats *stats = &ctx->nat_ctx->stats;
+    uint64_t next_hop[NAT_SIDES];
+    
+    /* ARP may change a next hop at any time; one read per batch */
+    for (int s = 0; s < NAT_SIDES; s++)
+        next_hop[s] = __atomic_load_n(&ctx->egress[s].next_hop_mac,
+                                      __ATOMIC_RELAXED);
+    
+    for (uint16_t i = 0; i < tx_count; i++) {
+        struct rte_mbuf *m = pkts[i];
+        uint16_t side = m->port;
+        const struct egress_side *eg = &ctx->egress[side];
+        
+        if (eg->rewrite) {
+            struct rte_ether_hdr *eth = rte_pktmbuf_mtod(m, struct rte_ether_hdr *);
+            
+            if (unlikely(next_hop[side] == 0)) {
+                stats->neighbor_unresolved++;
+                stats->packets_dropped++;
+                rte_pktmbuf_free(m);
+                continue;
+            }
+            memcpy(&eth->dst_addr, &next_hop[side], RTE_ETHER_ADDR_LEN);
+            rte_ether_addr_copy(&eg->port_mac, &eth->src_addr);
+        }
+        
+        /* Bytes count when queued; the error callback takes refused ones back */
+        stats->bytes_tx += m->pkt_len;
+        stats->packets_tx += rte_eth_tx_buffer(eg->port_id, ctx->queue_id,
+                                               ctx->tx_buf[side], m);
+    }
+}
+
+/* Helper: Send whatever the TX buffers hold */
+static void
+worker_tx_flush(struct worker_ctx *ctx)
+{
+    for (int s = 0; s < NAT_SIDES; s++) {
+        if (s > 0 && ctx->tx_buf[s] == ctx->tx_buf[0])
+            continue;
+        ctx->nat_ctx->stats.packets_tx +=
+            rte_eth_tx_buffer_flush(ctx->egress[s].port_id, ctx->queue_id,
+                                    ctx->tx_buf[s]);
+    }
+}
+
+/* Helper: Take ARP frames out of a burst; replies leave on the same port */
+static uint16_t
+worker_take_arp(struct worker_ctx *ctx, uint16_t port_id,
+                struct rte_mbuf **pkts, uint16_t nb_pkts)
+{
+    struct core_stats *stats = &ctx->nat_ctx->stats;
+    uint16_t kept = 0;
+    
+    for (uint16_t i = 0; i < nb_pkts; i++) {
+        struct rte_mbuf *m = pkts[i];
+        const struct rte_ether_hdr *eth = rte_pktmbuf_mtod(m, struct rte_ether_hdr *);
+        int side;
+        
+        if (likely(eth->ether_type != rte_cpu_to_be_16(RTE_ETHER_TYPE_ARP))) {
+            pkts[kept++] = m;
+            continue;
+        }
+        
+        side = dpdk_arp_input(ctx->egress, port_id, m);
+        if (side >= 0) {
+            stats->bytes_tx += m->pkt_len;
+            stats->packets_tx += rte_eth_tx_buffer(port_id, ctx->queue_id,
+                                                   ctx->tx_buf[side], m);
+        }
+    }
+    return kept;
+}
+
+/* Helper: Receive, translate and queue one burst from a port */
+static inline void
+worker_rx_port(struct worker_ctx *ctx, uint16_t idx, struct rte_mbuf **pkts)
+{
+    struct nat_core_ctx *nat = ctx->nat_ctx;
+    uint16_t port_id = ctx->rx_ports[idx];
+    uint16_t nb_rx, tx_count;
+    
+    nb_rx = rte_eth_rx_burst(port_id, ctx->queue_id, pkts, RX_BURST_SIZE);
+    if (nb_rx == 0)
+        return;
+    
+    nat->stats.packets_rx += nb_rx;
+    for (uint16_t i = 0; i < nb_rx; i++)
+        nat->stats.bytes_rx += pkts[i]->pkt_len;
+    
+    /* Next hop resolution and requests for our own addresses */
+    if (ctx->rx_arp[idx]) {
+        nb_rx = worker_take_arp(ctx, port_id, pkts, nb_rx);
+        if (nb_rx == 0)
+            return;
+    }
+    
+    /* Classify, look up and translate the whole burst */
+    tx_count = nat_process_burst(nat, pkts, nb_rx);
+    if (tx_count > 0)
+        worker_tx(ctx, pkts, tx_count);
+}
+
+/* Helper: Translate and send packets other workers handed to this core */
+static void
+worker_drain_handoff(struct worker_ctx *ctx, struct rte_mbuf **pkts)
+{
+    struct nat_core_ctx *nat = ctx->nat_ctx;
+    
+    for (unsigned int src = 0; src < nat->num_workers; src++) {
+        unsigned int nb;
+        uint16_t tx_count;
+        
+        if (nat->handoff_in[src] == NULL)
+            continue;
+        
+        nb = rte_ring_sc_dequeue_burst(nat->handoff_in[src], (void **)pkts,
+                                       RX_BURST_SIZE, NULL);
+        if (nb == 0)
+            continue;
+        
+        /* Already counted in packets_rx by the receiving worker */
+        nat->stats.handoff_rx += nb;
+        
+        tx_count = nat_process_burst(nat, pkts, nb);
+        if (tx_count > 0)
+            worker_tx(ctx, pkts, tx_count);
+    }
+}
+
+/* Helper: Transmit held fragments released by their first fragment */
+static void
+worker_drain_fragments(struct worker_ctx *ctx, struct rte_mbuf **pkts)
+{
+    uint16_t nb = nat_frag_drain(ctx->nat_ctx, pkts, RX_BURST_SIZE);
+    
+    if (nb > 0)
+        worker_tx(ctx, pkts, nb);
+}
+
+/* Helper: Adopt a parameter generation published by a reload */
+static inline void
+worker_refresh_params(struct nat_core_ctx *nat)
+{
+    struct nat_params *params = __atomic_load_n(&nat->params->active,
+                                                __ATOMIC_ACQUIRE);
+    
+    if (unlikely(params != NULL && params->generation != nat->params_generation))
+        nat_params_apply(nat, params);
+}
 
 /**
  * Main packet processing loop (per worker core)
@@ -197,87 +549,71 @@ int
 dpdk_worker_main(void *arg)
 {
     struct worker_ctx *ctx = (struct worker_ctx *)arg;
-    struct rte_mbuf *rx_pkts[RX_BURST_SIZE];
-    struct rte_mbuf *tx_pkts[TX_BURST_SIZE];
-    uint16_t nb_rx, nb_tx;
-    unsigned int tx_count;
+    struct rte_mbuf *pkts[RX_BURST_SIZE];
+    uint64_t drain_tsc = (rte_get_tsc_hz() + US_PER_S - 1) / US_PER_S *
+                         TX_DRAIN_US;
+    uint64_t publish_tsc = (rte_get_tsc_hz() + US_PER_S - 1) / US_PER_S *
+                           STATS_PUBLISH_US;
+    uint64_t now;
+    
+    struct rte_rcu_qsbr *rcu = ctx->nat_ctx->rcu;
+    unsigned int thread_id = ctx->nat_ctx->worker_id;
     
     printf("[WORKER %u] Started on lcore %u (queue %u)\n",
            ctx->core_id, rte_lcore_id(), ctx->queue_id);
     
+    /* Control plane waits for this core before freeing shared state */
+    if (rcu)
+        rte_rcu_qsbr_thread_online(rcu, thread_id);
+    
     /* Main processing loop */
     while (!force_quit) {
-        /* Receive packet burst */
-        nb_rx = rte_eth_rx_burst(ctx->port_id, ctx->queue_id,
-                                rx_pkts, RX_BURST_SIZE);
+        /* Nothing read from shared state in earlier passes is still held */
+        if (rcu)
+            rte_rcu_qsbr_quiescent(rcu, thread_id);
         
-        if (unlikely(nb_rx == 0))
-            continue;
+        /* Reloaded timeouts, limits and public IPs (after quiescence) */
+        if (ctx->nat_ctx->params)
+            worker_refresh_params(ctx->nat_ctx);
         
-        ctx->nat_ctx->stats.packets_rx += nb_rx;
+        /* Age out a bounded number of sessions (also runs when idle) */
+        nat_expire_sessions(ctx->nat_ctx);
         
-        tx_count = 0;
-        for (uint16_t i = 0; i < nb_rx; i++) {
-            struct rte_mbuf *m = rx_pkts[i];
-            ctx->nat_ctx->stats.bytes_rx += m->pkt_len;
-            
-            /* Determine packet direction and process */
-            struct rte_ether_hdr *eth = rte_pktmbuf_mtod(m, struct rte_ether_hdr *);
-            if (eth->ether_type == rte_cpu_to_be_16(RTE_ETHER_TYPE_IPV4)) {
-                struct rte_ipv4_hdr *ip = (struct rte_ipv4_hdr *)(eth + 1);
-                uint32_t src_ip = rte_be_to_cpu_32(ip->src_addr);
-                
-                int ret;
-                /* Check if outbound (from customer) or inbound (to customer) */
-                if ((src_ip & ctx->nat_ctx->customer_netmask) == ctx->nat_ctx->customer_subnet) {
-                    /* Outbound packet */
-                    ret = nat_process_outbound(ctx->nat_ctx, m);
-                } else {
-                    /* Inbound packet */
-                    ret = nat_process_inbound(ctx->nat_ctx, m);
-                }
-                
-                if (ret == 0) {
-                    /* Successfully translated - queue for TX */
-                    tx_pkts[tx_count++] = m;
-                } else {
-                    /* Translation failed - drop packet */
-                    rte_pktmbuf_free(m);
-                    ctx->nat_ctx->stats.packets_dropped++;
-                }
-            } else {
-                /* Non-IPv4 packet - drop */
-                rte_pktmbuf_free(m);
-                ctx->nat_ctx->stats.packets_dropped++;
-            }
-        }
+        /* Packets whose session this core owns but another core received */
+        if (ctx->nat_ctx->handoff_in)
+            worker_drain_handoff(ctx, pkts);
         
-        /* Transmit translated packets */
-        if (tx_count > 0) {
-            nb_tx = rte_eth_tx_burst(ctx->port_id, ctx->queue_id,
-                                    tx_pkts, tx_count);
-            ctx->nat_ctx->stats.packets_tx += nb_tx;
-            
-            /* Update byte counter */
-            for (uint16_t i = 0; i < nb_tx; i++) {
-                ctx->nat_ctx->stats.bytes_tx += tx_pkts[i]->pkt_len;
-            }
-            
-            /* Free any unsent packets */
-            if (unlikely(nb_tx < tx_count)) {
-                for (uint16_t i = nb_tx; i < tx_count; i++) {
-                    rte_pktmbuf_free(tx_pkts[i]);
-                    ctx->nat_ctx->stats.packets_dropped++;
-                }
-            }
+        /* Out-of-order fragments whose datagram is now resolved */
+        worker_drain_fragments(ctx, pkts);
+        
+        /* Receive from every port (inside and outside, or the one arm) */
+        for (uint16_t i = 0; i < ctx->num_rx_ports; i++)
+            worker_rx_port(ctx, i, pkts);
+        
+        /* This pass's NAT events go to the logger in one burst */
+        nat_event_flush(ctx->nat_ctx);
+        
+        /* Full buffers go out at once; partial ones wait TX_DRAIN_US at most */
+        now = rte_rdtsc();
+        if (unlikely(now - ctx->tx_drain_tsc > drain_tsc)) {
+            worker_tx_flush(ctx);
+            ctx->tx_drain_tsc = now;
         }
         
-        /* Periodic cleanup (every ~1M packets) */
-        if (unlikely((ctx->nat_ctx->stats.packets_rx & 0xFFFFF) == 0)) {
-            nat_expire_sessions(ctx->nat_ctx);
+        /* Counters for the collector: one copy per period, never a lock */
+        if (unlikely(now - ctx->stats_publish_tsc > publish_tsc)) {
+            nat_stats_publish(ctx->nat_ctx);
+            ctx->stats_publish_tsc = now;
         }
     }
     
+    worker_tx_flush(ctx);
+    nat_event_flush(ctx->nat_ctx);
+    nat_stats_publish(ctx->nat_ctx);
+    
+    if (rcu)
+        rte_rcu_qsbr_thread_offline(rcu, thread_id);
+    
     printf("[WORKER %u] Shutting down gracefully\n", ctx->core_id);
     return 0;
 }
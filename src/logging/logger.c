@@ -1,41 +1,638 @@
 /* SPDX-License-Identifier: MIT */
 /**
  * @file logger.c
- * @brief High-performance structured logging
+ * @brief Structured logging and the NAT event log writer
+ *
+ * The event logger thread drains the workers' rings in turn, stamps each
+ * event with wall-clock time and encodes it into a message buffer. Within
+ * a pass, finished messages are collected into one write() to the log
+ * file, or sent as one datagram each to a collector. With a rate limit the
+ * thread takes no more events than its token bucket holds; the rest wait
+ * in the rings, which drop new events once full.
+ *
+ * IPFIX output follows RFC 7011 with the NAT44 session and port block
+ * templates of RFC 8158. Templates are repeated every
+ * IPFIX_TEMPLATE_REFRESH_S so that a collector started later, or a reader
+ * of part of a file, can decode what follows.
  */
 
+#include "logger.h"
+#include <rte_byteorder.h>
+#include <rte_common.h>
+#include <rte_cycles.h>
+#include <rte_ring.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <netinet/in.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdarg.h>
-#include <time.h>
 #include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LOG_DRAIN_BURST     256         /* Events dequeued per ring and pass */
+#define LOG_IDLE_US         1000        /* Pause when no ring was backlogged */
+#define LOG_MSG_MAX_UDP     1400        /* One datagram */
+#define LOG_MSG_MAX_FILE    16384
+#define LOG_WRITE_BATCH     (256 * 1024)    /* File output per write() */
+#define LOG_JSON_MAX        320         /* Longest JSON line */
 
-typedef enum {
-    LOG_DEBUG,
-    LOG_INFO,
-    LOG_WARN,
-    LOG_ERROR,
-    LOG_FATAL
-} log_level_t;
+#define IPFIX_VERSION            10
+#define IPFIX_HEADER_LEN         16
+#define IPFIX_SET_HEADER_LEN     4
+#define IPFIX_SET_TEMPLATE       2
+#define IPFIX_TEMPLATE_SESSION   256
+#define IPFIX_TEMPLATE_BLOCK     257
+#define IPFIX_TEMPLATE_REFRESH_S 60
+#define IPFIX_DOMAIN_ID          0
+
+/* Information elements (IANA IPFIX registry) */
+#define IE_PROTOCOL              4      /* protocolIdentifier */
+#define IE_SRC_PORT              7      /* sourceTransportPort */
+#define IE_SRC_IPV4              8      /* sourceIPv4Address */
+#define IE_DST_PORT              11     /* destinationTransportPort */
+#define IE_DST_IPV4              12     /* destinationIPv4Address */
+#define IE_POST_NAT_SRC_IPV4     225    /* postNATSourceIPv4Address */
+#define IE_POST_NAPT_SRC_PORT    227    /* postNAPTSourceTransportPort */
+#define IE_NAT_EVENT             230    /* natEvent */
+#define IE_OBS_TIME_MS           323    /* observationTimeMilliseconds */
+#define IE_PORT_RANGE_START      361    /* portRangeStart */
+#define IE_PORT_RANGE_END        362    /* portRangeEnd */
+
+struct ipfix_field {
+    uint16_t id;
+    uint16_t len;
+};
+
+/* NAT44 session create/delete (RFC 8158 section 4.1) */
+static const struct ipfix_field session_fields[] = {
+    { IE_OBS_TIME_MS, 8 },
+    { IE_NAT_EVENT, 1 },
+    { IE_SRC_IPV4, 4 },
+    { IE_POST_NAT_SRC_IPV4, 4 },
+    { IE_PROTOCOL, 1 },
+    { IE_SRC_PORT, 2 },
+    { IE_POST_NAPT_SRC_PORT, 2 },
+    { IE_DST_IPV4, 4 },
+    { IE_DST_PORT, 2 },
+};
+#define IPFIX_SESSION_LEN   28
+
+/* Port block allocation/de-allocation (RFC 8158 section 4.6) */
+static const struct ipfix_field block_fields[] = {
+    { IE_OBS_TIME_MS, 8 },
+    { IE_NAT_EVENT, 1 },
+    { IE_SRC_IPV4, 4 },
+    { IE_POST_NAT_SRC_IPV4, 4 },
+    { IE_PORT_RANGE_START, 2 },
+    { IE_PORT_RANGE_END, 2 },
+};
+#define IPFIX_BLOCK_LEN     21
 
 static const char *level_strings[] = {
     "DEBUG", "INFO", "WARN", "ERROR", "FATAL"
 };
 
+/* Event logger state: the thread's own, except for running */
+static struct {
+    struct nat_core_ctx *cores;
+    unsigned int num_cores;
+    unsigned int next_core;             /* First ring of the next pass */
+    enum event_log_format format;
+    int fd;
+    bool udp;
+
+    /* Token bucket, events per second (0 = unlimited) */
+    uint32_t rate;
+    double tokens;
+    uint64_t refill_tsc;
+
+    /* Clock of the current pass, for event timestamps */
+    uint64_t hz;
+    uint64_t now_tsc;
+    uint64_t now_ms;
+
+    /* Message being built */
+    uint8_t msg[LOG_MSG_MAX_FILE];
+    size_t msg_len;
+    size_t msg_max;
+    uint32_t msg_records;
+    size_t set_start;                   /* IPFIX: open data set, 0 if none */
+    uint16_t set_id;
+    uint32_t sequence;                  /* IPFIX: data records before msg */
+    uint64_t templates_ms;              /* IPFIX: last sent, 0 = never */
+
+    /* File output waiting for write() */
+    uint8_t out[LOG_WRITE_BATCH];
+    size_t out_len;
+
+    uint64_t written;
+    uint64_t lost;                      /* Encoded, but the write failed */
+
+    volatile bool running;
+    pthread_t thread;
+} evlog = { .fd = -1 };
+
 void
 cgnat_log(log_level_t level, const char *format, ...)
 {
     time_t now = time(NULL);
-    struct tm *tm_info = localtime(&now);
+    struct tm tm_info;
     char timestamp[64];
-    
-    strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", tm_info);
-    
-    printf("[%s] [%s] ", timestamp, level_strings[level]);
-    
+    char message[1024];
     va_list args;
+
+    localtime_r(&now, &tm_info);
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", &tm_info);
+
     va_start(args, format);
-    vprintf(format, args);
+    vsnprintf(message, sizeof(message), format, args);
     va_end(args);
-    
+
+    /* One call, so lines from different threads do not interleave */
+    printf("[%s] [%s] %s\n", timestamp, level_strings[level], message);
+}
+
+/* Helper: Report a failed write or send, the first time only */
+static void
+sink_error(size_t records)
+{
+    if (evlog.lost == 0)
+        fprintf(stderr, "[EVENTS] Cannot write NAT event log: %s\n",
+                strerror(errno));
+    evlog.lost += records;
+}
+
+/* Helper: Write buffered file output */
+static void
+sink_flush(void)
+{
+    size_t done = 0;
+
+    while (done < evlog.out_len) {
+        ssize_t n = write(evlog.fd, evlog.out + done, evlog.out_len - done);
+
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            /* Records are not tracked per byte: count a batch as one */
+            sink_error(1);
+            break;
+        }
+        done += n;
+    }
+    evlog.out_len = 0;
+}
+
+/* Helper: Hand a finished message to the target */
+static void
+sink_put(const uint8_t *data, size_t len, uint32_t records)
+{
+    if (evlog.udp) {
+        if (send(evlog.fd, data, len, 0) < 0)
+            sink_error(records);
+        else
+            evlog.written += records;
+        return;
+    }
+
+    if (evlog.out_len + len > sizeof(evlog.out))
+        sink_flush();
+    memcpy(evlog.out + evlog.out_len, data, len);
+    evlog.out_len += len;
+    evlog.written += records;
+}
+
+/* Helpers: Append big-endian fields to the message */
+static inline void
+put8(uint8_t v)
+{
+    evlog.msg[evlog.msg_len++] = v;
+}
+
+static inline void
+put16(uint16_t v)
+{
+    v = rte_cpu_to_be_16(v);
+    memcpy(evlog.msg + evlog.msg_len, &v, sizeof(v));
+    evlog.msg_len += sizeof(v);
+}
+
+static inline void
+put32(uint32_t v)
+{
+    v = rte_cpu_to_be_32(v);
+    memcpy(evlog.msg + evlog.msg_len, &v, sizeof(v));
+    evlog.msg_len += sizeof(v);
+}
+
+static inline void
+put64(uint64_t v)
+{
+    v = rte_cpu_to_be_64(v);
+    memcpy(evlog.msg + evlog.msg_len, &v, sizeof(v));
+    evlog.msg_len += sizeof(v);
+}
+
+/* Helper: Set the length of the open IPFIX data set and close it */
+static void
+ipfix_close_set(void)
+{
+    uint16_t len;
+
+    if (evlog.set_start == 0)
+        return;
+
+    len = rte_cpu_to_be_16(evlog.msg_len - evlog.set_start);
+    memcpy(evlog.msg + evlog.set_start + 2, &len, sizeof(len));
+    evlog.set_start = 0;
+    evlog.set_id = 0;
+}
+
+/* Helper: Append one template record */
+static void
+ipfix_put_template(uint16_t id, const struct ipfix_field *fields,
+                   unsigned int num_fields)
+{
+    put16(id);
+    put16(num_fields);
+    for (unsigned int i = 0; i < num_fields; i++) {
+        put16(fields[i].id);
+        put16(fields[i].len);
+    }
+}
+
+/* Helper: Start a message; IPFIX gets its header and, when due, templates */
+static void
+msg_begin(void)
+{
+    evlog.msg_len = 0;
+    evlog.msg_records = 0;
+    evlog.set_start = 0;
+    evlog.set_id = 0;
+
+    if (evlog.format != EVENT_LOG_IPFIX)
+        return;
+
+    /* Header is filled in by msg_end() */
+    evlog.msg_len = IPFIX_HEADER_LEN;
+
+    if (evlog.templates_ms != 0 &&
+        evlog.now_ms - evlog.templates_ms < IPFIX_TEMPLATE_REFRESH_S * 1000)
+        return;
+    evlog.templates_ms = evlog.now_ms;
+
+    evlog.set_start = evlog.msg_len;
+    put16(IPFIX_SET_TEMPLATE);
+    put16(0);
+    ipfix_put_template(IPFIX_TEMPLATE_SESSION, session_fields,
+                       RTE_DIM(session_fields));
+    ipfix_put_template(IPFIX_TEMPLATE_BLOCK, block_fields,
+                       RTE_DIM(block_fields));
+    ipfix_close_set();
+}
+
+/* Helper: Finish the message and hand it to the target */
+static void
+msg_end(void)
+{
+    size_t len = evlog.msg_len;
+
+    if (evlog.msg_records == 0)
+        return;
+
+    if (evlog.format == EVENT_LOG_IPFIX) {
+        ipfix_close_set();
+        evlog.msg_len = 0;
+        put16(IPFIX_VERSION);
+        put16(len);
+        put32(evlog.now_ms / 1000);     /* Export time */
+        put32(evlog.sequence);
+        put32(IPFIX_DOMAIN_ID);
+        evlog.sequence += evlog.msg_records;
+    }
+
+    sink_put(evlog.msg, len, evlog.msg_records);
+    evlog.msg_len = 0;
+    evlog.msg_records = 0;
+}
+
+/* Helper: Format a host byte order address */
+static const char *
+ip_str(uint32_t ip, char *buf, size_t size)
+{
+    snprintf(buf, size, "%u.%u.%u.%u",
+             (ip >> 24) & 0xFF, (ip >> 16) & 0xFF, (ip >> 8) & 0xFF, ip & 0xFF);
+    return buf;
+}
+
+/* Helper: Wall-clock time of an event, from the pass's clock sample */
+static uint64_t
+event_time_ms(const struct nat_event *ev)
+{
+    if (ev->tsc >= evlog.now_tsc)
+        return evlog.now_ms;
+    return evlog.now_ms - (evlog.now_tsc - ev->tsc) * 1000 / evlog.hz;
+}
+
+static bool
+is_session_event(const struct nat_event *ev)
+{
+    return ev->type == NAT_EVENT_SESSION_CREATE ||
+           ev->type == NAT_EVENT_SESSION_DELETE;
+}
+
+static void
+encode_ipfix(const struct nat_event *ev, uint64_t time_ms)
+{
+    uint16_t tmpl = is_session_event(ev) ? IPFIX_TEMPLATE_SESSION :
+                                           IPFIX_TEMPLATE_BLOCK;
+
+    if (evlog.set_id != tmpl) {
+        ipfix_close_set();
+        evlog.set_start = evlog.msg_len;
+        evlog.set_id = tmpl;
+        put16(tmpl);
+        put16(0);
+    }
+
+    put64(time_ms);
+    put8(ev->type);
+    put32(ev->private_ip);
+    put32(ev->public_ip);
+    if (tmpl == IPFIX_TEMPLATE_SESSION) {
+        put8(ev->protocol);
+        put16(ev->private_port);
+        put16(ev->public_port);
+        put32(ev->remote_ip);
+        put16(ev->remote_port);
+    } else {
+        put16(ev->public_port);
+        put16(ev->port_end);
+    }
+}
+
+static void
+encode_binary(const struct nat_event *ev, uint64_t time_ms)
+{
+    struct nat_log_record rec = {
+        .timestamp_ms = rte_cpu_to_be_64(time_ms),
+        .event = ev->type,
+        .protocol = ev->protocol,
+        .private_ip = rte_cpu_to_be_32(ev->private_ip),
+        .public_ip = rte_cpu_to_be_32(ev->public_ip),
+        .remote_ip = rte_cpu_to_be_32(ev->remote_ip),
+        .private_port = rte_cpu_to_be_16(ev->private_port),
+        .public_port = rte_cpu_to_be_16(ev->public_port),
+        .remote_port = rte_cpu_to_be_16(ev->remote_port),
+        .port_end = rte_cpu_to_be_16(ev->port_end),
+    };
+
+    memcpy(evlog.msg + evlog.msg_len, &rec, sizeof(rec));
+    evlog.msg_len += sizeof(rec);
+}
+
+static void
+encode_json(const struct nat_event *ev, uint64_t time_ms)
+{
+    char *out = (char *)evlog.msg + evlog.msg_len;
+    char priv[16], pub[16], remote[16];
+    int n;
+
+    if (is_session_event(ev))
+        n = snprintf(out, LOG_JSON_MAX,
+                     "{\"timestamp_ms\":%lu,\"event\":\"%s\",\"protocol\":%u,"
+                     "\"private_ip\":\"%s\",\"private_port\":%u,"
+                     "\"public_ip\":\"%s\",\"public_port\":%u,"
+                     "\"remote_ip\":\"%s\",\"remote_port\":%u}\n",
+                     time_ms,
+                     ev->type == NAT_EVENT_SESSION_CREATE ? "session_create" :
+                                                            "session_delete",
+                     ev->protocol,
+                     ip_str(ev->private_ip, priv, sizeof(priv)), ev->private_port,
+                     ip_str(ev->public_ip, pub, sizeof(pub)), ev->public_port,
+                     ip_str(ev->remote_ip, remote, sizeof(remote)), ev->remote_port);
+    else
+        n = snprintf(out, LOG_JSON_MAX,
+                     "{\"timestamp_ms\":%lu,\"event\":\"%s\","
+                     "\"private_ip\":\"%s\",\"public_ip\":\"%s\","
+                     "\"port_start\":%u,\"port_end\":%u}\n",
+                     time_ms,
+                     ev->type == NAT_EVENT_BLOCK_ALLOC ? "port_block_alloc" :
+                                                         "port_block_free",
+                     ip_str(ev->private_ip, priv, sizeof(priv)),
+                     ip_str(ev->public_ip, pub, sizeof(pub)),
+                     ev->public_port, ev->port_end);
+
+    evlog.msg_len += RTE_MIN(n, LOG_JSON_MAX - 1);
+}
+
+/* Helper: Add one event to the message, starting a new one when full */
+static void
+encode_event(const struct nat_event *ev)
+{
+    size_t need;
+
+    switch (evlog.format) {
+    case EVENT_LOG_IPFIX:
+        need = IPFIX_SET_HEADER_LEN +
+               (is_session_event(ev) ? IPFIX_SESSION_LEN : IPFIX_BLOCK_LEN);
+        break;
+    case EVENT_LOG_BINARY:
+        need = sizeof(struct nat_log_record);
+        break;
+    default:
+        need = LOG_JSON_MAX;
+        break;
+    }
+
+    if (evlog.msg_records != 0 && evlog.msg_len + need > evlog.msg_max)
+        msg_end();
+    if (evlog.msg_records == 0)
+        msg_begin();
+
+    switch (evlog.format) {
+    case EVENT_LOG_IPFIX:
+        encode_ipfix(ev, event_time_ms(ev));
+        break;
+    case EVENT_LOG_BINARY:
+        encode_binary(ev, event_time_ms(ev));
+        break;
+    default:
+        encode_json(ev, event_time_ms(ev));
+        break;
+    }
+    evlog.msg_records++;
+}
+
+/* Helper: Events the rate limit allows in this pass */
+static unsigned int
+rate_budget(void)
+{
+    double elapsed;
+
+    if (evlog.rate == 0)
+        return UINT_MAX;
+
+    /* At most one second of burst */
+    elapsed = (double)(evlog.now_tsc - evlog.refill_tsc) / evlog.hz;
+    evlog.refill_tsc = evlog.now_tsc;
+    evlog.tokens = RTE_MIN(evlog.tokens + elapsed * evlog.rate,
+                           (double)evlog.rate);
+    return (unsigned int)evlog.tokens;
+}
+
+/*
+ * Helper: Drain every ring once, up to LOG_DRAIN_BURST events each
+ * Returns true if a ring still had more (the next pass should not wait).
+ */
+static bool
+logger_drain(bool limited)
+{
+    struct nat_event events[LOG_DRAIN_BURST];
+    struct timespec ts;
+    unsigned int budget, taken = 0;
+    bool backlog = false;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    evlog.now_tsc = rte_rdtsc();
+    evlog.now_ms = (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+    budget = limited ? rate_budget() : UINT_MAX;
+
+    /* Start one ring further each pass, so a limit is shared fairly */
+    for (unsigned int k = 0; k < evlog.num_cores && taken < budget; k++) {
+        unsigned int c = (evlog.next_core + k) % evlog.num_cores;
+        unsigned int want = RTE_MIN(budget - taken, LOG_DRAIN_BURST);
+        unsigned int n;
+
+        n = rte_ring_sc_dequeue_burst_elem(evlog.cores[c].event_ring, events,
+                                           sizeof(events[0]), want, NULL);
+        for (unsigned int i = 0; i < n; i++)
+            encode_event(&events[i]);
+        taken += n;
+        backlog |= (n == LOG_DRAIN_BURST);
+    }
+    evlog.next_core = (evlog.next_core + 1) % evlog.num_cores;
+
+    if (limited && evlog.rate != 0)
+        evlog.tokens -= taken;
+
+    msg_end();
+    if (!evlog.udp)
+        sink_flush();
+    return backlog;
+}
+
+static void *
+logger_main(void *arg __rte_unused)
+{
+    printf("[EVENTS] Event logger started\n");
+
+    while (evlog.running) {
+        if (!logger_drain(true))
+            usleep(LOG_IDLE_US);
+    }
+
+    /* Workers have stopped: write what is left, regardless of the rate */
+    while (logger_drain(false))
+        ;
+
+    printf("[EVENTS] Event logger stopped: %lu events written, %lu lost\n",
+           evlog.written, evlog.lost);
+    return NULL;
+}
+
+/* Helper: Open the log file or connect to the collector */
+static int
+sink_open(const struct cgnat_config *config)
+{
+    if (config->event_log_collector_ip != 0) {
+        struct sockaddr_in addr = {
+            .sin_family = AF_INET,
+            .sin_addr.s_addr = htonl(config->event_log_collector_ip),
+            .sin_port = htons(config->event_log_collector_port),
+        };
+
+        evlog.fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        if (evlog.fd < 0 ||
+            connect(evlog.fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+            perror("[EVENTS] Cannot reach collector");
+            return -1;
+        }
+        evlog.udp = true;
+        evlog.msg_max = LOG_MSG_MAX_UDP;
+        return 0;
+    }
+
+    evlog.fd = open(config->event_log_path,
+                    O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0640);
+    if (evlog.fd < 0) {
+        fprintf(stderr, "[EVENTS] Cannot open %s: %s\n",
+                config->event_log_path, strerror(errno));
+        return -1;
+    }
+    evlog.udp = false;
+    evlog.msg_max = LOG_MSG_MAX_FILE;
+    return 0;
+}
+
+int
+event_logger_start(struct nat_core_ctx *cores, unsigned int num_cores,
+                   const struct cgnat_config *config)
+{
+    static const char *const format_names[] = { "IPFIX", "binary", "JSON" };
+
+    evlog.cores = cores;
+    evlog.num_cores = num_cores;
+    evlog.next_core = 0;
+    evlog.format = config->event_log_format;
+    evlog.rate = config->event_rate_limit;
+    evlog.tokens = evlog.rate;
+    evlog.hz = rte_get_tsc_hz();
+    evlog.refill_tsc = rte_rdtsc();
+    evlog.sequence = 0;
+    evlog.templates_ms = 0;
+    evlog.written = 0;
+    evlog.lost = 0;
+
+    if (sink_open(config) < 0) {
+        if (evlog.fd >= 0)
+            close(evlog.fd);
+        evlog.fd = -1;
+        return -1;
+    }
+
+    evlog.running = true;
+    if (pthread_create(&evlog.thread, NULL, logger_main, NULL) != 0) {
+        fprintf(stderr, "Failed to create event logger thread\n");
+        evlog.running = false;
+        close(evlog.fd);
+        evlog.fd = -1;
+        return -1;
+    }
+
+    printf("[EVENTS] NAT events as %s to %s, %u per core ring",
+           format_names[evlog.format],
+           evlog.udp ? "collector" : config->event_log_path,
+           config->event_ring_size);
+    if (evlog.rate != 0)
+        printf(", at most %u per second", evlog.rate);
     printf("\n");
+    return 0;
+}
+
+void
+event_logger_stop(void)
+{
+    if (!evlog.running)
+        return;
+
+    evlog.running = false;
+    pthread_join(evlog.thread, NULL);
+    close(evlog.fd);
+    evlog.fd = -1;
 }
@@ -0,0 +1,66 @@
+/* SPDX-License-Identifier: MIT */
+/**
+ * @file ring_buffer.c
+ * @brief Per-core NAT event rings (worker side)
+ *
+ * Each worker owns one rte_ring of struct nat_event elements, produced
+ * only by that worker and consumed only by the logger thread, so both
+ * ends use the single-producer/single-consumer paths. Events are staged
+ * in a small per-core batch and enqueued with one burst call.
+ */
+
+#include "logger.h"
+#include <rte_malloc.h>
+#include <rte_ring.h>
+#include <stdio.h>
+
+int
+nat_event_ring_init(struct nat_core_ctx *ctx, uint32_t size)
+{
+    char name[64];
+
+    /* On the worker's node: it writes the ring on every pass */
+    snprintf(name, sizeof(name), "nat_events_%u", ctx->worker_id);
+    ctx->event_ring = rte_ring_create_elem(name, sizeof(struct nat_event), size,
+                                           ctx->socket_id,
+                                           RING_F_SP_ENQ | RING_F_SC_DEQ |
+                                           RING_F_EXACT_SZ);
+    if (!ctx->event_ring) {
+        printf("Failed to create event ring of %u entries on core %u\n",
+               size, ctx->core_id);
+        return -1;
+    }
+
+    ctx->events = rte_zmalloc_socket(NULL, sizeof(*ctx->events),
+                                     RTE_CACHE_LINE_SIZE, ctx->socket_id);
+    if (!ctx->events) {
+        printf("Failed to allocate event batch on core %u\n", ctx->core_id);
+        nat_event_ring_free(ctx);
+        return -1;
+    }
+
+    return 0;
+}
+
+void
+nat_event_ring_free(struct nat_core_ctx *ctx)
+{
+    rte_ring_free(ctx->event_ring);
+    rte_free(ctx->events);
+    ctx->event_ring = NULL;
+    ctx->events = NULL;
+}
+
+void
+nat_event_ring_flush(struct nat_core_ctx *ctx)
+{
+    struct nat_event_batch *batch = ctx->events;
+    unsigned int n;
+
+    n = rte_ring_sp_enqueue_burst_elem(ctx->event_ring, batch->events,
+                                       sizeof(struct nat_event), batch->count,
+                                       NULL);
+    ctx->stats.events_logged += n;
+    ctx->stats.events_dropped += batch->count - n;
+    batch->count = 0;
+}
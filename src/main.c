@@ -4,66 +4,224 @@
  * @brief DPDK CGNAT main entry point
  */
 
+#include "api_server.h"
 #include "cgnat_types.h"
+#include "config.h"
 #include "dpdk_runtime.h"
+#include "http_server.h"
+#include "logger.h"
 #include "nat_engine.h"
 #include "telemetry.h"
 #include <rte_eal.h>
 #include <rte_launch.h>
 #include <rte_lcore.h>
+#include <rte_lpm.h>
+#include <rte_malloc.h>
+#include <rte_rcu_qsbr.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
-#include <pthread.h>
 
 /* Global configuration */
 static struct cgnat_config g_config;
 
-/* Per-core NAT contexts */
-static struct nat_core_ctx g_nat_cores[MAX_CORES];
+/* Application options ("C" takes the YAML file, read in a first pass) */
+#define OPTSTRING "C:p:Pq:ob:sHm:Ai:l:r:M"
 
-/* Global statistics (protected by mutex) */
-struct cgnat_global_stats *g_global_stats = NULL;
-pthread_mutex_t g_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+/* YAML file given with -C, re-read on SIGHUP if hot_reload is set */
+static const char *g_config_file;
+
+/* Per-core NAT contexts (one per worker, allocated at startup) */
+static struct nat_core_ctx *g_nat_cores;
+
+/* State shared with workers and swapped by the control plane */
+static struct rte_rcu_qsbr *g_rcu;
+static struct nat_params_stage g_params;
+static struct acl_stage g_acl;
+
+/* Customer prefix tables, one per NUMA socket with workers (read-only) */
+static struct rte_lpm *g_customer_lpm[RTE_MAX_NUMA_NODES];
 
 /* Worker contexts */
-struct worker_ctx {
-    unsigned int core_id;
-    unsigned int queue_id;
-    uint16_t port_id;
-    struct nat_core_ctx *nat_ctx;
-};
+static struct worker_ctx *g_workers;
 
-static struct worker_ctx g_workers[MAX_CORES];
+/* Inside and outside egress state; next hop MACs are updated by ARP */
+static struct egress_side g_egress[NAT_SIDES];
 
-/* Statistics update thread */
-static volatile bool stats_running = true;
+/* Main lcore poll interval for SIGHUP reloads, ARP requests and HTTP */
+#define CONTROL_POLL_MS  100
 
-static void *
-stats_thread_main(void *arg)
+/* Print per-worker footprint and hugepage usage per NUMA socket */
+static void
+report_memory(void)
 {
-    struct cgnat_global_stats stats;
+    size_t total = 0;
     
-    printf("[STATS] Statistics thread started\n");
+    for (unsigned int i = 0; i < g_config.num_workers; i++)
+        total += nat_core_report_memory(&g_nat_cores[i]);
+    printf("[MEMORY] NAT state: %.1f MiB across %u workers\n",
+           (double)total / (1024.0 * 1024.0), g_config.num_workers);
     
-    while (stats_running) {
-        sleep(2);  /* Update every 2 seconds */
+    for (unsigned int i = 0; i < rte_socket_count(); i++) {
+        struct rte_malloc_socket_stats stats;
+        int socket = rte_socket_id_by_idx(i);
         
-        /* Aggregate stats from all cores */
-        telemetry_aggregate_stats(g_nat_cores, g_config.num_workers, &stats);
-        
-        /* Update global stats under lock */
-        pthread_mutex_lock(&g_stats_lock);
-        memcpy(g_global_stats, &stats, sizeof(stats));
-        pthread_mutex_unlock(&g_stats_lock);
+        if (socket < 0 || rte_malloc_get_socket_stats(socket, &stats) < 0)
+            continue;
+        printf("[MEMORY] Socket %d hugepages: %.1f MiB used of %.1f MiB\n",
+               socket, (double)stats.heap_allocsz_bytes / (1024.0 * 1024.0),
+               (double)stats.heap_totalsz_bytes / (1024.0 * 1024.0));
+    }
+}
+
+/* Helper: Whether one port serves both sides */
+static bool
+one_arm(const struct cgnat_config *config)
+{
+    return config->sides[NAT_SIDE_INSIDE].port_id ==
+           config->sides[NAT_SIDE_OUTSIDE].port_id;
+}
+
+/* Helper: Whether the policy needs an ACL stage at all */
+static bool
+acl_configured(const struct cgnat_config *config)
+{
+    return config->num_acl_rules || config->num_acl_block_ports ||
+           config->acl_allow_protocols != ACL_PROTO_ALL;
+}
+
+/* Helper: Whether two configurations list the same customer ranges */
+static bool
+same_customer_ranges(const struct cgnat_config *a, const struct cgnat_config *b)
+{
+    if (a->num_customer_prefixes != b->num_customer_prefixes ||
+        a->num_ip_pools != b->num_ip_pools)
+        return false;
+    
+    for (uint32_t i = 0; i < a->num_customer_prefixes; i++) {
+        const struct customer_prefix *pa = &a->customer_prefixes[i];
+        const struct customer_prefix *pb = &b->customer_prefixes[i];
         
-        /* Log metrics */
-        telemetry_log_metrics(&stats);
+        if (pa->addr != pb->addr || pa->len != pb->len ||
+            pa->ip_pool != pb->ip_pool)
+            return false;
     }
+    return true;
+}
+
+/*
+ * Re-read the configuration file (SIGHUP) and swap the reloadable parts
+ * into the running workers: timeouts, limits, policer, ACL and the public
+ * IP pool. Workers never stop; each swap returns once all of them have
+ * moved to the new generation. Anything sized at startup keeps its
+ * running value.
+ */
+static void
+reload_config(void)
+{
+    struct cgnat_config cfg;
+    struct nat_params *params;
+    struct acl_ruleset *acl = NULL;
     
-    printf("[STATS] Statistics thread stopped\n");
-    return NULL;
+    if (!g_config_file || !g_config.hot_reload) {
+        printf("[CONFIG] SIGHUP ignored: hot_reload is off\n");
+        return;
+    }
+    
+    printf("[CONFIG] SIGHUP: reloading %s\n", g_config_file);
+    if (config_set_defaults(&cfg) < 0)
+        return;
+    if (config_load(g_config_file, &cfg) < 0)
+        goto reject;
+    
+    /* Public IPs name their pool by customer range: the ranges must match */
+    if (!same_customer_ranges(&cfg, &g_config)) {
+        printf("[CONFIG] Customer ranges changed; they need a restart\n");
+        goto reject;
+    }
+    
+    if (memcmp(cfg.sides, g_config.sides, sizeof(cfg.sides)) != 0 ||
+        cfg.num_workers != g_config.num_workers ||
+        cfg.max_sessions != g_config.max_sessions ||
+        cfg.port_block_size != g_config.port_block_size ||
+        cfg.rss.mode != g_config.rss.mode)
+        printf("[CONFIG] Ports, queues, sessions, port allocation and RSS mode "
+               "need a restart; keeping running values\n");
+    
+    /* Settings sized or programmed at startup */
+    memcpy(cfg.sides, g_config.sides, sizeof(cfg.sides));
+    cfg.num_queues = g_config.num_queues;
+    cfg.num_workers = g_config.num_workers;
+    cfg.checksum_offload = g_config.checksum_offload;
+    cfg.rss = g_config.rss;
+    cfg.max_sessions = g_config.max_sessions;
+    cfg.port_block_size = g_config.port_block_size;
+    cfg.port_partition = g_config.port_partition;
+    cfg.telemetry_enabled = g_config.telemetry_enabled;
+    cfg.prometheus_port = g_config.prometheus_port;
+    cfg.api_enabled = g_config.api_enabled;
+    cfg.api_port = g_config.api_port;
+    cfg.event_log_enabled = g_config.event_log_enabled;
+    cfg.event_log_format = g_config.event_log_format;
+    memcpy(cfg.event_log_path, g_config.event_log_path, sizeof(cfg.event_log_path));
+    cfg.event_log_collector_ip = g_config.event_log_collector_ip;
+    cfg.event_log_collector_port = g_config.event_log_collector_port;
+    cfg.event_ring_size = g_config.event_ring_size;
+    cfg.event_rate_limit = g_config.event_rate_limit;
+    
+    if (config_validate(&cfg) < 0)
+        goto reject;
+    
+    params = nat_params_create(&cfg, g_params.active, g_nat_cores,
+                               g_params.generation + 1);
+    if (!params)
+        goto reject;
+    
+    if (acl_configured(&cfg)) {
+        acl = acl_ruleset_from_config(&cfg, rte_socket_id(), ++g_acl.generation);
+        if (!acl) {
+            nat_params_free(params);
+            goto reject;
+        }
+    }
+    
+    /* Return traffic to added addresses must reach the owning cores first */
+    if (g_config.rss.mode == RSS_MODE_FLOW &&
+        params->first_added < params->num_public_ips &&
+        dpdk_port_steer_public_ports(g_config.sides[NAT_SIDE_OUTSIDE].port_id,
+                                     &g_config.port_partition,
+                                     &params->public_ips[params->first_added],
+                                     params->num_public_ips -
+                                     params->first_added) < 0) {
+        acl_ruleset_free(acl);
+        nat_params_free(params);
+        goto reject;
+    }
+    
+    g_params.generation = params->generation;
+    acl_stage_swap(&g_acl, acl, g_rcu);
+    nat_params_swap(&g_params, params, g_rcu);
+    
+    int draining = 0;
+    for (int i = 0; i < params->num_public_ips; i++)
+        draining += params->draining[i];
+    printf("[CONFIG] Generation %u active: %d public IPs (%d new, %d draining), "
+           "ACL %s\n", params->generation, params->num_public_ips - draining,
+           params->num_public_ips - params->first_added, draining,
+           acl ? "on" : "off");
+    
+    stats_collector_set_alert_threshold(cfg.port_alert_threshold);
+    
+    config_free(&g_config);
+    g_config = cfg;
+    return;
+    
+reject:
+    config_free(&cfg);
+    printf("[CONFIG] Reload rejected; generation %u stays active\n",
+           g_params.generation);
 }
 
 static void
@@ -77,12 +235,23 @@ print_usage(const char *prgname)
            "  --huge-dir DIR : Directory for huge pages\n"
            "\n"
            "APP options:\n"
-           "  -p PORTMASK    : Hexadecimal bitmask of ports (e.g., 0x1)\n"
+           "  -C FILE        : Load YAML configuration (options below override it)\n"
+           "  -p PORTMASK    : Ports: one (one-arm) or inside and outside (e.g., 0x3)\n"
            "  -P             : Enable promiscuous mode\n"
            "  -q NQ          : Number of queues per port\n"
+           "  -o             : Enable NIC TX checksum offload\n"
+           "  -b SIZE        : Lease ports to customers in blocks of SIZE\n"
+           "  -m SESSIONS    : Maximum concurrent sessions (split across workers)\n"
+           "  -A             : Count packets and bytes per session\n"
+           "  -l SESSIONS    : Session limit per customer and worker (0 = none)\n"
+           "  -r MBPS        : Rate limit per customer and direction (0 = none)\n"
+           "  -M             : Mark over-rate packets (DSCP LE) instead of dropping\n"
+           "  -i PREFIX      : Public IP pool, e.g. 198.51.100.0/24\n"
+           "  -s             : Symmetric RSS with hash-selected public ports\n"
+           "  -H             : Hand off packets between workers in software\n"
            "\n"
            "Example:\n"
-           "  sudo %s -c 0xff -n 4 -- -p 0x1 -q 8\n"
+           "  sudo %s -c 0xff -n 4 -- -C /etc/dpdk-cgnat/cgnat.yaml\n"
            "\n",
            prgname, prgname);
 }
@@ -92,42 +261,36 @@ parse_args(int argc, char **argv)
 {
     int opt;
     
-    /* Default configuration */
-    g_config.port_id = 0;
-    g_config.num_queues = 4;
-    g_config.num_workers = 4;
+    if (config_set_defaults(&g_config) < 0)
+        return -1;
     
-    /* Public IPs (default TEST-NET-2 range) */
-    g_config.num_public_ips = 10;
-    for (int i = 0; i < 10; i++) {
-        g_config.public_ips[i] = (203 << 24) | (0 << 16) | (113 << 8) | (i + 1);
+    /* The file comes first so that options given with it override it */
+    opterr = 0;
+    while ((opt = getopt(argc, argv, OPTSTRING)) != -1) {
+        if (opt == 'C')
+            g_config_file = optarg;
     }
+    if (g_config_file && config_load(g_config_file, &g_config) < 0)
+        return -1;
+    opterr = 1;
+    optind = 1;
     
-    /* Customer network (10.0.0.0/16) */
-    g_config.customer_subnet = (10 << 24);
-    g_config.customer_netmask = 0xFFFF0000;
-    
-    /* Timeouts */
-    g_config.timeout_tcp_established = TIMEOUT_TCP_ESTABLISHED;
-    g_config.timeout_tcp_syn = TIMEOUT_TCP_SYN;
-    g_config.timeout_tcp_fin = TIMEOUT_TCP_FIN;
-    g_config.timeout_udp = TIMEOUT_UDP;
-    g_config.timeout_icmp = TIMEOUT_ICMP;
-    
-    /* Limits */
-    g_config.max_sessions_per_customer = 100;
-    
-    /* Monitoring */
-    g_config.telemetry_enabled = true;
-    g_config.prometheus_port = 9091;
-    g_config.api_port = 8080;
-    
-    while ((opt = getopt(argc, argv, "p:Pq:")) != -1) {
+    while ((opt = getopt(argc, argv, OPTSTRING)) != -1) {
         switch (opt) {
-        case 'p':
-            /* Port mask (we use first set bit) */
-            g_config.port_id = 0;
+        case 'p': {
+            /* Lowest port is the inside, highest the outside */
+            unsigned long long mask = strtoull(optarg, NULL, 16);
+            unsigned int last;
+            
+            if (mask == 0 || __builtin_popcountll(mask) > NAT_SIDES ||
+                (last = 63 - __builtin_clzll(mask)) >= RTE_MAX_ETHPORTS) {
+                fprintf(stderr, "Error: Port mask must select one or two ports\n");
+                return -1;
+            }
+            g_config.sides[NAT_SIDE_INSIDE].port_id = __builtin_ctzll(mask);
+            g_config.sides[NAT_SIDE_OUTSIDE].port_id = last;
             break;
+        }
         case 'P':
             printf("Promiscuous mode enabled (default)\n");
             break;
@@ -138,25 +301,109 @@ parse_args(int argc, char **argv)
                 fprintf(stderr, "Error: Too many queues (max %d)\n", MAX_CORES);
                 return -1;
             }
+            if ((g_config.num_workers & (g_config.num_workers - 1)) != 0) {
+                fprintf(stderr, "Error: Queue count must be a power of two\n");
+                return -1;
+            }
+            break;
+        case 'o':
+            g_config.checksum_offload = true;
             break;
+        case 's':
+            g_config.rss.mode = RSS_MODE_SYMMETRIC;
+            break;
+        case 'H':
+            g_config.rss.mode = RSS_MODE_SOFTWARE;
+            break;
+        case 'm': {
+            unsigned long long sessions = strtoull(optarg, NULL, 0);
+            if (sessions == 0 || sessions > MAX_SESSIONS_LIMIT) {
+                fprintf(stderr, "Error: Session count must be in [1, %u]\n",
+                        MAX_SESSIONS_LIMIT);
+                return -1;
+            }
+            g_config.max_sessions = sessions;
+            break;
+        }
+        case 'A':
+            g_config.session_accounting = true;
+            break;
+        case 'l':
+            g_config.max_sessions_per_customer = strtoul(optarg, NULL, 0);
+            break;
+        case 'r':
+            g_config.max_bandwidth_mbps = strtoul(optarg, NULL, 0);
+            break;
+        case 'M':
+            g_config.bandwidth_mark = true;
+            break;
+        case 'C':
+            break;
+        case 'i':
+            if (config_set_public_prefix(&g_config, optarg) < 0) {
+                fprintf(stderr, "Error: Invalid public prefix '%s' "
+                        "(expected A.B.C.D/20..32)\n", optarg);
+                return -1;
+            }
+            break;
+        case 'b': {
+            int size = atoi(optarg);
+            if (size < PORT_BLOCK_SIZE_MIN || size > PORT_BLOCK_SIZE_MAX ||
+                (size & (size - 1)) != 0) {
+                fprintf(stderr, "Error: Port block size must be a power of "
+                        "two in [%d, %d]\n", PORT_BLOCK_SIZE_MIN,
+                        PORT_BLOCK_SIZE_MAX);
+                return -1;
+            }
+            g_config.port_block_size = size;
+            break;
+        }
         default:
             print_usage(argv[0]);
             return -1;
         }
     }
     
-    printf("[CONFIG] Port: %u, Queues: %u, Workers: %u\n",
-           g_config.port_id, g_config.num_queues, g_config.num_workers);
+    printf("[CONFIG] Ports: inside %u, outside %u, Queues: %u, Workers: %u\n",
+           g_config.sides[NAT_SIDE_INSIDE].port_id,
+           g_config.sides[NAT_SIDE_OUTSIDE].port_id,
+           g_config.num_queues, g_config.num_workers);
+    if (config_validate(&g_config) < 0)
+        return -1;
+    
+    if (g_config.port_block_size)
+        printf("[CONFIG] Port allocation: blocks of %u ports per customer\n",
+               g_config.port_block_size);
+    else
+        printf("[CONFIG] Port allocation: per session\n");
+    uint32_t last_ip = g_config.public_ips[g_config.num_public_ips - 1];
     printf("[CONFIG] Public IPs: %d (%u.%u.%u.%u - %u.%u.%u.%u)\n",
            g_config.num_public_ips,
            (g_config.public_ips[0] >> 24) & 0xFF,
            (g_config.public_ips[0] >> 16) & 0xFF,
            (g_config.public_ips[0] >> 8) & 0xFF,
            g_config.public_ips[0] & 0xFF,
-           (g_config.public_ips[9] >> 24) & 0xFF,
-           (g_config.public_ips[9] >> 16) & 0xFF,
-           (g_config.public_ips[9] >> 8) & 0xFF,
-           g_config.public_ips[9] & 0xFF);
+           (last_ip >> 24) & 0xFF,
+           (last_ip >> 16) & 0xFF,
+           (last_ip >> 8) & 0xFF,
+           last_ip & 0xFF);
+    printf("[CONFIG] Customer ranges: %u (%u public IP pools)\n",
+           g_config.num_customer_prefixes, g_config.num_ip_pools);
+    printf("[CONFIG] Sessions: %u (%u per worker)\n", g_config.max_sessions,
+           (g_config.max_sessions + g_config.num_workers - 1) /
+           g_config.num_workers);
+    if (g_config.max_sessions_per_customer)
+        printf("[CONFIG] Session limit: %u per customer and worker\n",
+               g_config.max_sessions_per_customer);
+    else
+        printf("[CONFIG] Session limit: none\n");
+    if (g_config.max_bandwidth_mbps)
+        printf("[CONFIG] Rate limit: %u Mbit/s per customer and direction "
+               "(%s when exceeded)\n", g_config.max_bandwidth_mbps,
+               g_config.bandwidth_mark ? "mark" : "drop");
+    if (g_config_file)
+        printf("[CONFIG] Hot reload on SIGHUP: %s\n",
+               g_config.hot_reload ? "enabled" : "disabled");
     
     return 0;
 }
@@ -167,7 +414,6 @@ main(int argc, char **argv)
     int ret;
     unsigned int lcore_id;
     struct rte_mempool *mbuf_pool;
-    pthread_t stats_thread;
     
     printf("╔════════════════════════════════════════════════════════╗\n");
     printf("║   DPDK-Based CGNAT for Production ISPs                ║\n");
@@ -189,6 +435,10 @@ main(int argc, char **argv)
         return -1;
     }
     
+    /* Split every public IP's port range across the workers */
+    port_partition_init(&g_config.port_partition, g_config.port_block_size,
+                        g_config.num_workers);
+    
     /* Check if we have enough cores */
     if (rte_lcore_count() < g_config.num_workers + 1) {
         fprintf(stderr, "Error: Need at least %u cores (%u workers + 1 main)\n",
@@ -202,54 +452,157 @@ main(int argc, char **argv)
         return -1;
     }
     
-    /* Initialize port */
-    ret = dpdk_port_init(g_config.port_id, g_config.num_queues, mbuf_pool);
-    if (ret < 0) {
+    /* Initialize ports (inside first: both share its symmetric RSS setup) */
+    ret = dpdk_port_init(g_config.sides[NAT_SIDE_INSIDE].port_id,
+                         g_config.num_queues, mbuf_pool, &g_config);
+    if (ret == 0 && !one_arm(&g_config))
+        ret = dpdk_port_init(g_config.sides[NAT_SIDE_OUTSIDE].port_id,
+                             g_config.num_queues, mbuf_pool, &g_config);
+    if (ret < 0 || dpdk_egress_init(g_egress, &g_config) < 0) {
         return -1;
     }
     
     /* Initialize per-core NAT contexts */
+    g_nat_cores = rte_zmalloc("nat_cores",
+                              g_config.num_workers * sizeof(struct nat_core_ctx),
+                              RTE_CACHE_LINE_SIZE);
+    g_workers = calloc(g_config.num_workers, sizeof(struct worker_ctx));
+    if (!g_nat_cores || !g_workers) {
+        fprintf(stderr, "Error: Cannot allocate %u worker contexts\n",
+                g_config.num_workers);
+        return -1;
+    }
+    
     unsigned int worker_idx = 0;
     RTE_LCORE_FOREACH_WORKER(lcore_id) {
         if (worker_idx >= g_config.num_workers)
             break;
         
-        ret = nat_core_init(&g_nat_cores[worker_idx], lcore_id, &g_config);
+        ret = nat_core_init(&g_nat_cores[worker_idx], lcore_id, worker_idx,
+                            &g_config);
         if (ret < 0) {
             fprintf(stderr, "Failed to initialize NAT on core %u\n", lcore_id);
             return -1;
         }
         
+        /* Customer prefixes: shared by the workers of a socket */
+        unsigned int socket_id = g_nat_cores[worker_idx].socket_id;
+        if (!g_customer_lpm[socket_id]) {
+            g_customer_lpm[socket_id] = customer_lpm_create(&g_config, socket_id);
+            if (!g_customer_lpm[socket_id])
+                return -1;
+        }
+        g_nat_cores[worker_idx].customer_lpm = g_customer_lpm[socket_id];
+        
         /* Setup worker context */
-        g_workers[worker_idx].core_id = lcore_id;
-        g_workers[worker_idx].queue_id = worker_idx;
-        g_workers[worker_idx].port_id = g_config.port_id;
-        g_workers[worker_idx].nat_ctx = &g_nat_cores[worker_idx];
+        if (dpdk_worker_init(&g_workers[worker_idx], lcore_id, worker_idx,
+                             g_egress, &g_nat_cores[worker_idx]) < 0) {
+            fprintf(stderr, "Failed to allocate TX buffers for core %u\n",
+                    lcore_id);
+            return -1;
+        }
         
-        g_config.worker_cores[worker_idx] = lcore_id;
         worker_idx++;
     }
     
-    /* Start port */
-    ret = dpdk_port_start(g_config.port_id);
+    report_memory();
+    
+    /*
+     * Workers report quiescence so shared state can be swapped under them;
+     * after theirs come the thread slots of the statistics collector and
+     * of the REST API's session reader
+     */
+    size_t rcu_size = rte_rcu_qsbr_get_memsize(g_config.num_workers + 2);
+    g_rcu = rte_zmalloc("dataplane_rcu", rcu_size, RTE_CACHE_LINE_SIZE);
+    if (!g_rcu || rte_rcu_qsbr_init(g_rcu, g_config.num_workers + 2) < 0) {
+        fprintf(stderr, "Error: Cannot set up RCU for %u workers\n",
+                g_config.num_workers);
+        return -1;
+    }
+    
+    /* Timeouts, limits and public IPs; reloads publish later generations */
+    struct nat_params *params = nat_params_create(&g_config, NULL, g_nat_cores,
+                                                  ++g_params.generation);
+    if (!params) {
+        fprintf(stderr, "Error: Cannot build worker parameters\n");
+        return -1;
+    }
+    nat_params_swap(&g_params, params, NULL);
+    
+    /* Outbound ACL; later rule sets are swapped in by acl_stage_swap() */
+    if (acl_configured(&g_config)) {
+        struct acl_ruleset *acl = acl_ruleset_from_config(&g_config,
+                                                          rte_socket_id(),
+                                                          ++g_acl.generation);
+        if (!acl) {
+            fprintf(stderr, "Error: Cannot build ACL rule set\n");
+            return -1;
+        }
+        acl_stage_swap(&g_acl, acl, NULL);
+    }
+    
+    for (unsigned int i = 0; i < g_config.num_workers; i++) {
+        rte_rcu_qsbr_thread_register(g_rcu, i);
+        if (session_table_attach_rcu(&g_nat_cores[i].sessions, g_rcu) < 0) {
+            fprintf(stderr, "Error: Cannot attach RCU to sessions of worker %u\n", i);
+            return -1;
+        }
+        g_nat_cores[i].rcu = g_rcu;
+        g_nat_cores[i].params = &g_params;
+        g_nat_cores[i].acl = &g_acl;
+        if (g_config.event_log_enabled &&
+            nat_event_ring_init(&g_nat_cores[i], g_config.event_ring_size) < 0)
+            return -1;
+    }
+    
+    /* Start ports */
+    ret = dpdk_port_start(g_config.sides[NAT_SIDE_INSIDE].port_id);
+    if (ret == 0 && !one_arm(&g_config))
+        ret = dpdk_port_start(g_config.sides[NAT_SIDE_OUTSIDE].port_id);
     if (ret < 0) {
         return -1;
     }
     
+    /* Return traffic must reach the core owning the public port */
+    if (g_config.rss.mode == RSS_MODE_SYMMETRIC) {
+        if (dpdk_rss_self_test(&g_config, g_nat_cores, g_config.num_workers) < 0)
+            return -1;
+    } else if (g_config.rss.mode == RSS_MODE_FLOW &&
+               dpdk_port_steer_public_ports(
+                   g_config.sides[NAT_SIDE_OUTSIDE].port_id,
+                   &g_config.port_partition, g_config.public_ips,
+                   g_config.num_public_ips) < 0) {
+        fprintf(stderr, "Warning: NIC cannot steer public ports to their "
+                "owning cores; falling back to software handoff\n");
+        g_config.rss.mode = RSS_MODE_SOFTWARE;
+    }
+    
+    /* Software mode forwards every flow; otherwise only what RSS misplaces */
+    if (g_config.num_workers > 1 &&
+        nat_handoff_init(g_nat_cores, g_config.num_workers,
+                         g_config.rss.mode == RSS_MODE_SOFTWARE) < 0)
+        return -1;
+    
     /* Initialize telemetry */
     telemetry_init(&g_config);
     
-    /* Allocate global stats structure */
-    g_global_stats = malloc(sizeof(struct cgnat_global_stats));
-    memset(g_global_stats, 0, sizeof(struct cgnat_global_stats));
+    /* Aggregate published per-core snapshots for the exporters */
+    if (stats_collector_start(g_nat_cores, g_config.num_workers, g_rcu,
+                              g_config.port_alert_threshold) < 0)
+        return -1;
     
-    /* Start Prometheus exporter */
+    /* Prometheus exporter and REST API, served from the control loop */
     if (g_config.telemetry_enabled) {
         telemetry_start_prometheus(g_config.prometheus_port);
     }
+    if (g_config.api_enabled)
+        api_server_start(g_config.api_port, g_nat_cores, g_config.num_workers,
+                         g_rcu, g_config.num_workers + 1);
     
-    /* Start statistics thread */
-    pthread_create(&stats_thread, NULL, stats_thread_main, NULL);
+    /* NAT event log: drains the rings filled by the workers */
+    if (g_config.event_log_enabled &&
+        event_logger_start(g_nat_cores, g_config.num_workers, &g_config) < 0)
+        return -1;
     
     printf("\n╔════════════════════════════════════════════════════════╗\n");
     printf("║              CGNAT System Started                     ║\n");
@@ -257,7 +610,8 @@ main(int argc, char **argv)
     printf("║  Workers:           %2u cores                          ║\n", g_config.num_workers);
     printf("║  Port capacity:     %d ports total                 ║\n", 
            g_config.num_public_ips * PORTS_PER_IP);
-    printf("║  Session capacity:  %d concurrent                  ║\n", MAX_NAT_ENTRIES);
+    printf("║  Session capacity:  %u concurrent                ║\n",
+           g_config.max_sessions);
     printf("║                                                        ║\n");
     printf("║  Prometheus:        http://0.0.0.0:%u/metrics       ║\n", g_config.prometheus_port);
     printf("║                                                        ║\n");
@@ -274,20 +628,51 @@ main(int argc, char **argv)
         worker_idx++;
     }
     
+    /* Control loop on the main lcore: reloads, ARP and HTTP until shutdown */
+    while (!dpdk_quit_requested()) {
+        if (dpdk_reload_requested())
+            reload_config();
+        dpdk_arp_poll(g_egress, mbuf_pool, g_config.num_queues);
+        http_server_poll(CONTROL_POLL_MS);
+    }
+    
     /* Wait for workers to complete */
     rte_eal_mp_wait_lcore();
     
     /* Cleanup */
-    stats_running = false;
-    pthread_join(stats_thread, NULL);
+    http_server_close();
+    stats_collector_stop();
+    event_logger_stop();
     
-    dpdk_port_stop(g_config.port_id);
+    dpdk_port_stop(g_config.sides[NAT_SIDE_INSIDE].port_id);
+    if (!one_arm(&g_config))
+        dpdk_port_stop(g_config.sides[NAT_SIDE_OUTSIDE].port_id);
     
     for (unsigned int i = 0; i < g_config.num_workers; i++) {
+        dpdk_worker_cleanup(&g_workers[i]);
+        nat_event_ring_free(&g_nat_cores[i]);
         nat_core_cleanup(&g_nat_cores[i]);
     }
     
-    free(g_global_stats);
+    /* Rules that matched during this run */
+    if (g_acl.active) {
+        for (uint32_t i = 0; i < g_acl.active->num_rules; i++) {
+            uint64_t hits = acl_ruleset_hits(g_acl.active, i);
+            if (hits)
+                printf("[ACL] Rule %u: %" PRIu64 " hits\n", i, hits);
+        }
+    }
+    
+    /* Workers are stopped: no grace period needed */
+    acl_stage_swap(&g_acl, NULL, NULL);
+    nat_params_swap(&g_params, NULL, NULL);
+    rte_free(g_rcu);
+    
+    for (unsigned int i = 0; i < RTE_MAX_NUMA_NODES; i++)
+        rte_lpm_free(g_customer_lpm[i]);
+    rte_free(g_nat_cores);
+    free(g_workers);
+    config_free(&g_config);
     
     printf("\nCGNAT system shutdown complete\n");
     return 0;
@@ -0,0 +1,324 @@
+/* SPDX-License-Identifier: MIT */
+/**
+ * @file acl.c
+ * @brief Outbound ACL stage on rte_acl
+ *
+ * Rule sets are compiled by the control plane into immutable rte_acl
+ * contexts. Workers classify each burst's outbound flow keys with a single
+ * rte_acl_classify() call, which uses the widest SIMD path the CPU and EAL
+ * allow (AVX2, or AVX-512 with --force-max-simd-bitwidth=512). Swapping a
+ * rule set is one atomic pointer exchange followed by an RCU grace period.
+ */
+
+#include "nat_engine.h"
+#include "cgnat_types.h"
+#include <rte_acl.h>
+#include <rte_byteorder.h>
+#include <rte_malloc.h>
+#include <rte_rcu_qsbr.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum {
+    ACL_FIELD_PROTO,
+    ACL_FIELD_SRC,
+    ACL_FIELD_DST,
+    ACL_FIELD_SPORT,
+    ACL_FIELD_DPORT,
+    ACL_NUM_FIELDS
+};
+
+/*
+ * Network-order tuple handed to rte_acl, built from the already extracted
+ * flow key: IP options, ICMP identifiers and quoted ICMP errors need no
+ * second parse. rte_acl wants a 1-byte first field and 4-byte input groups.
+ */
+struct acl_tuple {
+    uint8_t proto;
+    uint8_t pad[3];
+    uint32_t src_ip;
+    uint32_t dst_ip;
+    uint16_t src_port;
+    uint16_t dst_port;
+};
+
+RTE_ACL_RULE_DEF(acl_ipv4_rule, ACL_NUM_FIELDS);
+
+static const struct rte_acl_field_def acl_fields[ACL_NUM_FIELDS] = {
+    {
+        .type = RTE_ACL_FIELD_TYPE_BITMASK,
+        .size = sizeof(uint8_t),
+        .field_index = ACL_FIELD_PROTO,
+        .input_index = 0,
+        .offset = offsetof(struct acl_tuple, proto),
+    },
+    {
+        .type = RTE_ACL_FIELD_TYPE_MASK,
+        .size = sizeof(uint32_t),
+        .field_index = ACL_FIELD_SRC,
+        .input_index = 1,
+        .offset = offsetof(struct acl_tuple, src_ip),
+    },
+    {
+        .type = RTE_ACL_FIELD_TYPE_MASK,
+        .size = sizeof(uint32_t),
+        .field_index = ACL_FIELD_DST,
+        .input_index = 2,
+        .offset = offsetof(struct acl_tuple, dst_ip),
+    },
+    {
+        .type = RTE_ACL_FIELD_TYPE_RANGE,
+        .size = sizeof(uint16_t),
+        .field_index = ACL_FIELD_SPORT,
+        .input_index = 3,
+        .offset = offsetof(struct acl_tuple, src_port),
+    },
+    {
+        .type = RTE_ACL_FIELD_TYPE_RANGE,
+        .size = sizeof(uint16_t),
+        .field_index = ACL_FIELD_DPORT,
+        .input_index = 3,
+        .offset = offsetof(struct acl_tuple, dst_port),
+    },
+};
+
+/* Helper: Convert a configured rule to rte_acl form (host byte order) */
+static void
+acl_rule_convert(const struct acl_rule_spec *spec, uint32_t idx,
+                 struct acl_ipv4_rule *rule)
+{
+    memset(rule, 0, sizeof(*rule));
+    rule->data.category_mask = 1;
+    rule->data.priority = RTE_ACL_MAX_PRIORITY - idx;  /* First match wins */
+    rule->data.userdata = idx + 1;                    /* 0 means no match */
+
+    rule->field[ACL_FIELD_PROTO].value.u8 = spec->protocol;
+    rule->field[ACL_FIELD_PROTO].mask_range.u8 = spec->protocol ? 0xFF : 0;
+    rule->field[ACL_FIELD_SRC].value.u32 = spec->src_ip;
+    rule->field[ACL_FIELD_SRC].mask_range.u32 = spec->src_len;
+    rule->field[ACL_FIELD_DST].value.u32 = spec->dst_ip;
+    rule->field[ACL_FIELD_DST].mask_range.u32 = spec->dst_len;
+    rule->field[ACL_FIELD_SPORT].value.u16 = spec->src_port_lo;
+    rule->field[ACL_FIELD_SPORT].mask_range.u16 = spec->src_port_hi;
+    rule->field[ACL_FIELD_DPORT].value.u16 = spec->dst_port_lo;
+    rule->field[ACL_FIELD_DPORT].mask_range.u16 = spec->dst_port_hi;
+}
+
+/* Helper: Rule matching any flow, to be narrowed by the caller */
+static struct acl_rule_spec
+acl_rule_any(uint8_t action)
+{
+    struct acl_rule_spec spec = {
+        .action = action,
+        .src_port_hi = UINT16_MAX,
+        .dst_port_hi = UINT16_MAX,
+    };
+
+    return spec;
+}
+
+struct acl_ruleset *
+acl_ruleset_create(const struct acl_rule_spec *rules, uint32_t num_rules,
+                   unsigned int num_workers, int socket_id, uint32_t generation)
+{
+    struct acl_ruleset *rs;
+    char name[RTE_ACL_NAMESIZE];
+
+    if (num_rules == 0 || num_rules > ACL_MAX_RULES) {
+        printf("[ACL] Invalid rule count %u (max %u)\n", num_rules, ACL_MAX_RULES);
+        return NULL;
+    }
+
+    rs = rte_zmalloc_socket("acl_ruleset", sizeof(*rs), RTE_CACHE_LINE_SIZE,
+                            socket_id);
+    if (!rs)
+        return NULL;
+
+    rs->num_rules = num_rules;
+    rs->generation = generation;
+    rs->num_workers = num_workers;
+
+    /* One cache-aligned row of counters per worker, slot 0 unused */
+    rs->hits_stride = RTE_ALIGN(num_rules + 1,
+                                RTE_CACHE_LINE_SIZE / sizeof(uint64_t));
+    rs->hits = rte_zmalloc_socket("acl_hits",
+                                  (size_t)num_workers * rs->hits_stride *
+                                  sizeof(uint64_t),
+                                  RTE_CACHE_LINE_SIZE, socket_id);
+    rs->rules = rte_malloc_socket("acl_rules", num_rules * sizeof(*rules),
+                                  RTE_CACHE_LINE_SIZE, socket_id);
+    if (!rs->hits || !rs->rules)
+        goto fail;
+    memcpy(rs->rules, rules, num_rules * sizeof(*rules));
+
+    snprintf(name, sizeof(name), "acl_gen%u", generation);
+    struct rte_acl_param param = {
+        .name = name,
+        .socket_id = socket_id,
+        .rule_size = RTE_ACL_RULE_SZ(ACL_NUM_FIELDS),
+        .max_rule_num = num_rules,
+    };
+    rs->acx = rte_acl_create(&param);
+    if (!rs->acx) {
+        printf("[ACL] Failed to create context %s\n", name);
+        goto fail;
+    }
+
+    for (uint32_t i = 0; i < num_rules; i++) {
+        struct acl_ipv4_rule rule;
+
+        acl_rule_convert(&rules[i], i, &rule);
+        if (rte_acl_add_rules(rs->acx, (const struct rte_acl_rule *)&rule, 1) < 0) {
+            printf("[ACL] Failed to add rule %u\n", i);
+            goto fail;
+        }
+    }
+
+    struct rte_acl_config cfg = {
+        .num_categories = 1,
+        .num_fields = ACL_NUM_FIELDS,
+    };
+    memcpy(cfg.defs, acl_fields, sizeof(acl_fields));
+    if (rte_acl_build(rs->acx, &cfg) < 0) {
+        printf("[ACL] Failed to build %u rules\n", num_rules);
+        goto fail;
+    }
+
+    printf("[ACL] Built rule set generation %u (%u rules)\n",
+           generation, num_rules);
+    return rs;
+
+fail:
+    acl_ruleset_free(rs);
+    return NULL;
+}
+
+struct acl_ruleset *
+acl_ruleset_from_config(const struct cgnat_config *config, int socket_id,
+                        uint32_t generation)
+{
+    uint32_t max = config->num_acl_rules + 2 * config->num_acl_block_ports + 3;
+    struct acl_rule_spec *rules = calloc(max, sizeof(*rules));
+    struct acl_ruleset *rs = NULL;
+    uint32_t n = 0;
+
+    if (!rules)
+        return NULL;
+
+    /* Explicit prefix/port/protocol rules take precedence */
+    if (config->num_acl_rules > 0)
+        memcpy(rules, config->acl_rules, config->num_acl_rules * sizeof(*rules));
+    n = config->num_acl_rules;
+
+    /* Block list: destination port over TCP and UDP */
+    for (uint32_t i = 0; i < config->num_acl_block_ports; i++) {
+        uint16_t port = config->acl_block_ports[i];
+
+        rules[n] = acl_rule_any(ACL_ACTION_DENY);
+        rules[n].protocol = PROTO_TCP;
+        rules[n].dst_port_lo = port;
+        rules[n].dst_port_hi = port;
+        n++;
+        rules[n] = rules[n - 1];
+        rules[n].protocol = PROTO_UDP;
+        n++;
+    }
+
+    /* Only TCP, UDP and ICMP are translated; deny whichever is not allowed */
+    static const struct { uint8_t bit, proto; } protos[] = {
+        { ACL_PROTO_TCP, PROTO_TCP },
+        { ACL_PROTO_UDP, PROTO_UDP },
+        { ACL_PROTO_ICMP, PROTO_ICMP },
+    };
+    for (unsigned int i = 0; i < RTE_DIM(protos); i++) {
+        if (config->acl_allow_protocols & protos[i].bit)
+            continue;
+        rules[n] = acl_rule_any(ACL_ACTION_DENY);
+        rules[n].protocol = protos[i].proto;
+        n++;
+    }
+
+    if (n > 0)
+        rs = acl_ruleset_create(rules, n, config->num_workers, socket_id,
+                                generation);
+    free(rules);
+    return rs;
+}
+
+void
+acl_ruleset_free(struct acl_ruleset *rs)
+{
+    if (!rs)
+        return;
+
+    if (rs->acx)
+        rte_acl_free(rs->acx);
+    rte_free(rs->rules);
+    rte_free(rs->hits);
+    rte_free(rs);
+}
+
+uint64_t
+acl_ruleset_hits(const struct acl_ruleset *rs, uint32_t rule)
+{
+    uint64_t total = 0;
+
+    for (unsigned int w = 0; w < rs->num_workers; w++)
+        total += rs->hits[w * rs->hits_stride + rule + 1];
+    return total;
+}
+
+void
+acl_stage_swap(struct acl_stage *stage, struct acl_ruleset *rs,
+               struct rte_rcu_qsbr *rcu)
+{
+    struct acl_ruleset *old;
+
+    old = __atomic_exchange_n(&stage->active, rs, __ATOMIC_ACQ_REL);
+    if (!old)
+        return;
+
+    /* Every worker has passed a quiescent point once this returns */
+    if (rcu)
+        rte_rcu_qsbr_synchronize(rcu, RTE_QSBR_THRID_INVALID);
+    acl_ruleset_free(old);
+}
+
+uint64_t
+acl_classify_burst(const struct acl_ruleset *rs, unsigned int worker_id,
+                   const void **keys, uint32_t nb_keys)
+{
+    struct acl_tuple tuples[RX_BURST_SIZE];
+    const uint8_t *data[RX_BURST_SIZE];
+    uint32_t results[RX_BURST_SIZE];
+    uint64_t *hits = &rs->hits[worker_id * rs->hits_stride];
+    uint64_t deny = 0;
+
+    for (uint32_t i = 0; i < nb_keys; i++) {
+        const struct flow_key *key = keys[i];
+        struct acl_tuple *t = &tuples[i];
+
+        t->proto = key->protocol;
+        t->src_ip = rte_cpu_to_be_32(key->src_ip);
+        t->dst_ip = rte_cpu_to_be_32(key->dst_ip);
+        t->src_port = rte_cpu_to_be_16(key->src_port);
+        t->dst_port = rte_cpu_to_be_16(key->dst_port);
+        data[i] = (const uint8_t *)t;
+    }
+
+    rte_acl_classify(rs->acx, data, results, nb_keys, 1);
+
+    for (uint32_t i = 0; i < nb_keys; i++) {
+        uint32_t rule = results[i];
+
+        if (rule == 0)
+            continue;
+        hits[rule]++;
+        if (rs->rules[rule - 1].action == ACL_ACTION_DENY)
+            deny |= 1ULL << i;
+    }
+
+    return deny;
+}
@@ -0,0 +1,82 @@
+/* SPDX-License-Identifier: MIT */
+/**
+ * @file customers.c
+ * @brief Customer prefix classification and per-prefix public IP pools
+ *
+ * Customer prefixes live in one rte_lpm per NUMA socket whose next hop is
+ * the prefix index, so a single bulk lookup per burst both classifies the
+ * direction of every packet and finds the prefix that selects the public
+ * IP pool and the subscriber record. Workers keep their public IPs sorted
+ * by pool, rebuilt whenever a reload changes the layout.
+ */
+
+#include "nat_engine.h"
+#include "cgnat_types.h"
+#include <rte_lpm.h>
+#include <stdio.h>
+#include <string.h>
+
+struct rte_lpm *
+customer_lpm_create(const struct cgnat_config *config, int socket_id)
+{
+    char name[RTE_LPM_NAMESIZE];
+    struct rte_lpm *lpm;
+
+    /* Prefixes longer than /24 take one tbl8 group each */
+    struct rte_lpm_config cfg = {
+        .max_rules = config->num_customer_prefixes,
+        .number_tbl8s = MAX_CUSTOMER_PREFIXES,
+    };
+
+    snprintf(name, sizeof(name), "customers_%d", socket_id);
+    lpm = rte_lpm_create(name, socket_id, &cfg);
+    if (!lpm) {
+        printf("[LPM] Failed to create customer table on socket %d\n", socket_id);
+        return NULL;
+    }
+
+    for (uint32_t i = 0; i < config->num_customer_prefixes; i++) {
+        const struct customer_prefix *cp = &config->customer_prefixes[i];
+
+        if (rte_lpm_add(lpm, cp->addr, cp->len, i) < 0) {
+            printf("[LPM] Failed to add customer range %u.%u.%u.%u/%u\n",
+                   (cp->addr >> 24) & 0xFF, (cp->addr >> 16) & 0xFF,
+                   (cp->addr >> 8) & 0xFF, cp->addr & 0xFF, cp->len);
+            rte_lpm_free(lpm);
+            return NULL;
+        }
+    }
+
+    printf("[LPM] %u customer ranges on socket %d (%u public IP pools)\n",
+           config->num_customer_prefixes, socket_id, config->num_ip_pools);
+    return lpm;
+}
+
+void
+nat_ip_pools_build(struct nat_core_ctx *ctx)
+{
+    uint16_t *start = ctx->ip_pool_start;
+
+    memset(start, 0, (ctx->num_ip_pools + 1) * sizeof(*start));
+
+    /* Counting sort by IP pool; draining addresses serve nobody */
+    for (int i = 0; i < ctx->num_public_ips; i++) {
+        const struct port_pool *pool = ctx->port_pools[i];
+
+        if (!pool->draining && pool->ip_pool < ctx->num_ip_pools)
+            start[pool->ip_pool + 1]++;
+    }
+    for (uint16_t p = 0; p < ctx->num_ip_pools; p++)
+        start[p + 1] += start[p];
+
+    /* Filling advances each start to the next pool's; shift them back */
+    for (int i = 0; i < ctx->num_public_ips; i++) {
+        const struct port_pool *pool = ctx->port_pools[i];
+
+        if (!pool->draining && pool->ip_pool < ctx->num_ip_pools)
+            ctx->ip_pool_order[start[pool->ip_pool]++] = i;
+    }
+    for (uint16_t p = ctx->num_ip_pools; p > 0; p--)
+        start[p] = start[p - 1];
+    start[0] = 0;
+}
@@ -6,158 +6,1464 @@
 
 #include "nat_engine.h"
 #include "cgnat_types.h"
+#include "logger.h"
 #include <rte_hash.h>
-#include <rte_jhash.h>
-#include <rte_mempool.h>
+#include <rte_lpm.h>
+#include <rte_malloc.h>
+#include <rte_ring.h>
+#include <rte_lcore.h>
+#include <rte_thash.h>
 #include <rte_cycles.h>
+#include <rte_prefetch.h>
+#include <rte_debug.h>
 #include <rte_ip.h>
 #include <rte_tcp.h>
 #include <rte_udp.h>
+#include <rte_icmp.h>
+#include <rte_mbuf.h>
 #include <string.h>
 #include <stdio.h>
+#include <stddef.h>
 
-/* Helper: Update IP checksum after modification */
+/* extract_flow_key results besides 0 (plain packet) and -1 (unsupported) */
+#define FLOW_KEY_ICMP_ERROR  1  /* Key is the session the ICMP error quotes */
+#define FLOW_KEY_FRAGMENT    2  /* Later fragment: no ports, use frag cache */
+
+/* Customer prefix index in an rte_lpm next hop */
+#define CUSTOMER_HOP_MASK    0x00FFFFFF
+
+/* Helper: Fold 32-bit one's complement sum to 16 bits */
+static inline uint16_t
+cksum_fold(uint32_t sum)
+{
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    return (uint16_t)sum;
+}
+
+/*
+ * Helper: Patch checksum for a replaced 32-bit field (RFC 1624, eqn. 3)
+ * HC' = ~(~HC + ~m + m'). Operates on raw network-order values: the one's
+ * complement sum is invariant under byte swapping.
+ */
+static inline uint16_t
+cksum_adjust32(uint16_t cksum, uint32_t old_val, uint32_t new_val)
+{
+    uint32_t sum = (uint16_t)~cksum;
+    
+    sum += (uint16_t)~old_val + (uint16_t)~(old_val >> 16);
+    sum += (new_val & 0xFFFF) + (new_val >> 16);
+    return (uint16_t)~cksum_fold(sum);
+}
+
+/* Helper: Patch checksum for a replaced 16-bit field (RFC 1624, eqn. 3) */
+static inline uint16_t
+cksum_adjust16(uint16_t cksum, uint16_t old_val, uint16_t new_val)
+{
+    uint32_t sum = (uint16_t)~cksum;
+    
+    sum += (uint16_t)~old_val;
+    sum += new_val;
+    return (uint16_t)~cksum_fold(sum);
+}
+
+/*
+ * Helper: Replace the identifier of an ICMP echo message
+ * The ICMP checksum has no pseudo-header, so only the identifier is patched,
+ * in software even in offload mode.
+ */
+static inline void
+rewrite_icmp_ident(struct rte_ipv4_hdr *ip, uint8_t ihl, uint16_t new_id)
+{
+    struct rte_icmp_hdr *icmp = (struct rte_icmp_hdr *)((uint8_t *)ip + ihl);
+    uint16_t old_id = icmp->icmp_ident;
+    
+    icmp->icmp_ident = new_id;
+    icmp->icmp_cksum = cksum_adjust16(icmp->icmp_cksum, old_id, new_id);
+}
+
+/*
+ * Helper: Replace source or destination address/port and fix checksums
+ * Software mode patches IP and L4 checksums incrementally; offload mode
+ * leaves the IP checksum to the NIC and seeds the L4 checksum with the
+ * pseudo-header sum. Either way the cost does not depend on packet length.
+ * For ICMP echo the port is the identifier; any other proto leaves L4 alone.
+ * new_addr and new_port are in network byte order. The mbuf's port becomes
+ * the egress side: a rewritten source leaves towards the Internet.
+ */
+static inline void
+rewrite_addr_port(struct rte_mbuf *m, struct rte_ipv4_hdr *ip, uint8_t proto,
+                  bool is_src, uint32_t new_addr, uint16_t new_port,
+                  bool offload)
+{
+    uint8_t ihl = (ip->version_ihl & 0x0F) * 4;
+    uint32_t *addr = is_src ? &ip->src_addr : &ip->dst_addr;
+    uint32_t old_addr = *addr;
+    
+    *addr = new_addr;
+    m->port = is_src ? NAT_SIDE_OUTSIDE : NAT_SIDE_INSIDE;
+    
+    if (offload) {
+        m->l2_len = sizeof(struct rte_ether_hdr);
+        m->l3_len = ihl;
+        m->ol_flags |= RTE_MBUF_F_TX_IPV4 | RTE_MBUF_F_TX_IP_CKSUM;
+        ip->hdr_checksum = 0;
+        
+        if (proto == PROTO_TCP) {
+            struct rte_tcp_hdr *tcp = (struct rte_tcp_hdr *)((uint8_t *)ip + ihl);
+            if (is_src)
+                tcp->src_port = new_port;
+            else
+                tcp->dst_port = new_port;
+            m->ol_flags |= RTE_MBUF_F_TX_TCP_CKSUM;
+            tcp->cksum = rte_ipv4_phdr_cksum(ip, m->ol_flags);
+        } else if (proto == PROTO_UDP) {
+            struct rte_udp_hdr *udp = (struct rte_udp_hdr *)((uint8_t *)ip + ihl);
+            if (is_src)
+                udp->src_port = new_port;
+            else
+                udp->dst_port = new_port;
+            /* Zero checksum means "none" - keep it that way */
+            if (udp->dgram_cksum != 0) {
+                m->ol_flags |= RTE_MBUF_F_TX_UDP_CKSUM;
+                udp->dgram_cksum = rte_ipv4_phdr_cksum(ip, m->ol_flags);
+            }
+        } else if (proto == PROTO_ICMP) {
+            rewrite_icmp_ident(ip, ihl, new_port);
+        }
+        return;
+    }
+    
+    ip->hdr_checksum = cksum_adjust32(ip->hdr_checksum, old_addr, new_addr);
+    
+    if (proto == PROTO_TCP) {
+        struct rte_tcp_hdr *tcp = (struct rte_tcp_hdr *)((uint8_t *)ip + ihl);
+        uint16_t *port = is_src ? &tcp->src_port : &tcp->dst_port;
+        uint16_t old_port = *port;
+        
+        *port = new_port;
+        tcp->cksum = cksum_adjust16(cksum_adjust32(tcp->cksum, old_addr, new_addr),
+                                    old_port, new_port);
+    } else if (proto == PROTO_UDP) {
+        struct rte_udp_hdr *udp = (struct rte_udp_hdr *)((uint8_t *)ip + ihl);
+        uint16_t *port = is_src ? &udp->src_port : &udp->dst_port;
+        uint16_t old_port = *port;
+        
+        *port = new_port;
+        
+        /* Zero checksum means "none" - keep it that way */
+        if (udp->dgram_cksum != 0) {
+            uint16_t cksum = cksum_adjust16(cksum_adjust32(udp->dgram_cksum,
+                                                           old_addr, new_addr),
+                                            old_port, new_port);
+            /* A computed zero is transmitted as all ones (RFC 768) */
+            udp->dgram_cksum = (cksum == 0) ? 0xFFFF : cksum;
+        }
+    } else if (proto == PROTO_ICMP) {
+        rewrite_icmp_ident(ip, ihl, new_port);
+    }
+}
+
+/* Helper: Fragment other than the first, carrying no L4 header */
+static inline bool
+ipv4_later_fragment(const struct rte_ipv4_hdr *ip)
+{
+    return (ip->fragment_offset & rte_cpu_to_be_16(RTE_IPV4_HDR_OFFSET_MASK)) != 0;
+}
+
+/* Helper: First fragment of a fragmented datagram */
+static inline bool
+ipv4_first_fragment(const struct rte_ipv4_hdr *ip)
+{
+    return (ip->fragment_offset &
+            rte_cpu_to_be_16(RTE_IPV4_HDR_MF_FLAG | RTE_IPV4_HDR_OFFSET_MASK)) ==
+           rte_cpu_to_be_16(RTE_IPV4_HDR_MF_FLAG);
+}
+
+/*
+ * Helper: Derive the session key of the packet quoted by an ICMP error
+ * The quoted packet travelled the opposite way, so its tuple is swapped
+ * into the key the session is stored under in that direction's table.
+ */
+static int
+extract_icmp_error_key(const struct rte_mbuf *m, const struct rte_ipv4_hdr *ip,
+                       struct flow_key *key)
+{
+    uint8_t ihl = (ip->version_ihl & 0x0F) * 4;
+    const struct rte_ipv4_hdr *inner = (const struct rte_ipv4_hdr *)
+        ((const uint8_t *)ip + ihl + sizeof(struct rte_icmp_hdr));
+    uint32_t offset = (const uint8_t *)inner - rte_pktmbuf_mtod(m, const uint8_t *);
+    
+    if (rte_pktmbuf_data_len(m) < offset + sizeof(*inner))
+        return -1;
+    
+    uint8_t inner_ihl = (inner->version_ihl & 0x0F) * 4;
+    if (inner_ihl < sizeof(*inner) ||
+        rte_pktmbuf_data_len(m) < offset + inner_ihl + ICMP_ERROR_QUOTE_MIN)
+        return -1;
+    
+    /* Only a first fragment quotes the L4 header */
+    if (inner->fragment_offset & rte_cpu_to_be_16(RTE_IPV4_HDR_OFFSET_MASK))
+        return -1;
+    
+    const uint8_t *l4 = (const uint8_t *)inner + inner_ihl;
+    
+    key->src_ip = rte_be_to_cpu_32(inner->dst_addr);
+    key->dst_ip = rte_be_to_cpu_32(inner->src_addr);
+    key->protocol = inner->next_proto_id;
+    
+    if (inner->next_proto_id == PROTO_TCP || inner->next_proto_id == PROTO_UDP) {
+        /* Both headers start with source and destination port */
+        const uint16_t *ports = (const uint16_t *)l4;
+        key->src_port = rte_be_to_cpu_16(ports[1]);
+        key->dst_port = rte_be_to_cpu_16(ports[0]);
+    } else if (inner->next_proto_id == PROTO_ICMP) {
+        const struct rte_icmp_hdr *icmp = (const struct rte_icmp_hdr *)l4;
+        uint16_t id = rte_be_to_cpu_16(icmp->icmp_ident);
+        
+        if (icmp->icmp_type == ICMP_ECHO_REQUEST) {
+            key->src_port = 0;
+            key->dst_port = id;
+        } else if (icmp->icmp_type == ICMP_ECHO_REPLY) {
+            key->src_port = id;
+            key->dst_port = 0;
+        } else {
+            return -1;  /* Errors about errors are never translated */
+        }
+    } else {
+        return -1;
+    }
+    
+    return FLOW_KEY_ICMP_ERROR;
+}
+
+/*
+ * Helper: Extract flow key from packet
+ * ICMP echo uses its identifier as the port: the source port of a request,
+ * the destination port of a reply. ICMP errors yield the key of the session
+ * they quote and return FLOW_KEY_ICMP_ERROR. Later fragments have no ports
+ * at all and return FLOW_KEY_FRAGMENT with the ports zeroed.
+ */
+static inline int
+extract_flow_key(struct rte_mbuf *m, struct flow_key *key)
+{
+    struct rte_ether_hdr *eth = rte_pktmbuf_mtod(m, struct rte_ether_hdr *);
+    
+    /* Only handle IPv4 */
+    if (eth->ether_type != rte_cpu_to_be_16(RTE_ETHER_TYPE_IPV4))
+        return -1;
+    
+    struct rte_ipv4_hdr *ip = (struct rte_ipv4_hdr *)(eth + 1);
+    
+    key->src_ip = rte_be_to_cpu_32(ip->src_addr);
+    key->dst_ip = rte_be_to_cpu_32(ip->dst_addr);
+    key->protocol = ip->next_proto_id;
+    memset(key->reserved, 0, sizeof(key->reserved));
+    
+    if (unlikely(ipv4_later_fragment(ip))) {
+        if (ip->next_proto_id != PROTO_TCP && ip->next_proto_id != PROTO_UDP &&
+            ip->next_proto_id != PROTO_ICMP)
+            return -1;
+        key->src_port = 0;
+        key->dst_port = 0;
+        return FLOW_KEY_FRAGMENT;
+    }
+    
+    if (ip->next_proto_id == PROTO_TCP) {
+        struct rte_tcp_hdr *tcp = (struct rte_tcp_hdr *)
+            ((uint8_t *)ip + (ip->version_ihl & 0x0F) * 4);
+        key->src_port = rte_be_to_cpu_16(tcp->src_port);
+        key->dst_port = rte_be_to_cpu_16(tcp->dst_port);
+    } else if (ip->next_proto_id == PROTO_UDP) {
+        struct rte_udp_hdr *udp = (struct rte_udp_hdr *)
+            ((uint8_t *)ip + (ip->version_ihl & 0x0F) * 4);
+        key->src_port = rte_be_to_cpu_16(udp->src_port);
+        key->dst_port = rte_be_to_cpu_16(udp->dst_port);
+    } else if (ip->next_proto_id == PROTO_ICMP) {
+        struct rte_icmp_hdr *icmp = (struct rte_icmp_hdr *)
+            ((uint8_t *)ip + (ip->version_ihl & 0x0F) * 4);
+        
+        switch (icmp->icmp_type) {
+        case ICMP_ECHO_REQUEST:
+            key->src_port = rte_be_to_cpu_16(icmp->icmp_ident);
+            key->dst_port = 0;
+            break;
+        case ICMP_ECHO_REPLY:
+            key->src_port = 0;
+            key->dst_port = rte_be_to_cpu_16(icmp->icmp_ident);
+            break;
+        case ICMP_DEST_UNREACH:
+        case ICMP_TIME_EXCEEDED:
+        case ICMP_PARAM_PROBLEM:
+            return extract_icmp_error_key(m, ip, key);
+        default:
+            return -1;  /* Other ICMP messages have no session */
+        }
+    } else {
+        return -1;  /* Unsupported protocol */
+    }
+    
+    return 0;
+}
+
+/* Helper: Build outbound (private side) key for a session */
+static inline void
+build_outbound_key(const struct nat_entry *entry, struct flow_key *key)
+{
+    memset(key, 0, sizeof(*key));
+    key->src_ip = entry->private_ip;
+    key->dst_ip = entry->remote_ip;
+    key->src_port = entry->private_port;
+    key->dst_port = entry->remote_port;
+    key->protocol = entry->protocol;
+}
+
+/* Helper: Build inbound (public side) key for a session */
+static inline void
+build_inbound_key(const struct nat_core_ctx *ctx, const struct nat_entry *entry,
+                  struct flow_key *key)
+{
+    memset(key, 0, sizeof(*key));
+    key->src_ip = entry->remote_ip;
+    key->dst_ip = ctx->public_ips[entry->pool_idx];
+    key->src_port = entry->remote_port;
+    key->dst_port = entry->public_port;
+    key->protocol = entry->protocol;
+}
+
+/* Helper: Sample the TSC and the coarse session clock for this burst */
+static inline void
+clock_update(struct nat_core_ctx *ctx, uint64_t now_tsc)
+{
+    ctx->now_tsc = now_tsc;
+    ctx->now = (uint32_t)(now_tsc >> ctx->clock_shift);
+}
+
+/* Helper: Customer prefix of an address, -1 if it is not a customer */
+static inline int
+customer_of(const struct nat_core_ctx *ctx, uint32_t ip)
+{
+    uint32_t hop;
+    
+    if (rte_lpm_lookup(ctx->customer_lpm, ip, &hop) != 0)
+        return -1;
+    return (int)hop;
+}
+
+/* Helper: Subscriber index of an address in customer prefix cust */
+static inline uint32_t
+subscriber_index(const struct nat_core_ctx *ctx, uint32_t private_ip, int cust)
+{
+    const struct customer_prefix *cp = &ctx->customers[cust];
+    
+    return cp->sub_base + (private_ip - cp->addr);
+}
+
+/* Helper: Subscriber record of an address in customer prefix cust */
+static inline struct subscriber *
+subscriber_at(struct nat_core_ctx *ctx, uint32_t private_ip, int cust)
+{
+    return &ctx->subscribers[subscriber_index(ctx, private_ip, cust)];
+}
+
+/* Helper: Subscriber record of a customer address (one LPM lookup) */
+static inline struct subscriber *
+subscriber_of(struct nat_core_ctx *ctx, uint32_t private_ip)
+{
+    return subscriber_at(ctx, private_ip, customer_of(ctx, private_ip));
+}
+
+/* Helper: Subscriber record of a session, from its stored prefix */
+static inline struct subscriber *
+session_subscriber(struct nat_core_ctx *ctx, const struct nat_entry *entry)
+{
+    return subscriber_at(ctx, entry->private_ip, entry->customer);
+}
+
+/* Helper: Set the DSCP of an over-rate packet to Lower Effort */
+static inline void
+policer_mark(struct rte_ipv4_hdr *ip)
+{
+    uint16_t old_word, new_word;
+    
+    /* TOS shares its checksum word with version_ihl */
+    memcpy(&old_word, ip, sizeof(old_word));
+    ip->type_of_service = (POLICER_DSCP_MARK << 2) | (ip->type_of_service & 0x03);
+    memcpy(&new_word, ip, sizeof(new_word));
+    ip->hdr_checksum = cksum_adjust16(ip->hdr_checksum, old_word, new_word);
+}
+
+/*
+ * Helper: Charge a packet to its subscriber's token bucket
+ * Buckets refill lazily from the session clock delta, both directions at
+ * once so they can share one timestamp. Returns false if the packet must
+ * be dropped; over-rate packets are marked instead when so configured.
+ */
+static inline bool
+policer_admit(struct nat_core_ctx *ctx, struct subscriber *sub,
+              struct rte_mbuf *m, bool outbound)
+{
+    uint32_t *tokens = &sub->tokens[outbound ? 0 : 1];
+    uint32_t elapsed = ctx->now - sub->refilled;
+    
+    if (elapsed != 0) {
+        uint64_t credit = (uint64_t)elapsed * ctx->policer_rate;
+        
+        for (int dir = 0; dir < 2; dir++)
+            sub->tokens[dir] = RTE_MIN(sub->tokens[dir] + credit,
+                                       (uint64_t)ctx->policer_depth);
+        sub->refilled = ctx->now;
+    }
+    
+    if (likely(*tokens >= m->pkt_len)) {
+        *tokens -= m->pkt_len;
+        return true;
+    }
+    
+    if (ctx->policer_mark) {
+        struct rte_ether_hdr *eth = rte_pktmbuf_mtod(m, struct rte_ether_hdr *);
+        policer_mark((struct rte_ipv4_hdr *)(eth + 1));
+        ctx->stats.policer_marked++;
+        return true;
+    }
+    
+    ctx->stats.policer_dropped++;
+    return false;
+}
+
+/* Helper: XOR of the two 16-bit halves of an address (symmetric RSS) */
+static inline uint16_t
+rss_fold(uint32_t ip)
+{
+    return (uint16_t)((ip >> 16) ^ ip);
+}
+
+uint16_t
+nat_rss_port_candidate(const struct nat_core_ctx *ctx, const struct flow_key *key,
+                       uint32_t public_ip, uint32_t n)
+{
+    /*
+     * The inbound tuple (remote, public_ip, remote_port, port) hashes to
+     * T(base ^ port). Picking port = base ^ x with T(x) landing on this
+     * worker's queue makes the whole tuple land there too.
+     */
+    uint16_t base = rss_fold(key->dst_ip) ^ key->dst_port ^ rss_fold(public_ip);
+    
+    return base ^ ctx->rss_ports[n % ctx->num_rss_ports];
+}
+
+uint16_t
+nat_icmp_ident_candidate(const struct nat_core_ctx *ctx, uint32_t n)
+{
+    const struct port_partition *part = &ctx->port_partition;
+    uint32_t low = n & ((1U << part->shift) - 1);
+    uint32_t high = n >> part->shift;
+    
+    /* Slice index worker_id of every run of num_slices slices */
+    return (uint16_t)((high << (part->shift + __builtin_ctz(part->num_slices))) |
+                      (ctx->worker_id << part->shift) | low);
+}
+
+/* Helper: Allocate an ICMP identifier from this worker's slices (symmetric RSS) */
+static uint16_t
+alloc_slice_port(struct nat_core_ctx *ctx, const uint16_t *ips, int num_ips,
+                 int *pool_idx)
+{
+    int start = ctx->stats.nat_created % num_ips;
+    
+    for (int i = 0; i < num_ips; i++) {
+        int ip_idx = ips[(start + i) % num_ips];
+        struct port_pool *pool = ctx->port_pools[ip_idx];
+        
+        for (int t = 0; t < RSS_PORT_TRIES; t++) {
+            uint16_t port = nat_icmp_ident_candidate(ctx, ctx->rss_cursor++);
+            if (port >= PORT_RANGE_START && port_pool_claim(pool, port)) {
+                *pool_idx = ip_idx;
+                return port;
+            }
+        }
+        rte_atomic32_inc(&pool->exhaustion_events);
+    }
+    
+    return 0;
+}
+
+/* Helper: Allocate a public port whose return tuple hashes to this worker */
+static uint16_t
+alloc_rss_port(struct nat_core_ctx *ctx, const struct flow_key *key,
+               const uint16_t *ips, int num_ips, int *pool_idx)
+{
+    int start = ctx->stats.nat_created % num_ips;
+    
+    for (int i = 0; i < num_ips; i++) {
+        int ip_idx = ips[(start + i) % num_ips];
+        struct port_pool *pool = ctx->port_pools[ip_idx];
+        
+        for (int t = 0; t < RSS_PORT_TRIES; t++) {
+            uint16_t port = nat_rss_port_candidate(ctx, key, pool->public_ip,
+                                                   ctx->rss_cursor++);
+            if (port >= PORT_RANGE_START && port_pool_claim(pool, port)) {
+                *pool_idx = ip_idx;
+                return port;
+            }
+        }
+        rte_atomic32_inc(&pool->exhaustion_events);
+    }
+    
+    return 0;
+}
+
+/* Helper: Queue a session create or delete for the event log */
+static inline void
+log_session_event(struct nat_core_ctx *ctx, enum nat_event_type type,
+                  const struct nat_entry *entry)
+{
+    struct nat_event *ev = nat_event_alloc(ctx);
+    
+    if (ev == NULL)
+        return;
+    
+    ev->tsc = ctx->now_tsc;
+    ev->private_ip = entry->private_ip;
+    ev->public_ip = ctx->public_ips[entry->pool_idx];
+    ev->remote_ip = entry->remote_ip;
+    ev->private_port = entry->private_port;
+    ev->public_port = entry->public_port;
+    ev->remote_port = entry->remote_port;
+    ev->port_end = entry->public_port;
+    ev->type = type;
+    ev->protocol = entry->protocol;
+    ev->reserved = 0;
+}
+
+/* Helper: Queue a port block lease or release for the event log */
+static void
+log_block_event(struct nat_core_ctx *ctx, enum nat_event_type type,
+                const struct port_pool *pool, uint16_t block)
+{
+    struct nat_event *ev = nat_event_alloc(ctx);
+    uint16_t first = port_block_first(pool, block);
+    
+    if (ev == NULL)
+        return;
+    
+    memset(ev, 0, sizeof(*ev));
+    ev->tsc = ctx->now_tsc;
+    ev->private_ip = pool->blocks[block].owner;
+    ev->public_ip = pool->public_ip;
+    ev->public_port = first;
+    ev->port_end = first + pool->block_size - 1;
+    ev->type = type;
+}
+
+/*
+ * Helper: Allocate a public port for a new session
+ * Only public IPs of the pool serving the customer's prefix are used.
+ * Symmetric RSS mode picks a port by hash. Per-session mode round-robins
+ * across public IPs. Block mode serves the customer's current block and
+ * leases a new one only when it is full, preferring the public IP the
+ * customer already uses.
+ */
+static uint16_t
+alloc_public_port(struct nat_core_ctx *ctx, const struct flow_key *key,
+                  int cust, int *pool_idx)
+{
+    uint32_t private_ip = key->src_ip;
+    uint16_t ip_pool = ctx->customers[cust].ip_pool;
+    const uint16_t *ips = &ctx->ip_pool_order[ctx->ip_pool_start[ip_pool]];
+    int num_ips = ctx->ip_pool_start[ip_pool + 1] - ctx->ip_pool_start[ip_pool];
+    uint16_t port;
+    
+    /* Every address of the pool removed by a reload */
+    if (unlikely(num_ips == 0))
+        return 0;
+    
+    /* Symmetric RSS: ports by return tuple hash, echo identifiers by slice */
+    if (ctx->rss_ports)
+        return key->protocol == PROTO_ICMP ?
+               alloc_slice_port(ctx, ips, num_ips, pool_idx) :
+               alloc_rss_port(ctx, key, ips, num_ips, pool_idx);
+    
+    if (ctx->port_block_size == 0) {
+        int start = ctx->stats.nat_created % num_ips;
+        
+        /* Round-robin start, then the other IPs if it is full */
+        for (int i = 0; i < num_ips; i++) {
+            int ip_idx = ips[(start + i) % num_ips];
+            
+            port = port_pool_alloc(ctx->port_pools[ip_idx]);
+            if (port != 0) {
+                *pool_idx = ip_idx;
+                return port;
+            }
+        }
+        return 0;
+    }
+    
+    uint32_t sub_idx = subscriber_index(ctx, private_ip, cust);
+    struct subscriber *sub = &ctx->subscribers[sub_idx];
+    int start = sub_idx % num_ips;
+    
+    if (sub->block != PORT_BLOCK_NONE) {
+        struct port_pool *pool = ctx->port_pools[sub->pool_idx];
+        
+        /* A draining or reassigned public IP serves no new sessions,
+         * even from its blocks */
+        port = (pool->draining || pool->ip_pool != ip_pool) ? 0 :
+               port_block_alloc(pool, sub->block);
+        if (port != 0) {
+            *pool_idx = sub->pool_idx;
+            return port;
+        }
+        for (int i = 0; i < num_ips; i++) {
+            if (ips[i] == sub->pool_idx) {
+                start = i;
+                break;
+            }
+        }
+    }
+    
+    /* Current block full (or none yet) - lease another */
+    for (int i = 0; i < num_ips; i++) {
+        int ip_idx = ips[(start + i) % num_ips];
+        int block = port_block_lease(ctx->port_pools[ip_idx], private_ip);
+        if (block < 0)
+            continue;
+        
+        ctx->stats.port_blocks_allocated++;
+        log_block_event(ctx, NAT_EVENT_BLOCK_ALLOC, ctx->port_pools[ip_idx], block);
+        sub->block = block;
+        sub->pool_idx = ip_idx;
+        *pool_idx = ip_idx;
+        return port_block_alloc(ctx->port_pools[ip_idx], block);
+    }
+    
+    return 0;
+}
+
+/* Helper: Return a public port; drained blocks go back to the pool */
+static void
+release_public_port(struct nat_core_ctx *ctx, int pool_idx, uint16_t port)
+{
+    struct port_pool *pool = ctx->port_pools[pool_idx];
+    
+    port_pool_free(pool, port);
+    ctx->stats.port_freed++;
+    
+    if (ctx->port_block_size == 0)
+        return;
+    
+    uint16_t block = port_block_index(pool, port);
+    if (pool->blocks[block].in_use != 0)
+        return;
+    
+    struct subscriber *sub = subscriber_of(ctx, pool->blocks[block].owner);
+    if (sub->block == block && sub->pool_idx == pool_idx)
+        sub->block = PORT_BLOCK_NONE;
+    
+    log_block_event(ctx, NAT_EVENT_BLOCK_FREE, pool, block);
+    port_block_release(pool, block);
+    ctx->stats.port_blocks_freed++;
+}
+
+/* Helper: Current deadline of a session in timer wheel ticks */
+static uint64_t
+session_deadline(const struct nat_entry *entry, void *arg)
+{
+    const struct nat_core_ctx *ctx = arg;
+    /* Wrap-safe: sessions never idle anywhere near 2^31 clock units */
+    int32_t age = (int32_t)(ctx->now - entry->last_active);
+    uint64_t last_tsc = ctx->now_tsc;
+    
+    if (age > 0)
+        last_tsc -= (uint64_t)age << ctx->clock_shift;
+    
+    return timer_wheel_tsc_to_tick(&ctx->timers,
+                                   last_tsc + ctx->timeout_cycles[entry->state]);
+}
+
+/* Helper: Release an expired session */
+static void
+session_expire(struct nat_entry *entry, void *arg)
+{
+    struct nat_core_ctx *ctx = arg;
+    struct flow_key key, reverse_key;
+    
+    build_outbound_key(entry, &key);
+    build_inbound_key(ctx, entry, &reverse_key);
+    session_table_remove(&ctx->sessions, &key, &reverse_key);
+    log_session_event(ctx, NAT_EVENT_SESSION_DELETE, entry);
+    
+    release_public_port(ctx, entry->pool_idx, entry->public_port);
+    session_subscriber(ctx, entry)->sessions--;
+    session_table_release(&ctx->sessions,
+                          session_table_index(&ctx->sessions, entry));
+    
+    ctx->stats.nat_expired++;
+}
+
+/* Helper: Collect the 16-bit XOR-offsets whose hash maps to this worker */
+static int
+build_rss_ports(struct nat_core_ctx *ctx, const struct rss_config *rss,
+                char *name, size_t name_len)
+{
+    uint16_t mask = rss->reta_size - 1;
+    uint32_t count = 0;
+    
+    for (int pass = 0; pass < 2; pass++) {
+        for (uint32_t x = 0; x <= UINT16_MAX; x++) {
+            uint32_t tuple[3] = { 0, 0, x };
+            uint32_t hash = rte_softrss(tuple, RTE_DIM(tuple), rss->key);
+            
+            if (rss->reta[hash & mask] != ctx->worker_id)
+                continue;
+            if (pass == 1)
+                ctx->rss_ports[ctx->num_rss_ports++] = x;
+            else
+                count++;
+        }
+        
+        if (pass == 0) {
+            if (count == 0)
+                return -1;
+            snprintf(name, name_len, "rss_ports_%u", ctx->core_id);
+            ctx->rss_ports = rte_malloc_socket(name, count * sizeof(uint16_t),
+                                               RTE_CACHE_LINE_SIZE,
+                                               ctx->socket_id);
+            if (!ctx->rss_ports)
+                return -1;
+        }
+    }
+    
+    return 0;
+}
+
+/* Helper: Copy the customer prefixes and size the per-pool IP lists */
+static int
+init_customers(struct nat_core_ctx *ctx, const struct cgnat_config *config,
+               char *name, size_t name_len)
+{
+    uint32_t sub_base = 0;
+    
+    snprintf(name, name_len, "customers_%u", ctx->core_id);
+    ctx->customers = rte_malloc_socket(name, config->num_customer_prefixes *
+                                       sizeof(struct customer_prefix),
+                                       RTE_CACHE_LINE_SIZE, ctx->socket_id);
+    snprintf(name, name_len, "ip_pools_%u", ctx->core_id);
+    ctx->ip_pool_order = rte_malloc_socket(name, MAX_PUBLIC_IPS * sizeof(uint16_t),
+                                           RTE_CACHE_LINE_SIZE, ctx->socket_id);
+    ctx->ip_pool_start = rte_malloc_socket(name, (config->num_ip_pools + 1) *
+                                           sizeof(uint16_t),
+                                           RTE_CACHE_LINE_SIZE, ctx->socket_id);
+    if (!ctx->customers || !ctx->ip_pool_order || !ctx->ip_pool_start)
+        return -1;
+    
+    /* Subscriber records of all prefixes share one table */
+    for (uint32_t i = 0; i < config->num_customer_prefixes; i++) {
+        ctx->customers[i] = config->customer_prefixes[i];
+        ctx->customers[i].sub_base = sub_base;
+        sub_base += 1U << (32 - ctx->customers[i].len);
+    }
+    ctx->num_customers = config->num_customer_prefixes;
+    ctx->num_subscribers = sub_base;
+    ctx->num_ip_pools = config->num_ip_pools;
+    
+    for (int i = 0; i < ctx->num_public_ips; i++)
+        ctx->port_pools[i]->ip_pool = config->public_ip_pools[i];
+    nat_ip_pools_build(ctx);
+    return 0;
+}
+
+/* Helper: Free the customer prefixes and the per-pool IP lists */
+static void
+free_customers(struct nat_core_ctx *ctx)
+{
+    rte_free(ctx->customers);
+    rte_free(ctx->ip_pool_order);
+    rte_free(ctx->ip_pool_start);
+    ctx->customers = NULL;
+    ctx->ip_pool_order = NULL;
+    ctx->ip_pool_start = NULL;
+}
+
+/* Helper: Free the pool table, its pools and the public IP table */
+static void
+free_port_pools(struct nat_core_ctx *ctx)
+{
+    if (ctx->port_pools) {
+        for (int i = 0; i < ctx->num_public_ips; i++)
+            rte_free(ctx->port_pools[i]);
+        rte_free(ctx->port_pools);
+    }
+    if (ctx->public_ips)
+        rte_free(ctx->public_ips);
+    ctx->port_pools = NULL;
+    ctx->public_ips = NULL;
+    ctx->num_public_ips = 0;
+}
+
+int
+nat_core_init(struct nat_core_ctx *ctx, unsigned int core_id,
+              unsigned int worker_id, const struct cgnat_config *config)
+{
+    char name[64];
+    /* Everything below is touched only by the worker: keep it on its node */
+    unsigned int socket_id = rte_lcore_to_socket_id(core_id);
+    uint32_t capacity = (config->max_sessions + config->num_workers - 1) /
+                        config->num_workers;
+    
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->core_id = core_id;
+    ctx->worker_id = worker_id;
+    ctx->socket_id = socket_id;
+    rte_seqcount_init(&ctx->stats_snapshot.seq);
+    
+    /* Session array and both lookup tables */
+    if (session_table_init(&ctx->sessions, core_id, capacity, socket_id) < 0)
+        return -1;
+    
+    /* Initialize port pools for each public IP (shared range under
+     * symmetric RSS: the hash alone keeps workers' tuples apart) */
+    bool symmetric = (config->rss.mode == RSS_MODE_SYMMETRIC);
+    ctx->port_block_size = config->port_block_size;
+    snprintf(name, sizeof(name), "port_pools_%u", core_id);
+    ctx->port_pools = rte_zmalloc_socket(name,
+                                         config->num_public_ips * sizeof(struct port_pool *),
+                                         RTE_CACHE_LINE_SIZE, socket_id);
+    snprintf(name, sizeof(name), "public_ips_%u", core_id);
+    ctx->public_ips = rte_malloc_socket(name,
+                                        config->num_public_ips * sizeof(uint32_t),
+                                        RTE_CACHE_LINE_SIZE, socket_id);
+    if (!ctx->port_pools || !ctx->public_ips) {
+        printf("Failed to allocate public IP tables on core %u\n", core_id);
+        free_port_pools(ctx);
+        session_table_free(&ctx->sessions);
+        return -1;
+    }
+    for (int i = 0; i < config->num_public_ips; i++) {
+        ctx->public_ips[i] = config->public_ips[i];
+        ctx->port_pools[i] = port_pool_create(config->public_ips[i],
+                                              config->port_block_size,
+                                              symmetric ? NULL :
+                                              &config->port_partition,
+                                              worker_id, socket_id);
+        ctx->num_public_ips = i + 1;
+        if (!ctx->port_pools[i]) {
+            printf("Failed to allocate %d port pools on core %u\n",
+                   config->num_public_ips, core_id);
+            free_port_pools(ctx);
+            session_table_free(&ctx->sessions);
+            return -1;
+        }
+    }
+    
+    /* Customer prefixes and the public IPs serving each of them */
+    if (init_customers(ctx, config, name, sizeof(name)) < 0) {
+        printf("Failed to allocate customer tables on core %u\n", core_id);
+        free_customers(ctx);
+        free_port_pools(ctx);
+        session_table_free(&ctx->sessions);
+        return -1;
+    }
+    
+    /* Per-subscriber state, indexed by address within the customer prefixes */
+    snprintf(name, sizeof(name), "subscribers_%u", core_id);
+    ctx->subscribers = rte_zmalloc_socket(name,
+                                          ctx->num_subscribers * sizeof(struct subscriber),
+                                          RTE_CACHE_LINE_SIZE, socket_id);
+    if (!ctx->subscribers) {
+        printf("Failed to allocate subscriber table on core %u\n", core_id);
+        free_customers(ctx);
+        free_port_pools(ctx);
+        session_table_free(&ctx->sessions);
+        return -1;
+    }
+    for (uint32_t i = 0; i < ctx->num_subscribers; i++)
+        ctx->subscribers[i].block = PORT_BLOCK_NONE;
+    
+    if (symmetric && build_rss_ports(ctx, &config->rss, name, sizeof(name)) < 0) {
+        printf("Failed to build RSS port table on core %u\n", core_id);
+        rte_free(ctx->subscribers);
+        free_customers(ctx);
+        free_port_pools(ctx);
+        session_table_free(&ctx->sessions);
+        return -1;
+    }
+    
+    /* Checksums: NIC offload or incremental updates */
+    ctx->cksum_offload = config->checksum_offload;
+    ctx->session_accounting = config->session_accounting;
+    
+    /* Ownership rules for handoff (rings set up separately) */
+    ctx->num_workers = config->num_workers;
+    ctx->port_partition = config->port_partition;
+    ctx->rss = config->rss.key_len ? &config->rss : NULL;
+    
+    /* Session clock: largest power-of-two TSC divisor at or below the rate */
+    uint64_t hz = rte_get_tsc_hz();
+    ctx->clock_shift = nat_session_clock_shift(hz);
+    clock_update(ctx, rte_rdtsc());
+    
+    /* Timeouts, limits and policer; later generations come from reloads */
+    struct nat_params params = { .generation = 0 };
+    nat_params_derive(&params, config);
+    nat_params_apply(ctx, &params);
+    
+    /* Policer buckets start full */
+    if (ctx->policer_rate != 0) {
+        for (uint32_t i = 0; i < ctx->num_subscribers; i++) {
+            ctx->subscribers[i].tokens[0] = ctx->policer_depth;
+            ctx->subscribers[i].tokens[1] = ctx->policer_depth;
+            ctx->subscribers[i].refilled = ctx->now;
+        }
+    }
+    
+    uint32_t frag_timeout = (uint32_t)(((hz >> ctx->clock_shift) * FRAG_TIMEOUT_MS) / 1000);
+    if (frag_cache_init(&ctx->frags, core_id, socket_id, frag_timeout) < 0) {
+        rte_free(ctx->rss_ports);
+        rte_free(ctx->subscribers);
+        free_customers(ctx);
+        free_port_pools(ctx);
+        session_table_free(&ctx->sessions);
+        return -1;
+    }
+    
+    timer_wheel_init(&ctx->timers, ctx->sessions.entries, hz / TW_TICK_HZ,
+                     ctx->now_tsc);
+    
+    printf("[CORE %u] NAT engine initialized (socket %u, %u sessions, "
+           "%u ports per public IP)\n", core_id, socket_id, capacity,
+           ctx->port_pools[0]->ports_owned);
+    return 0;
+}
+
+void
+nat_core_cleanup(struct nat_core_ctx *ctx)
+{
+    session_table_free(&ctx->sessions);
+    frag_cache_free(&ctx->frags);
+    free_customers(ctx);
+    free_port_pools(ctx);
+    if (ctx->subscribers)
+        rte_free(ctx->subscribers);
+    if (ctx->rss_ports)
+        rte_free(ctx->rss_ports);
+    
+    /* Each ring is freed once, by its producer */
+    if (ctx->handoff_out) {
+        for (unsigned int i = 0; i < ctx->num_workers; i++)
+            rte_ring_free(ctx->handoff_out[i]);
+        rte_free(ctx->handoff_out);
+    }
+    rte_free(ctx->handoff_in);
+    rte_free(ctx->handoff_queues);
+    
+    printf("[CORE %u] NAT engine cleaned up\n", ctx->core_id);
+}
+
+/* Helper: Bytes to MiB for footprint reports */
+static inline double
+to_mib(size_t bytes)
+{
+    return (double)bytes / (1024.0 * 1024.0);
+}
+
+size_t
+nat_core_report_memory(const struct nat_core_ctx *ctx)
+{
+    size_t sessions = session_table_footprint(&ctx->sessions);
+    size_t pools = (size_t)ctx->num_public_ips *
+                   (sizeof(struct port_pool) + sizeof(struct port_pool *) +
+                    sizeof(uint32_t)) +
+                   (MAX_PUBLIC_IPS + ctx->num_ip_pools + 1) * sizeof(uint16_t);
+    size_t subscribers = (size_t)ctx->num_subscribers * sizeof(struct subscriber) +
+                         ctx->num_customers * sizeof(struct customer_prefix);
+    size_t rss = (size_t)ctx->num_rss_ports * sizeof(uint16_t);
+    size_t frags = frag_cache_footprint();
+    size_t total = sizeof(*ctx) + sessions + pools + subscribers + rss + frags;
+    
+    printf("[CORE %u] Memory on socket %u: %.1f MiB (sessions %.1f, "
+           "port pools %.1f, subscribers %.1f, RSS ports %.1f, "
+           "fragments %.1f)\n",
+           ctx->core_id, ctx->socket_id, to_mib(total), to_mib(sessions),
+           to_mib(pools), to_mib(subscribers), to_mib(rss), to_mib(frags));
+    return total;
+}
+
+int
+nat_handoff_init(struct nat_core_ctx *cores, unsigned int num_workers,
+                 bool all_flows)
+{
+    char name[64];
+    
+    /* One row and one column of the matrix per worker, on its own node */
+    for (unsigned int i = 0; i < num_workers; i++) {
+        struct nat_core_ctx *ctx = &cores[i];
+        
+        ctx->handoff_out = rte_zmalloc_socket(NULL,
+                                              num_workers * sizeof(struct rte_ring *),
+                                              RTE_CACHE_LINE_SIZE, ctx->socket_id);
+        ctx->handoff_in = rte_zmalloc_socket(NULL,
+                                             num_workers * sizeof(struct rte_ring *),
+                                             RTE_CACHE_LINE_SIZE, ctx->socket_id);
+        ctx->handoff_queues = rte_zmalloc_socket(NULL,
+                                                 num_workers * sizeof(struct handoff_queue),
+                                                 RTE_CACHE_LINE_SIZE, ctx->socket_id);
+        if (!ctx->handoff_out || !ctx->handoff_in || !ctx->handoff_queues) {
+            printf("Failed to allocate handoff state on core %u\n",
+                   ctx->core_id);
+            return -1;
+        }
+    }
+    
+    for (unsigned int src = 0; src < num_workers; src++) {
+        for (unsigned int dst = 0; dst < num_workers; dst++) {
+            struct rte_ring *ring;
+            
+            if (src == dst)
+                continue;
+            
+            /* Consumer's socket: it touches the ring on every pass */
+            snprintf(name, sizeof(name), "handoff_%u_%u", src, dst);
+            ring = rte_ring_create(name, HANDOFF_RING_SIZE,
+                                   cores[dst].socket_id,
+                                   RING_F_SP_ENQ | RING_F_SC_DEQ);
+            if (!ring) {
+                printf("Failed to create handoff ring %u -> %u\n", src, dst);
+                return -1;
+            }
+            cores[src].handoff_out[dst] = ring;
+            cores[dst].handoff_in[src] = ring;
+        }
+    }
+    
+    for (unsigned int i = 0; i < num_workers; i++)
+        cores[i].handoff_enabled = all_flows;
+    
+    printf("[NAT] %s handoff: %u x %u rings of %u packets\n",
+           all_flows ? "Software" : "ICMP and fragment",
+           num_workers, num_workers - 1, HANDOFF_RING_SIZE);
+    return 0;
+}
+
+/* Helper: Create a session for an outbound flow (customer prefix cust) */
+static struct nat_entry *
+create_session(struct nat_core_ctx *ctx, const struct flow_key *key, int cust)
+{
+    struct session_table *st = &ctx->sessions;
+    struct nat_entry *entry;
+    uint32_t idx;
+    
+    /* An earlier packet of the same burst may have created it already */
+    entry = session_table_lookup(st, st->outbound_hash, key);
+    if (entry != NULL)
+        return entry;
+    
+    /* Only an echo request opens an ICMP mapping, never a stray reply */
+    if (key->protocol == PROTO_ICMP && key->dst_port != 0) {
+        ctx->stats.errors_invalid_packet++;
+        return NULL;
+    }
+    
+    /* One subscriber must not drain a public IP shared by many */
+    struct subscriber *sub = subscriber_at(ctx, key->src_ip, cust);
+    if (ctx->max_sessions_per_subscriber != 0 &&
+        sub->sessions >= ctx->max_sessions_per_subscriber) {
+        ctx->stats.errors_session_limit++;
+        return NULL;
+    }
+    
+    idx = session_table_alloc(st);
+    if (idx == SESSION_INDEX_NONE) {
+        ctx->stats.errors_no_memory++;
+        return NULL;
+    }
+    entry = &st->entries[idx];
+    
+    int ip_idx;
+    uint16_t public_port = alloc_public_port(ctx, key, cust, &ip_idx);
+    if (public_port == 0) {
+        session_table_release(st, idx);
+        ctx->stats.errors_no_ports++;
+        ctx->stats.port_alloc_fail++;
+        return NULL;
+    }
+    ctx->stats.port_alloc_success++;
+    
+    /* Fill NAT entry */
+    entry->private_ip = key->src_ip;
+    entry->private_port = key->src_port;
+    entry->public_port = public_port;
+    entry->remote_ip = key->dst_ip;
+    entry->remote_port = key->dst_port;
+    entry->protocol = key->protocol;
+    entry->pool_idx = ip_idx;
+    entry->customer = cust;
+    if (key->protocol == PROTO_TCP)
+        entry->state = NAT_STATE_SYN_SENT;
+    else if (key->protocol == PROTO_UDP)
+        entry->state = NAT_STATE_UDP_ACTIVE;
+    else
+        entry->state = NAT_STATE_ICMP_ACTIVE;
+    entry->last_active = ctx->now;
+    entry->flags = 0;
+    entry->next = SESSION_INDEX_NONE;
+    
+    memset(&st->stats[idx], 0, sizeof(st->stats[idx]));
+    st->stats[idx].created = ctx->now;
+    
+    /* Add to hash tables */
+    struct flow_key reverse_key;
+    build_inbound_key(ctx, entry, &reverse_key);
+    
+    if (session_table_insert(st, idx, key, &reverse_key) < 0) {
+        release_public_port(ctx, ip_idx, public_port);
+        session_table_release(st, idx);
+        ctx->stats.errors_no_memory++;
+        return NULL;
+    }
+    
+    /* Schedule aging */
+    timer_wheel_add(&ctx->timers, idx, session_deadline(entry, ctx));
+    sub->sessions++;
+    
+    log_session_event(ctx, NAT_EVENT_SESSION_CREATE, entry);
+    ctx->stats.nat_created++;
+    return entry;
+}
+
+/* Helper: Refresh a session and charge a packet to its accounting, if kept */
+static inline void
+session_touch(struct nat_core_ctx *ctx, struct nat_entry *entry,
+              const struct rte_mbuf *m)
+{
+    entry->last_active = ctx->now;
+    if (ctx->session_accounting) {
+        struct nat_entry_stats *stats =
+            &ctx->sessions.stats[session_table_index(&ctx->sessions, entry)];
+        
+        stats->packets++;
+        stats->bytes += m->pkt_len;
+    }
+}
+
+/* Helper: Pull a found session, and its accounting if kept, into cache */
+static inline void
+session_prefetch(const struct nat_core_ctx *ctx, const struct nat_entry *entry)
+{
+    const struct session_table *st = &ctx->sessions;
+    
+    rte_prefetch0(entry);
+    if (ctx->session_accounting)
+        rte_prefetch0(&st->stats[session_table_index(st, entry)]);
+}
+
+/* Helper: Apply a datagram's cached address rewrite to a later fragment */
+static inline void
+fragment_translate(struct nat_core_ctx *ctx, const struct frag_entry *fe,
+                   struct rte_mbuf *m)
+{
+    struct rte_ether_hdr *eth = rte_pktmbuf_mtod(m, struct rte_ether_hdr *);
+    struct rte_ipv4_hdr *ip = (struct rte_ipv4_hdr *)(eth + 1);
+    
+    /* L3 only: the L4 checksum travels in the first fragment */
+    rewrite_addr_port(m, ip, 0, fe->outbound, fe->new_addr, 0,
+                      ctx->cksum_offload);
+}
+
+/*
+ * Helper: Record the rewrite of a first fragment for the rest of its
+ * datagram and release any fragments that arrived ahead of it
+ */
+static void
+fragment_first(struct nat_core_ctx *ctx, const struct nat_entry *entry,
+               const struct rte_ipv4_hdr *ip, bool outbound)
+{
+    struct frag_cache *fc = &ctx->frags;
+    struct frag_entry *fe = frag_cache_lookup(fc, ip, ctx->now, &ctx->stats);
+    
+    if (fe == NULL)
+        fe = frag_cache_add(fc, ip, ctx->now, &ctx->stats);
+    
+    fe->state = FRAG_TRANSLATE;
+    fe->outbound = outbound;
+    fe->new_addr = outbound ?
+                   rte_cpu_to_be_32(ctx->public_ips[entry->pool_idx]) :
+                   rte_cpu_to_be_32(entry->private_ip);
+    fe->last_active = ctx->now;
+    
+    for (uint8_t i = 0; i < fe->nb_held; i++) {
+        struct rte_mbuf *held = fe->held[i];
+        
+        if (fc->nb_ready == FRAG_READY_MAX) {
+            ctx->stats.packets_dropped++;
+            rte_pktmbuf_free(held);
+            continue;
+        }
+        fragment_translate(ctx, fe, held);
+        fc->ready[fc->nb_ready++] = held;
+    }
+    fe->nb_held = 0;
+}
+
+/*
+ * Helper: Resolve a later fragment from the cache without holding it
+ * Used by the single-packet API, where the caller keeps the mbuf.
+ */
+static int
+fragment_translate_cached(struct nat_core_ctx *ctx, struct rte_mbuf *m)
+{
+    struct rte_ether_hdr *eth = rte_pktmbuf_mtod(m, struct rte_ether_hdr *);
+    struct rte_ipv4_hdr *ip = (struct rte_ipv4_hdr *)(eth + 1);
+    struct frag_entry *fe = frag_cache_lookup(&ctx->frags, ip, ctx->now,
+                                              &ctx->stats);
+    
+    if (fe == NULL || fe->state != FRAG_TRANSLATE) {
+        ctx->stats.frag_misses++;
+        return -1;
+    }
+    
+    ctx->stats.frag_hits++;
+    fe->last_active = ctx->now;
+    fragment_translate(ctx, fe, m);
+    return 0;
+}
+
+/* Helper: Advance the TCP state of a session from the segment's flags */
+static inline void
+tcp_track(struct nat_core_ctx *ctx, struct nat_entry *entry,
+          const struct rte_ipv4_hdr *ip, bool outbound)
+{
+    uint8_t ihl = (ip->version_ihl & 0x0F) * 4;
+    const struct rte_tcp_hdr *tcp =
+        (const struct rte_tcp_hdr *)((const uint8_t *)ip + ihl);
+    uint8_t tcp_flags = tcp->tcp_flags;
+    uint8_t fin_flag = outbound ? NAT_FLAG_FIN_OUT : NAT_FLAG_FIN_IN;
+    uint8_t old_state = entry->state;
+    uint8_t state = old_state;
+    
+    if (tcp_flags & RTE_TCP_RST_FLAG) {
+        state = NAT_STATE_CLOSED;
+    } else if (tcp_flags & RTE_TCP_SYN_FLAG) {
+        /* Fresh outbound SYN reuses a closed or lingering mapping */
+        if (outbound && !(tcp_flags & RTE_TCP_ACK_FLAG) &&
+            (state == NAT_STATE_CLOSED || state == NAT_STATE_TIME_WAIT)) {
+            state = NAT_STATE_SYN_SENT;
+            entry->flags &= ~(NAT_FLAG_FIN_OUT | NAT_FLAG_FIN_IN);
+        } else if (!outbound && (tcp_flags & RTE_TCP_ACK_FLAG) &&
+                   state == NAT_STATE_SYN_SENT) {
+            /* SYN-ACK from the peer answers the handshake */
+            state = NAT_STATE_ESTABLISHED;
+        }
+    } else {
+        switch (state) {
+        case NAT_STATE_SYN_SENT:
+            /* Handshake completes once the peer has answered */
+            if (!outbound && (tcp_flags & RTE_TCP_ACK_FLAG))
+                state = NAT_STATE_ESTABLISHED;
+            break;
+        case NAT_STATE_ESTABLISHED:
+        case NAT_STATE_FIN_WAIT:
+            if (tcp_flags & RTE_TCP_FIN_FLAG) {
+                entry->flags |= fin_flag;
+                if ((entry->flags & NAT_FLAG_FIN_OUT) &&
+                    (entry->flags & NAT_FLAG_FIN_IN))
+                    state = NAT_STATE_CLOSING;
+                else
+                    state = NAT_STATE_FIN_WAIT;
+            }
+            break;
+        case NAT_STATE_CLOSING:
+            /* Final ACK of the second FIN */
+            if ((tcp_flags & RTE_TCP_ACK_FLAG) && !(tcp_flags & RTE_TCP_FIN_FLAG))
+                state = NAT_STATE_TIME_WAIT;
+            break;
+        default:
+            break;
+        }
+    }
+    
+    if (state == old_state)
+        return;
+    
+    entry->state = state;
+    
+    /* A longer timeout is picked up lazily; a shorter one must move the timer */
+    if (ctx->timeout_cycles[state] < ctx->timeout_cycles[old_state])
+        timer_wheel_reschedule(&ctx->timers,
+                               session_table_index(&ctx->sessions, entry),
+                               session_deadline(entry, ctx));
+}
+
+/* Helper: Rewrite outbound packet source to the session's public address */
 static inline void
-update_ip_checksum(struct rte_ipv4_hdr *ip_hdr)
+translate_outbound(struct nat_core_ctx *ctx, struct nat_entry *entry,
+                   struct rte_mbuf *m)
 {
-    ip_hdr->hdr_checksum = 0;
-    ip_hdr->hdr_checksum = rte_ipv4_cksum(ip_hdr);
+    struct rte_ether_hdr *eth = rte_pktmbuf_mtod(m, struct rte_ether_hdr *);
+    struct rte_ipv4_hdr *ip = (struct rte_ipv4_hdr *)(eth + 1);
+    
+    session_touch(ctx, entry, m);
+    if (entry->protocol == PROTO_TCP)
+        tcp_track(ctx, entry, ip, true);
+    if (unlikely(ipv4_first_fragment(ip)))
+        fragment_first(ctx, entry, ip, true);
+    rewrite_addr_port(m, ip, entry->protocol, true,
+                      rte_cpu_to_be_32(ctx->public_ips[entry->pool_idx]),
+                      rte_cpu_to_be_16(entry->public_port), ctx->cksum_offload);
 }
 
-/* Helper: Update TCP/UDP checksum */
+/* Helper: Rewrite inbound packet destination back to the private address */
 static inline void
-update_l4_checksum(struct rte_mbuf *m, struct rte_ipv4_hdr *ip_hdr, uint8_t proto)
+translate_inbound(struct nat_core_ctx *ctx, struct nat_entry *entry,
+                  struct rte_mbuf *m)
 {
-    if (proto == PROTO_TCP) {
-        struct rte_tcp_hdr *tcp = (struct rte_tcp_hdr *)
-            ((uint8_t *)ip_hdr + (ip_hdr->version_ihl & 0x0F) * 4);
-        tcp->cksum = 0;
-        tcp->cksum = rte_ipv4_udptcp_cksum(ip_hdr, tcp);
-    } else if (proto == PROTO_UDP) {
-        struct rte_udp_hdr *udp = (struct rte_udp_hdr *)
-            ((uint8_t *)ip_hdr + (ip_hdr->version_ihl & 0x0F) * 4);
-        udp->dgram_cksum = 0;
-        udp->dgram_cksum = rte_ipv4_udptcp_cksum(ip_hdr, udp);
-    }
+    struct rte_ether_hdr *eth = rte_pktmbuf_mtod(m, struct rte_ether_hdr *);
+    struct rte_ipv4_hdr *ip = (struct rte_ipv4_hdr *)(eth + 1);
+    
+    session_touch(ctx, entry, m);
+    if (entry->protocol == PROTO_TCP)
+        tcp_track(ctx, entry, ip, false);
+    if (unlikely(ipv4_first_fragment(ip)))
+        fragment_first(ctx, entry, ip, false);
+    rewrite_addr_port(m, ip, entry->protocol, false,
+                      rte_cpu_to_be_32(entry->private_ip),
+                      rte_cpu_to_be_16(entry->private_port), ctx->cksum_offload);
 }
 
-/* Helper: Extract flow key from packet */
-static inline int
-extract_flow_key(struct rte_mbuf *m, struct flow_key *key)
+/*
+ * Helper: Translate an ICMP error quoting a packet of this session
+ * The outer address, the quoted address and the quoted port (or echo
+ * identifier) are rewritten. The quoted IP and L4 checksums are patched,
+ * and every changed word of the quote is folded into the ICMP checksum.
+ * Errors do not refresh the session (RFC 5508).
+ */
+static void
+translate_icmp_error(struct nat_core_ctx *ctx, struct nat_entry *entry,
+                     struct rte_mbuf *m, bool outbound)
 {
     struct rte_ether_hdr *eth = rte_pktmbuf_mtod(m, struct rte_ether_hdr *);
-    
-    /* Only handle IPv4 */
-    if (eth->ether_type != rte_cpu_to_be_16(RTE_ETHER_TYPE_IPV4))
-        return -1;
-    
     struct rte_ipv4_hdr *ip = (struct rte_ipv4_hdr *)(eth + 1);
+    uint8_t ihl = (ip->version_ihl & 0x0F) * 4;
+    struct rte_icmp_hdr *icmp = (struct rte_icmp_hdr *)((uint8_t *)ip + ihl);
+    struct rte_ipv4_hdr *inner = (struct rte_ipv4_hdr *)(icmp + 1);
+    uint8_t *l4 = (uint8_t *)inner + (inner->version_ihl & 0x0F) * 4;
+    uint32_t l4_len = rte_pktmbuf_data_len(m) -
+                      (uint32_t)(l4 - rte_pktmbuf_mtod(m, uint8_t *));
+    uint16_t *inner_port, *l4_cksum = NULL;
+    uint32_t *inner_addr;
+    uint32_t new_addr;
+    uint16_t new_port;
     
-    key->src_ip = rte_be_to_cpu_32(ip->src_addr);
-    key->dst_ip = rte_be_to_cpu_32(ip->dst_addr);
-    key->protocol = ip->next_proto_id;
+    if (outbound) {
+        /* Quote is a translated inbound packet: restore its destination */
+        new_addr = rte_cpu_to_be_32(ctx->public_ips[entry->pool_idx]);
+        new_port = rte_cpu_to_be_16(entry->public_port);
+        inner_addr = &inner->dst_addr;
+    } else {
+        /* Quote is a translated outbound packet: restore its source */
+        new_addr = rte_cpu_to_be_32(entry->private_ip);
+        new_port = rte_cpu_to_be_16(entry->private_port);
+        inner_addr = &inner->src_addr;
+    }
     
-    if (ip->next_proto_id == PROTO_TCP) {
-        struct rte_tcp_hdr *tcp = (struct rte_tcp_hdr *)
-            ((uint8_t *)ip + (ip->version_ihl & 0x0F) * 4);
-        key->src_port = rte_be_to_cpu_16(tcp->src_port);
-        key->dst_port = rte_be_to_cpu_16(tcp->dst_port);
-    } else if (ip->next_proto_id == PROTO_UDP) {
-        struct rte_udp_hdr *udp = (struct rte_udp_hdr *)
-            ((uint8_t *)ip + (ip->version_ihl & 0x0F) * 4);
-        key->src_port = rte_be_to_cpu_16(udp->src_port);
-        key->dst_port = rte_be_to_cpu_16(udp->dst_port);
-    } else if (ip->next_proto_id == PROTO_ICMP) {
-        key->src_port = 0;
-        key->dst_port = 0;
+    if (entry->protocol == PROTO_ICMP) {
+        struct rte_icmp_hdr *inner_icmp = (struct rte_icmp_hdr *)l4;
+        inner_port = &inner_icmp->icmp_ident;
+        l4_cksum = &inner_icmp->icmp_cksum;
     } else {
-        return -1;  /* Unsupported protocol */
+        uint16_t *ports = (uint16_t *)l4;
+        inner_port = outbound ? &ports[1] : &ports[0];
+        
+        if (entry->protocol == PROTO_TCP) {
+            /* Routers usually quote only the first 8 bytes of TCP */
+            if (l4_len >= offsetof(struct rte_tcp_hdr, cksum) + sizeof(uint16_t))
+                l4_cksum = &((struct rte_tcp_hdr *)l4)->cksum;
+        } else if (((struct rte_udp_hdr *)l4)->dgram_cksum != 0) {
+            l4_cksum = &((struct rte_udp_hdr *)l4)->dgram_cksum;
+        }
     }
     
-    return 0;
-}
-
-int
-nat_core_init(struct nat_core_ctx *ctx, unsigned int core_id,
-              const struct cgnat_config *config)
-{
-    char name[64];
-    unsigned int socket_id = rte_socket_id();
+    uint32_t old_addr = *inner_addr;
+    uint16_t old_port = *inner_port;
+    uint16_t old_ip_cksum = inner->hdr_checksum;
+    uint16_t icmp_cksum = icmp->icmp_cksum;
     
-    memset(ctx, 0, sizeof(*ctx));
-    ctx->core_id = core_id;
-    ctx->socket_id = socket_id;
+    *inner_addr = new_addr;
+    *inner_port = new_port;
+    inner->hdr_checksum = cksum_adjust32(old_ip_cksum, old_addr, new_addr);
     
-    /* Create outbound hash table (private -> public) */
-    snprintf(name, sizeof(name), "outbound_hash_%u", core_id);
-    struct rte_hash_parameters hash_params = {
-        .name = name,
-        .entries = ENTRIES_PER_CORE,
-        .key_len = sizeof(struct flow_key),
-        .hash_func = rte_jhash,
-        .hash_func_init_val = 0,
-        .socket_id = socket_id,
-    };
-    ctx->outbound_hash = rte_hash_create(&hash_params);
-    if (!ctx->outbound_hash) {
-        printf("Failed to create outbound hash table on core %u\n", core_id);
-        return -1;
-    }
+    icmp_cksum = cksum_adjust32(icmp_cksum, old_addr, new_addr);
+    icmp_cksum = cksum_adjust16(icmp_cksum, old_port, new_port);
+    icmp_cksum = cksum_adjust16(icmp_cksum, old_ip_cksum, inner->hdr_checksum);
     
-    /* Create inbound hash table (public -> private) */
-    snprintf(name, sizeof(name), "inbound_hash_%u", core_id);
-    hash_params.name = name;
-    ctx->inbound_hash = rte_hash_create(&hash_params);
-    if (!ctx->inbound_hash) {
-        printf("Failed to create inbound hash table on core %u\n", core_id);
-        rte_hash_free(ctx->outbound_hash);
-        return -1;
+    if (l4_cksum != NULL) {
+        uint16_t old_l4_cksum = *l4_cksum;
+        uint16_t cksum = cksum_adjust16(old_l4_cksum, old_port, new_port);
+        
+        /* TCP and UDP checksums also cover the pseudo-header address */
+        if (entry->protocol != PROTO_ICMP)
+            cksum = cksum_adjust32(cksum, old_addr, new_addr);
+        if (entry->protocol == PROTO_UDP && cksum == 0)
+            cksum = 0xFFFF;
+        *l4_cksum = cksum;
+        icmp_cksum = cksum_adjust16(icmp_cksum, old_l4_cksum, cksum);
     }
+    icmp->icmp_cksum = icmp_cksum;
     
-    /* Create NAT entry memory pool */
-    snprintf(name, sizeof(name), "nat_entry_pool_%u", core_id);
-    ctx->entry_pool = rte_mempool_create(name,
-                                         ENTRIES_PER_CORE,
-                                         sizeof(struct nat_entry),
-                                         MBUF_CACHE_SIZE,
-                                         0, NULL, NULL, NULL, NULL,
-                                         socket_id, 0);
-    if (!ctx->entry_pool) {
-        printf("Failed to create NAT entry pool on core %u\n", core_id);
-        rte_hash_free(ctx->outbound_hash);
-        rte_hash_free(ctx->inbound_hash);
-        return -1;
-    }
+    /* Outer header: L3 only, the ICMP checksum has no pseudo-header */
+    rewrite_addr_port(m, ip, 0, outbound, new_addr, 0, ctx->cksum_offload);
+    ctx->stats.icmp_errors_translated++;
+}
+
+/* Helper: Resolve and translate an ICMP error; never creates a session */
+static int
+process_icmp_error(struct nat_core_ctx *ctx, const struct flow_key *key,
+                   struct rte_mbuf *m, bool outbound)
+{
+    struct rte_hash *hash = outbound ? ctx->sessions.outbound_hash :
+                                       ctx->sessions.inbound_hash;
+    struct nat_entry *entry = session_table_lookup(&ctx->sessions, hash, key);
     
-    /* Initialize port pools for each public IP */
-    ctx->num_public_ips = config->num_public_ips;
-    for (int i = 0; i < config->num_public_ips; i++) {
-        ctx->port_pools[i].public_ip = config->public_ips[i];
-        ctx->port_pools[i].cursor = PORT_RANGE_START;
-        ctx->port_pools[i].ports_allocated = 0;
-        memset(ctx->port_pools[i].bitmap, 0, sizeof(ctx->port_pools[i].bitmap));
-        rte_atomic32_init(&ctx->port_pools[i].exhaustion_events);
+    if (entry == NULL) {
+        ctx->stats.nat_lookup_miss++;
+        return -1;
     }
     
-    /* Store customer subnet config */
-    ctx->customer_subnet = config->customer_subnet;
-    ctx->customer_netmask = config->customer_netmask;
-    
-    printf("[CORE %u] NAT engine initialized (socket %u)\n", core_id, socket_id);
+    ctx->stats.nat_lookup_hit++;
+    translate_icmp_error(ctx, entry, m, outbound);
     return 0;
 }
 
-void
-nat_core_cleanup(struct nat_core_ctx *ctx)
+/* Helper: Latency histogram bucket of a duration in cycles */
+static inline unsigned int
+latency_bucket(uint64_t cycles)
 {
-    if (ctx->outbound_hash)
-        rte_hash_free(ctx->outbound_hash);
-    if (ctx->inbound_hash)
-        rte_hash_free(ctx->inbound_hash);
-    if (ctx->entry_pool)
-        rte_mempool_free(ctx->entry_pool);
-    
-    printf("[CORE %u] NAT engine cleaned up\n", ctx->core_id);
+    unsigned int e;
+
+    if (cycles < (1ULL << LAT_HIST_MIN_SHIFT))
+        return 0;
+
+    e = 63 - __builtin_clzll(cycles);
+    if (e >= LAT_HIST_MAX_SHIFT)
+        return LAT_HIST_BUCKETS - 1;
+
+    return 1 + ((e - LAT_HIST_MIN_SHIFT) << LAT_HIST_SUB_BITS) +
+           ((cycles >> (e - LAT_HIST_SUB_BITS)) & ((1U << LAT_HIST_SUB_BITS) - 1));
+}
+
+/*
+ * Helper: Record the processing time of nb packets of one direction
+ * cycles covers the stages they went through; each packet counts with it.
+ */
+static inline void
+track_latency(struct nat_core_ctx *ctx, unsigned int dir, uint64_t cycles,
+              uint16_t nb)
+{
+    struct latency_hist *h = &ctx->stats.latency[dir];
+
+    h->buckets[latency_bucket(cycles)] += nb;
+    h->sum += cycles * nb;
 }
 
 int
@@ -166,113 +1472,61 @@ nat_process_outbound(struct nat_core_ctx *ctx, struct rte_mbuf *m)
     struct flow_key key;
     struct nat_entry *entry;
     uint64_t start_tsc = rte_rdtsc();
+    int rc, cust;
+    
+    clock_update(ctx, start_tsc);
     
     /* Extract 5-tuple */
-    if (extract_flow_key(m, &key) < 0) {
+    rc = extract_flow_key(m, &key);
+    if (rc < 0) {
         ctx->stats.errors_invalid_packet++;
         return -1;
     }
     
     /* Check if this is a customer packet */
-    if ((key.src_ip & ctx->customer_netmask) != ctx->customer_subnet) {
+    cust = customer_of(ctx, key.src_ip);
+    if (cust < 0) {
         ctx->stats.errors_invalid_packet++;
         return -1;
     }
     
-    /* Lookup existing NAT session */
-    int32_t ret = rte_hash_lookup(ctx->outbound_hash, &key);
-    if (ret >= 0) {
-        /* Session exists - retrieve entry */
-        if (rte_mempool_get(ctx->entry_pool, (void **)&entry) < 0) {
-            ctx->stats.errors_no_memory++;
-            return -1;
-        }
-        
-        ctx->stats.nat_lookup_hit++;
-        entry->last_activity = start_tsc;
-        entry->packet_count++;
-        entry->byte_count += m->pkt_len;
-    } else {
-        /* New session - create NAT entry */
-        if (rte_mempool_get(ctx->entry_pool, (void **)&entry) < 0) {
-            ctx->stats.errors_no_memory++;
-            return -1;
-        }
-        
-        /* Allocate public port (round-robin across IPs) */
-        int ip_idx = (ctx->stats.nat_created % ctx->num_public_ips);
-        uint16_t public_port = port_pool_alloc(&ctx->port_pools[ip_idx]);
-        if (public_port == 0) {
-            /* Try other IPs if first fails */
-            for (int i = 0; i < ctx->num_public_ips; i++) {
-                public_port = port_pool_alloc(&ctx->port_pools[i]);
-                if (public_port != 0) {
-                    ip_idx = i;
-                    break;
-                }
-            }
-        }
+    if (rc == FLOW_KEY_ICMP_ERROR)
+        return process_icmp_error(ctx, &key, m, true);
+    if (rc == FLOW_KEY_FRAGMENT)
+        return fragment_translate_cached(ctx, m);
+    
+    if (ctx->acl != NULL) {
+        const struct acl_ruleset *acl = __atomic_load_n(&ctx->acl->active,
+                                                        __ATOMIC_ACQUIRE);
+        const void *key_ptr = &key;
         
-        if (public_port == 0) {
-            rte_mempool_put(ctx->entry_pool, entry);
-            ctx->stats.errors_no_ports++;
-            ctx->stats.port_alloc_fail++;
+        if (acl && acl_classify_burst(acl, ctx->worker_id, &key_ptr, 1)) {
+            ctx->stats.acl_denied++;
             return -1;
         }
-        
-        /* Fill NAT entry */
-        memcpy(&entry->private_flow, &key, sizeof(key));
-        entry->public_ip = ctx->port_pools[ip_idx].public_ip;
-        entry->public_port = public_port;
-        entry->state = (key.protocol == PROTO_TCP) ? NAT_STATE_SYN_SENT : NAT_STATE_UDP_ACTIVE;
-        entry->last_activity = start_tsc;
-        entry->packet_count = 1;
-        entry->byte_count = m->pkt_len;
-        entry->customer_id = rte_jhash(&key.src_ip, 4, 0);
-        
-        /* Add to hash tables */
-        rte_hash_add_key_data(ctx->outbound_hash, &key, entry);
-        
-        struct flow_key reverse_key = {
-            .src_ip = key.dst_ip,
-            .dst_ip = entry->public_ip,
-            .src_port = key.dst_port,
-            .dst_port = public_port,
-            .protocol = key.protocol,
-        };
-        rte_hash_add_key_data(ctx->inbound_hash, &reverse_key, entry);
-        
-        ctx->stats.nat_created++;
-        ctx->stats.nat_lookup_miss++;
-        ctx->stats.port_alloc_success++;
     }
     
-    /* Rewrite packet */
-    struct rte_ether_hdr *eth = rte_pktmbuf_mtod(m, struct rte_ether_hdr *);
-    struct rte_ipv4_hdr *ip = (struct rte_ipv4_hdr *)(eth + 1);
+    /* Lookup existing NAT session */
+    entry = session_table_lookup(&ctx->sessions, ctx->sessions.outbound_hash,
+                                 &key);
+    if (entry != NULL)
+        ctx->stats.nat_lookup_hit++;
+    else
+        ctx->stats.nat_lookup_miss++;
     
-    ip->src_addr = rte_cpu_to_be_32(entry->public_ip);
+    /* Police first: an over-rate miss must not take a port or a session */
+    if (ctx->policer_rate != 0 &&
+        !policer_admit(ctx, subscriber_at(ctx, key.src_ip, cust), m, true))
+        return -1;
     
-    if (key.protocol == PROTO_TCP) {
-        struct rte_tcp_hdr *tcp = (struct rte_tcp_hdr *)
-            ((uint8_t *)ip + (ip->version_ihl & 0x0F) * 4);
-        tcp->src_port = rte_cpu_to_be_16(entry->public_port);
-    } else if (key.protocol == PROTO_UDP) {
-        struct rte_udp_hdr *udp = (struct rte_udp_hdr *)
-            ((uint8_t *)ip + (ip->version_ihl & 0x0F) * 4);
-        udp->src_port = rte_cpu_to_be_16(entry->public_port);
+    if (entry == NULL) {
+        entry = create_session(ctx, &key, cust);
+        if (entry == NULL)
+            return -1;
     }
     
-    /* Update checksums */
-    update_ip_checksum(ip);
-    update_l4_checksum(m, ip, key.protocol);
-    
-    /* Track latency */
-    uint64_t latency = rte_rdtsc() - start_tsc;
-    ctx->stats.latency_sum += latency;
-    ctx->stats.latency_count++;
-    if (latency > ctx->stats.latency_max)
-        ctx->stats.latency_max = latency;
+    translate_outbound(ctx, entry, m);
+    track_latency(ctx, NAT_DIR_OUTBOUND, rte_rdtsc() - start_tsc, 1);
     
     return 0;
 }
@@ -282,124 +1536,502 @@ nat_process_inbound(struct nat_core_ctx *ctx, struct rte_mbuf *m)
 {
     struct flow_key key;
     struct nat_entry *entry;
+    uint64_t start_tsc = rte_rdtsc();
+    int rc;
     
     /* Extract 5-tuple */
-    if (extract_flow_key(m, &key) < 0) {
+    rc = extract_flow_key(m, &key);
+    if (rc < 0) {
         ctx->stats.errors_invalid_packet++;
         return -1;
     }
     
+    clock_update(ctx, start_tsc);
+    if (rc == FLOW_KEY_ICMP_ERROR)
+        return process_icmp_error(ctx, &key, m, false);
+    if (rc == FLOW_KEY_FRAGMENT)
+        return fragment_translate_cached(ctx, m);
+    
     /* Lookup NAT session */
-    int32_t ret = rte_hash_lookup_data(ctx->inbound_hash, &key, (void **)&entry);
-    if (ret < 0) {
+    entry = session_table_lookup(&ctx->sessions, ctx->sessions.inbound_hash,
+                                 &key);
+    if (entry == NULL) {
         ctx->stats.nat_lookup_miss++;
         return -1;  /* No NAT session - drop */
     }
     
     ctx->stats.nat_lookup_hit++;
-    entry->last_activity = rte_rdtsc();
-    entry->packet_count++;
-    entry->byte_count += m->pkt_len;
+    if (ctx->policer_rate != 0 &&
+        !policer_admit(ctx, session_subscriber(ctx, entry), m, false))
+        return -1;
     
-    /* Rewrite packet back to private address */
-    struct rte_ether_hdr *eth = rte_pktmbuf_mtod(m, struct rte_ether_hdr *);
-    struct rte_ipv4_hdr *ip = (struct rte_ipv4_hdr *)(eth + 1);
+    translate_inbound(ctx, entry, m);
+    track_latency(ctx, NAT_DIR_INBOUND, rte_rdtsc() - start_tsc, 1);
     
-    ip->dst_addr = rte_cpu_to_be_32(entry->private_flow.src_ip);
+    return 0;
+}
+
+/* Helper: Worker owning a flow; cust is the source's prefix, -1 inbound */
+static inline unsigned int
+flow_owner(const struct nat_core_ctx *ctx, const struct flow_key *key, int cust)
+{
+    /* Sessions of one subscriber all live on one worker */
+    if (cust >= 0)
+        return subscriber_index(ctx, key->src_ip, cust) % ctx->num_workers;
     
-    if (key.protocol == PROTO_TCP) {
-        struct rte_tcp_hdr *tcp = (struct rte_tcp_hdr *)
-            ((uint8_t *)ip + (ip->version_ihl & 0x0F) * 4);
-        tcp->dst_port = rte_cpu_to_be_16(entry->private_flow.src_port);
-    } else if (key.protocol == PROTO_UDP) {
-        struct rte_udp_hdr *udp = (struct rte_udp_hdr *)
-            ((uint8_t *)ip + (ip->version_ihl & 0x0F) * 4);
-        udp->dst_port = rte_cpu_to_be_16(entry->private_flow.src_port);
-    }
+    /* Return traffic (or an ICMP error quoting it) belongs to the worker
+     * owning the public port's slice; for ICMP the port is the identifier */
+    return port_partition_owner(&ctx->port_partition, key->dst_port);
+}
+
+/* Helper: Queue RSS puts a tuple on (TCP and UDP with ports, others without) */
+static inline unsigned int
+rss_queue_of(const struct rss_config *rss, const struct flow_key *key)
+{
+    uint32_t tuple[3] = { key->src_ip, key->dst_ip,
+                          ((uint32_t)key->src_port << 16) | key->dst_port };
+    uint32_t len = (key->protocol == PROTO_TCP || key->protocol == PROTO_UDP) ?
+                   3 : 2;
+    
+    return rss->reta[rte_softrss(tuple, len, rss->key) & (rss->reta_size - 1)];
+}
+
+/*
+ * Helper: Worker owning a flow's session in flow and symmetric RSS modes
+ * Outbound sessions live where RSS put the flow. Inbound ones are found
+ * the way the NIC finds them: by return tuple hash for symmetric TCP/UDP,
+ * by the public port's (or echo identifier's) slice otherwise.
+ */
+static inline unsigned int
+steered_owner(const struct nat_core_ctx *ctx, const struct flow_key *key,
+              bool outbound)
+{
+    if (outbound)
+        return ctx->rss ? rss_queue_of(ctx->rss, key) : ctx->worker_id;
+    if (ctx->rss_ports && key->protocol != PROTO_ICMP)
+        return rss_queue_of(ctx->rss, key);
+    return port_partition_owner(&ctx->port_partition, key->dst_port);
+}
+
+unsigned int
+nat_flow_owner(const struct nat_core_ctx *ctx, const struct flow_key *key,
+               bool outbound)
+{
+    if (!ctx->handoff_enabled)
+        return steered_owner(ctx, key, outbound);
+    return flow_owner(ctx, key, outbound ? customer_of(ctx, key->src_ip) : -1);
+}
+
+/* Helper: Push the packets staged for one worker onto its ring */
+static void
+handoff_flush_queue(struct nat_core_ctx *ctx, unsigned int w)
+{
+    struct handoff_queue *q = &ctx->handoff_queues[w];
+    uint16_t count = q->count;
+    unsigned int sent;
     
-    /* Update checksums */
-    update_ip_checksum(ip);
-    update_l4_checksum(m, ip, key.protocol);
+    if (count == 0)
+        return;
     
-    return 0;
+    sent = rte_ring_sp_enqueue_burst(ctx->handoff_out[w],
+                                     (void * const *)q->pkts,
+                                     count, NULL);
+    ctx->stats.handoff_tx += sent;
+    
+    /* Owner is not keeping up - drop rather than stall this core */
+    for (unsigned int i = sent; i < count; i++) {
+        rte_pktmbuf_free(q->pkts[i]);
+        ctx->stats.handoff_dropped++;
+        ctx->stats.packets_dropped++;
+    }
+    q->count = 0;
 }
 
-int
-nat_expire_sessions(struct nat_core_ctx *ctx)
+/* Helper: Queue a packet for the worker owning its session */
+static inline void
+handoff_stage(struct nat_core_ctx *ctx, unsigned int owner, struct rte_mbuf *m)
 {
-    /* TODO: Implement timer wheel-based aging */
-    /* For now, this is a placeholder */
-    return 0;
+    struct handoff_queue *q = &ctx->handoff_queues[owner];
+    
+    /* Released fragments can add to a burst's worth of staged packets */
+    if (unlikely(q->count == RX_BURST_SIZE))
+        handoff_flush_queue(ctx, owner);
+    q->pkts[q->count++] = m;
 }
 
-void
-nat_get_stats(const struct nat_core_ctx *ctx, struct core_stats *stats)
+/* Helper: Push staged packets to their owners, one burst per ring */
+static void
+handoff_flush(struct nat_core_ctx *ctx)
+{
+    for (unsigned int w = 0; w < ctx->num_workers; w++)
+        handoff_flush_queue(ctx, w);
+}
+
+/*
+ * Helper: Send the rest of a datagram after its first fragment
+ * Runs on the receiving worker when the first fragment is handed off: later
+ * fragments carry no port, so only this entry knows their owner.
+ */
+static void
+fragment_forward(struct nat_core_ctx *ctx, struct rte_mbuf *m, unsigned int owner)
+{
+    struct rte_ether_hdr *eth = rte_pktmbuf_mtod(m, struct rte_ether_hdr *);
+    struct rte_ipv4_hdr *ip = (struct rte_ipv4_hdr *)(eth + 1);
+    struct frag_entry *fe = frag_cache_lookup(&ctx->frags, ip, ctx->now,
+                                              &ctx->stats);
+    
+    if (fe == NULL)
+        fe = frag_cache_add(&ctx->frags, ip, ctx->now, &ctx->stats);
+    
+    fe->state = FRAG_FORWARD;
+    fe->owner = owner;
+    fe->last_active = ctx->now;
+    
+    /* The owner holds these until the first fragment reaches it */
+    for (uint8_t i = 0; i < fe->nb_held; i++)
+        handoff_stage(ctx, owner, fe->held[i]);
+    fe->nb_held = 0;
+}
+
+/*
+ * Helper: Dispose of a later fragment through its datagram's cache entry
+ * cust is the customer prefix of an outbound fragment, -1 for inbound.
+ * Returns true if it was translated in place and should be transmitted;
+ * otherwise it was handed off, held for its first fragment, or dropped.
+ */
+static bool
+fragment_process(struct nat_core_ctx *ctx, struct rte_mbuf *m,
+                 const struct flow_key *key, int cust)
 {
-    memcpy(stats, &ctx->stats, sizeof(*stats));
+    struct rte_ether_hdr *eth = rte_pktmbuf_mtod(m, struct rte_ether_hdr *);
+    struct rte_ipv4_hdr *ip = (struct rte_ipv4_hdr *)(eth + 1);
+    struct frag_entry *fe;
+    
+    /* Outbound ownership follows the subscriber, as for the first fragment */
+    if (cust >= 0 && ctx->handoff_enabled) {
+        unsigned int owner = flow_owner(ctx, key, cust);
+        if (owner != ctx->worker_id) {
+            handoff_stage(ctx, owner, m);
+            return false;
+        }
+    }
+    
+    fe = frag_cache_lookup(&ctx->frags, ip, ctx->now, &ctx->stats);
+    if (fe != NULL && fe->state != FRAG_PENDING) {
+        ctx->stats.frag_hits++;
+        fe->last_active = ctx->now;
+        if (fe->state == FRAG_FORWARD) {
+            handoff_stage(ctx, fe->owner, m);
+            return false;
+        }
+        fragment_translate(ctx, fe, m);
+        return true;
+    }
+    
+    /* Overtook its first fragment: hold it, within bounds */
+    ctx->stats.frag_misses++;
+    if (fe == NULL)
+        fe = frag_cache_add(&ctx->frags, ip, ctx->now, &ctx->stats);
+    if (fe->nb_held == FRAG_HOLD_MAX) {
+        ctx->stats.packets_dropped++;
+        rte_pktmbuf_free(m);
+        return false;
+    }
+    fe->held[fe->nb_held++] = m;
+    return false;
 }
 
-/* Port pool management */
 uint16_t
-port_pool_alloc(struct port_pool *pool)
+nat_process_burst(struct nat_core_ctx *ctx, struct rte_mbuf **pkts,
+                  uint16_t nb_pkts)
 {
-    uint16_t start_cursor = pool->cursor;
+    struct flow_key keys[RX_BURST_SIZE];
+    uint32_t src_ips[RX_BURST_SIZE], hops[RX_BURST_SIZE];
+    uint8_t key_types[RX_BURST_SIZE];
+    const void *out_key_ptrs[RX_BURST_SIZE], *in_key_ptrs[RX_BURST_SIZE];
+    struct rte_mbuf *out_pkts[RX_BURST_SIZE], *in_pkts[RX_BURST_SIZE];
+    struct nat_entry *out_data[RX_BURST_SIZE], *in_data[RX_BURST_SIZE];
+    int out_customers[RX_BURST_SIZE];
+    uint64_t out_hits = 0, in_hits = 0;
+    uint16_t nb_keys = 0, nb_out = 0, nb_in = 0, nb_tx = 0;
+    uint64_t start_tsc = rte_rdtsc(), lookup_tsc, out_tsc;
     
-    /* Scan from cursor with wraparound */
-    do {
-        uint16_t port = pool->cursor;
-        if (port < PORT_RANGE_START || port > PORT_RANGE_END) {
-            pool->cursor = PORT_RANGE_START;
+    RTE_ASSERT(nb_pkts <= RX_BURST_SIZE);
+    
+    clock_update(ctx, start_tsc);
+    
+    /* Stage 1: pull packet headers into cache */
+    for (uint16_t i = 0; i < nb_pkts; i++)
+        rte_prefetch0(rte_pktmbuf_mtod(pkts[i], void *));
+    
+    /* Stage 2: extract keys; parsed packets are compacted in pkts */
+    for (uint16_t i = 0; i < nb_pkts; i++) {
+        struct rte_mbuf *m = pkts[i];
+        int rc = extract_flow_key(m, &keys[nb_keys]);
+        
+        if (unlikely(rc < 0)) {
+            ctx->stats.errors_invalid_packet++;
+            ctx->stats.packets_dropped++;
+            rte_pktmbuf_free(m);
             continue;
         }
+        key_types[nb_keys] = rc;
+        src_ips[nb_keys] = keys[nb_keys].src_ip;
+        pkts[nb_keys++] = m;
+    }
+    
+    /* Stage 2a: one LPM lookup for the burst gives direction and prefix */
+    if (nb_keys > 0)
+        rte_lpm_lookup_bulk(ctx->customer_lpm, src_ips, hops, nb_keys);
+    
+    /* Stage 2b: classify */
+    for (uint16_t i = 0; i < nb_keys; i++) {
+        struct rte_mbuf *m = pkts[i];
+        struct flow_key *key = &keys[i];
+        int rc = key_types[i];
+        int cust = (hops[i] & RTE_LPM_LOOKUP_SUCCESS) ?
+                   (int)(hops[i] & CUSTOMER_HOP_MASK) : -1;
+        bool outbound = (cust >= 0);
         
-        /* Check bitmap */
-        uint16_t idx = port - PORT_RANGE_START;
-        uint16_t word_idx = idx / 64;
-        uint16_t bit_idx = idx % 64;
+        /* Later fragments have no ports: resolved through the frag cache */
+        if (unlikely(rc == FLOW_KEY_FRAGMENT)) {
+            if (fragment_process(ctx, m, key, cust))
+                pkts[nb_tx++] = m;
+            continue;
+        }
         
-        if (!(pool->bitmap[word_idx] & (1ULL << bit_idx))) {
-            /* Port is free - allocate it */
-            pool->bitmap[word_idx] |= (1ULL << bit_idx);
-            pool->ports_allocated++;
-            pool->cursor = (port + 1 > PORT_RANGE_END) ? PORT_RANGE_START : port + 1;
-            return port;
+        /*
+         * Session lives elsewhere: forward instead of missing locally.
+         * With NIC placement only what RSS hashes on the addresses alone
+         * can be misplaced: inbound echo, ICMP errors and first fragments.
+         */
+        if (ctx->handoff_out != NULL) {
+            struct rte_ipv4_hdr *ip = (struct rte_ipv4_hdr *)
+                (rte_pktmbuf_mtod(m, struct rte_ether_hdr *) + 1);
+            bool first_frag = ipv4_first_fragment(ip);
+            unsigned int owner = ctx->worker_id;
+            
+            if (ctx->handoff_enabled)
+                owner = flow_owner(ctx, key, cust);
+            else if (unlikely(rc == FLOW_KEY_ICMP_ERROR || first_frag ||
+                              (!outbound && key->protocol == PROTO_ICMP)))
+                owner = steered_owner(ctx, key, outbound);
+            
+            if (owner != ctx->worker_id) {
+                /* Later fragments follow the first fragment's receiver,
+                 * except outbound ones in software mode (by subscriber).
+                 * Before staging: once on the ring m belongs to the owner */
+                if (unlikely(first_frag && (!outbound || !ctx->handoff_enabled)))
+                    fragment_forward(ctx, m, owner);
+                handoff_stage(ctx, owner, m);
+                continue;
+            }
+        }
+        
+        /* ICMP errors are rare: resolve them here, off the bulk path */
+        if (unlikely(rc == FLOW_KEY_ICMP_ERROR)) {
+            if (process_icmp_error(ctx, key, m, outbound) == 0) {
+                /* Slot nb_tx <= i has already been consumed */
+                pkts[nb_tx++] = m;
+            } else {
+                ctx->stats.packets_dropped++;
+                rte_pktmbuf_free(m);
+            }
+            continue;
+        }
+        
+        if (outbound) {
+            out_key_ptrs[nb_out] = key;
+            out_customers[nb_out] = cust;
+            out_pkts[nb_out++] = m;
+        } else {
+            in_key_ptrs[nb_in] = key;
+            in_pkts[nb_in++] = m;
         }
+    }
+    
+    /* Hand misdirected packets over before the local work */
+    if (ctx->handoff_out != NULL)
+        handoff_flush(ctx);
+    
+    /* Stage 3: outbound ACL, one vector classification for the burst */
+    if (ctx->acl != NULL && nb_out > 0) {
+        const struct acl_ruleset *acl = __atomic_load_n(&ctx->acl->active,
+                                                        __ATOMIC_ACQUIRE);
+        uint64_t deny = acl ? acl_classify_burst(acl, ctx->worker_id,
+                                                 out_key_ptrs, nb_out) : 0;
         
-        /* Try next port */
-        pool->cursor++;
-        if (pool->cursor > PORT_RANGE_END)
-            pool->cursor = PORT_RANGE_START;
+        if (unlikely(deny != 0)) {
+            uint16_t kept = 0;
             
-    } while (pool->cursor != start_cursor);
+            for (uint16_t i = 0; i < nb_out; i++) {
+                if (deny & (1ULL << i)) {
+                    ctx->stats.acl_denied++;
+                    ctx->stats.packets_dropped++;
+                    rte_pktmbuf_free(out_pkts[i]);
+                    continue;
+                }
+                out_key_ptrs[kept] = out_key_ptrs[i];
+                out_customers[kept] = out_customers[i];
+                out_pkts[kept++] = out_pkts[i];
+            }
+            nb_out = kept;
+        }
+    }
     
-    /* Pool exhausted */
-    rte_atomic32_inc(&pool->exhaustion_events);
-    return 0;
+    /* Stage 4: resolve all keys with one bulk probe per table */
+    if (nb_out > 0)
+        session_table_lookup_bulk(&ctx->sessions, ctx->sessions.outbound_hash,
+                                  out_key_ptrs, nb_out, &out_hits, out_data);
+    if (nb_in > 0)
+        session_table_lookup_bulk(&ctx->sessions, ctx->sessions.inbound_hash,
+                                  in_key_ptrs, nb_in, &in_hits, in_data);
+    
+    for (uint16_t i = 0; i < nb_out; i++)
+        if (out_hits & (1ULL << i))
+            session_prefetch(ctx, out_data[i]);
+    for (uint16_t i = 0; i < nb_in; i++)
+        if (in_hits & (1ULL << i))
+            session_prefetch(ctx, in_data[i]);
+    
+    /* Classification and lookups are shared by both directions */
+    lookup_tsc = rte_rdtsc();
+    
+    /* Stage 5: translate; only outbound misses take the slow path */
+    for (uint16_t i = 0; i < nb_out; i++) {
+        const struct flow_key *key = out_key_ptrs[i];
+        struct nat_entry *entry = NULL;
+        
+        if (likely(out_hits & (1ULL << i))) {
+            entry = out_data[i];
+            ctx->stats.nat_lookup_hit++;
+        } else {
+            ctx->stats.nat_lookup_miss++;
+        }
+        
+        /* Police first: an over-rate miss must not take a port or a session */
+        if (ctx->policer_rate != 0 &&
+            !policer_admit(ctx, subscriber_at(ctx, key->src_ip, out_customers[i]),
+                           out_pkts[i], true)) {
+            ctx->stats.packets_dropped++;
+            rte_pktmbuf_free(out_pkts[i]);
+            continue;
+        }
+        
+        if (unlikely(entry == NULL)) {
+            entry = create_session(ctx, key, out_customers[i]);
+            if (entry == NULL) {
+                ctx->stats.packets_dropped++;
+                rte_pktmbuf_free(out_pkts[i]);
+                continue;
+            }
+        }
+        
+        translate_outbound(ctx, entry, out_pkts[i]);
+        pkts[nb_tx++] = out_pkts[i];
+    }
+    
+    out_tsc = rte_rdtsc();
+    
+    for (uint16_t i = 0; i < nb_in; i++) {
+        if (unlikely(!(in_hits & (1ULL << i)))) {
+            /* No NAT session - drop */
+            ctx->stats.nat_lookup_miss++;
+            ctx->stats.packets_dropped++;
+            rte_pktmbuf_free(in_pkts[i]);
+            continue;
+        }
+        
+        ctx->stats.nat_lookup_hit++;
+        if (ctx->policer_rate != 0 &&
+            !policer_admit(ctx, session_subscriber(ctx, in_data[i]),
+                           in_pkts[i], false)) {
+            ctx->stats.packets_dropped++;
+            rte_pktmbuf_free(in_pkts[i]);
+            continue;
+        }
+        
+        translate_inbound(ctx, in_data[i], in_pkts[i]);
+        pkts[nb_tx++] = in_pkts[i];
+    }
+    
+    /*
+     * Each direction is charged the shared stages and its own translation
+     * loop, not the other direction's. Fragments, ICMP errors and
+     * handed-off packets are not timed.
+     */
+    if (nb_out > 0)
+        track_latency(ctx, NAT_DIR_OUTBOUND, out_tsc - start_tsc, nb_out);
+    if (nb_in > 0)
+        track_latency(ctx, NAT_DIR_INBOUND,
+                      (lookup_tsc - start_tsc) + (rte_rdtsc() - out_tsc), nb_in);
+    
+    return nb_tx;
+}
+
+int
+nat_expire_sessions(struct nat_core_ctx *ctx)
+{
+    uint64_t now_tsc = rte_rdtsc();
+    
+    clock_update(ctx, now_tsc);
+    frag_cache_expire(&ctx->frags, ctx->now, FRAG_EXPIRE_BUDGET, &ctx->stats);
+    return timer_wheel_advance(&ctx->timers, now_tsc, TW_EXPIRE_BUDGET,
+                               session_deadline, session_expire, ctx);
+}
+
+uint16_t
+nat_frag_drain(struct nat_core_ctx *ctx, struct rte_mbuf **pkts, uint16_t max)
+{
+    struct frag_cache *fc = &ctx->frags;
+    uint16_t n = RTE_MIN(fc->nb_ready, max);
+    
+    if (n == 0)
+        return 0;
+    
+    memcpy(pkts, fc->ready, n * sizeof(*pkts));
+    fc->nb_ready -= n;
+    memmove(fc->ready, fc->ready + n, fc->nb_ready * sizeof(*pkts));
+    return n;
 }
 
 void
-port_pool_free(struct port_pool *pool, uint16_t port)
+nat_stats_publish(struct nat_core_ctx *ctx)
 {
-    if (port < PORT_RANGE_START || port > PORT_RANGE_END)
-        return;
+    struct core_stats_snapshot *snap = &ctx->stats_snapshot;
     
-    uint16_t idx = port - PORT_RANGE_START;
-    uint16_t word_idx = idx / 64;
-    uint16_t bit_idx = idx % 64;
+    rte_seqcount_write_begin(&snap->seq);
+    memcpy(&snap->stats, &ctx->stats, sizeof(snap->stats));
+    snap->port_pools = ctx->port_pools;
+    snap->num_public_ips = ctx->num_public_ips;
+    rte_seqcount_write_end(&snap->seq);
+}
+
+void
+nat_get_stats(const struct nat_core_ctx *ctx, struct core_stats *stats)
+{
+    const struct core_stats_snapshot *snap = &ctx->stats_snapshot;
+    uint32_t sn;
     
-    pool->bitmap[word_idx] &= ~(1ULL << bit_idx);
-    pool->ports_allocated--;
+    do {
+        sn = rte_seqcount_read_begin(&snap->seq);
+        memcpy(stats, &snap->stats, sizeof(*stats));
+    } while (rte_seqcount_read_retry(&snap->seq, sn));
 }
 
-bool
-port_pool_is_allocated(const struct port_pool *pool, uint16_t port)
+int
+nat_get_port_pools(const struct nat_core_ctx *ctx,
+                   struct port_pool *const **pools)
 {
-    if (port < PORT_RANGE_START || port > PORT_RANGE_END)
-        return false;
+    const struct core_stats_snapshot *snap = &ctx->stats_snapshot;
+    uint32_t sn;
+    int n;
     
-    uint16_t idx = port - PORT_RANGE_START;
-    uint16_t word_idx = idx / 64;
-    uint16_t bit_idx = idx % 64;
+    do {
+        sn = rte_seqcount_read_begin(&snap->seq);
+        *pools = snap->port_pools;
+        n = snap->num_public_ips;
+    } while (rte_seqcount_read_retry(&snap->seq, sn));
     
-    return (pool->bitmap[word_idx] & (1ULL << bit_idx)) != 0;
+    return n;
 }
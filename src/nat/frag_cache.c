@@ -0,0 +1,191 @@
+/* SPDX-License-Identifier: MIT */
+/**
+ * @file frag_cache.c
+ * @brief Per-core IPv4 fragment cache (translation without reassembly)
+ *
+ * The first fragment of a datagram is translated through its session and
+ * leaves an entry here; later fragments, which carry no ports, find it by
+ * (src, dst, proto, IP ID) and get the same address rewrite. Fragments that
+ * overtake the first are held in the entry. The table is a fixed
+ * set-associative array, so memory stays bounded: a full bucket evicts its
+ * least recently used way.
+ */
+
+#include "nat_engine.h"
+#include "cgnat_types.h"
+#include <rte_ip.h>
+#include <rte_jhash.h>
+#include <rte_malloc.h>
+#include <rte_mbuf.h>
+#include <stdio.h>
+#include <string.h>
+
+#define FRAG_ENTRIES  (FRAG_CACHE_BUCKETS * FRAG_CACHE_WAYS)
+
+/* Helper: First way of the bucket a datagram maps to */
+static inline struct frag_entry *
+frag_bucket(const struct frag_cache *fc, const struct rte_ipv4_hdr *ip)
+{
+    uint32_t hash = rte_jhash_3words(ip->src_addr, ip->dst_addr,
+                                     ((uint32_t)ip->packet_id << 8) |
+                                     ip->next_proto_id, 0);
+
+    return &fc->entries[(hash & (FRAG_CACHE_BUCKETS - 1)) * FRAG_CACHE_WAYS];
+}
+
+/* Helper: Entry belongs to the datagram of this fragment */
+static inline bool
+frag_match(const struct frag_entry *fe, const struct rte_ipv4_hdr *ip)
+{
+    return fe->state != FRAG_FREE &&
+           fe->src_ip == ip->src_addr && fe->dst_ip == ip->dst_addr &&
+           fe->ip_id == ip->packet_id && fe->protocol == ip->next_proto_id;
+}
+
+/* Helper: Entry idle for longer than the fragment timeout */
+static inline bool
+frag_expired(const struct frag_cache *fc, const struct frag_entry *fe,
+             uint32_t now)
+{
+    return (uint32_t)(now - fe->last_active) > fc->timeout;
+}
+
+/* Helper: Free an entry, dropping any fragments it still holds */
+static void
+frag_release(struct frag_entry *fe, struct core_stats *stats)
+{
+    if (fe->nb_held > 0)
+        stats->frag_evictions++;
+
+    for (uint8_t i = 0; i < fe->nb_held; i++) {
+        rte_pktmbuf_free(fe->held[i]);
+        stats->packets_dropped++;
+    }
+    fe->nb_held = 0;
+    fe->state = FRAG_FREE;
+}
+
+int
+frag_cache_init(struct frag_cache *fc, unsigned int core_id,
+                unsigned int socket_id, uint32_t timeout)
+{
+    char name[64];
+
+    memset(fc, 0, sizeof(*fc));
+
+    snprintf(name, sizeof(name), "frag_cache_%u", core_id);
+    fc->entries = rte_zmalloc_socket(name, FRAG_ENTRIES * sizeof(struct frag_entry),
+                                     RTE_CACHE_LINE_SIZE, socket_id);
+    if (!fc->entries) {
+        printf("Failed to allocate fragment cache on core %u\n", core_id);
+        return -1;
+    }
+
+    fc->timeout = timeout;
+    return 0;
+}
+
+void
+frag_cache_free(struct frag_cache *fc)
+{
+    if (fc->entries) {
+        for (uint32_t i = 0; i < FRAG_ENTRIES; i++)
+            for (uint8_t j = 0; j < fc->entries[i].nb_held; j++)
+                rte_pktmbuf_free(fc->entries[i].held[j]);
+        rte_free(fc->entries);
+    }
+
+    for (uint16_t i = 0; i < fc->nb_ready; i++)
+        rte_pktmbuf_free(fc->ready[i]);
+
+    memset(fc, 0, sizeof(*fc));
+}
+
+size_t
+frag_cache_footprint(void)
+{
+    return FRAG_ENTRIES * sizeof(struct frag_entry);
+}
+
+struct frag_entry *
+frag_cache_lookup(struct frag_cache *fc, const struct rte_ipv4_hdr *ip,
+                  uint32_t now, struct core_stats *stats)
+{
+    struct frag_entry *bucket = frag_bucket(fc, ip);
+
+    for (unsigned int w = 0; w < FRAG_CACHE_WAYS; w++) {
+        struct frag_entry *fe = &bucket[w];
+
+        if (!frag_match(fe, ip))
+            continue;
+
+        /* A stale entry may belong to an earlier datagram with this ID */
+        if (frag_expired(fc, fe, now)) {
+            frag_release(fe, stats);
+            return NULL;
+        }
+        return fe;
+    }
+
+    return NULL;
+}
+
+struct frag_entry *
+frag_cache_add(struct frag_cache *fc, const struct rte_ipv4_hdr *ip,
+               uint32_t now, struct core_stats *stats)
+{
+    struct frag_entry *bucket = frag_bucket(fc, ip);
+    struct frag_entry *fe = NULL;
+    uint32_t oldest_age = 0;
+
+    for (unsigned int w = 0; w < FRAG_CACHE_WAYS; w++) {
+        struct frag_entry *way = &bucket[w];
+
+        if (way->state == FRAG_FREE) {
+            fe = way;
+            break;
+        }
+        if (frag_expired(fc, way, now)) {
+            frag_release(way, stats);
+            fe = way;
+            break;
+        }
+
+        uint32_t age = now - way->last_active;
+        if (fe == NULL || age > oldest_age) {
+            fe = way;
+            oldest_age = age;
+        }
+    }
+
+    /* Bucket full of live datagrams: evict the least recently used */
+    if (fe->state != FRAG_FREE) {
+        if (fe->nb_held == 0)
+            stats->frag_evictions++;
+        frag_release(fe, stats);
+    }
+
+    fe->src_ip = ip->src_addr;
+    fe->dst_ip = ip->dst_addr;
+    fe->ip_id = ip->packet_id;
+    fe->protocol = ip->next_proto_id;
+    fe->state = FRAG_PENDING;
+    fe->nb_held = 0;
+    fe->last_active = now;
+    return fe;
+}
+
+void
+frag_cache_expire(struct frag_cache *fc, uint32_t now, unsigned int budget,
+                  struct core_stats *stats)
+{
+    for (unsigned int b = 0; b < budget; b++) {
+        struct frag_entry *bucket = &fc->entries[fc->sweep_cursor * FRAG_CACHE_WAYS];
+
+        for (unsigned int w = 0; w < FRAG_CACHE_WAYS; w++)
+            if (bucket[w].state != FRAG_FREE && frag_expired(fc, &bucket[w], now))
+                frag_release(&bucket[w], stats);
+
+        fc->sweep_cursor = (fc->sweep_cursor + 1) & (FRAG_CACHE_BUCKETS - 1);
+    }
+}
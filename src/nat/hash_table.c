@@ -0,0 +1,260 @@
+/* SPDX-License-Identifier: MIT */
+/**
+ * @file hash_table.c
+ * @brief Per-core session store: entry array plus index-valued hash tables
+ *
+ * The hash tables store a session index as their data pointer rather than
+ * the address of an allocator object, so the entry array can be a single
+ * flat allocation on the worker's NUMA node.
+ *
+ * Both tables are created for lock-free concurrent reads so that the
+ * control plane can walk them while the owning worker keeps adding and
+ * deleting keys. Deleted key slots are handed back through the data plane
+ * RCU once every reader has moved on.
+ */
+
+#include "nat_engine.h"
+#include "cgnat_types.h"
+#include <rte_common.h>
+#include <rte_hash.h>
+#include <rte_jhash.h>
+#include <rte_malloc.h>
+#include <rte_rcu_qsbr.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Slots per rte_hash bucket (RTE_HASH_BUCKET_ENTRIES, not exported) */
+#define HASH_BUCKET_ENTRIES 8
+
+/* Helper: Approximate hugepage memory of one rte_hash with flow_key keys */
+static size_t
+hash_footprint(uint32_t entries)
+{
+    /* Key store slot: data pointer + key, 16-byte aligned */
+    size_t key_slot = RTE_ALIGN(sizeof(void *) + sizeof(struct flow_key), 16);
+    size_t buckets = rte_align32pow2(entries) / HASH_BUCKET_ENTRIES;
+
+    return (size_t)(entries + 1) * key_slot +
+           buckets * RTE_CACHE_LINE_SIZE +
+           (size_t)rte_align32pow2(entries + 1) * sizeof(uint32_t);
+}
+
+/* Helper: Encode a session index as rte_hash data */
+static inline void *
+index_to_data(uint32_t idx)
+{
+    return (void *)(uintptr_t)idx;
+}
+
+/* Helper: Decode rte_hash data back to a session index */
+static inline uint32_t
+data_to_index(const void *data)
+{
+    return (uint32_t)(uintptr_t)data;
+}
+
+int
+session_table_init(struct session_table *st, unsigned int core_id,
+                   uint32_t capacity, unsigned int socket_id)
+{
+    char name[64];
+
+    memset(st, 0, sizeof(*st));
+    st->capacity = capacity;
+
+    /* Create outbound hash table (private -> session) */
+    snprintf(name, sizeof(name), "outbound_hash_%u", core_id);
+    struct rte_hash_parameters hash_params = {
+        .name = name,
+        .entries = capacity,
+        .key_len = sizeof(struct flow_key),
+        .hash_func = rte_jhash,
+        .hash_func_init_val = 0,
+        .socket_id = socket_id,
+        .extra_flag = RTE_HASH_EXTRA_FLAGS_RW_CONCURRENCY_LF,
+    };
+    st->outbound_hash = rte_hash_create(&hash_params);
+    if (!st->outbound_hash) {
+        printf("Failed to create outbound hash table on core %u\n", core_id);
+        goto fail;
+    }
+
+    /* Create inbound hash table (public -> session) */
+    snprintf(name, sizeof(name), "inbound_hash_%u", core_id);
+    hash_params.name = name;
+    st->inbound_hash = rte_hash_create(&hash_params);
+    if (!st->inbound_hash) {
+        printf("Failed to create inbound hash table on core %u\n", core_id);
+        goto fail;
+    }
+
+    /* Hot session array: two entries per cache line, no object headers */
+    snprintf(name, sizeof(name), "nat_sessions_%u", core_id);
+    st->entries = rte_zmalloc_socket(name,
+                                     (size_t)capacity * sizeof(struct nat_entry),
+                                     RTE_CACHE_LINE_SIZE, socket_id);
+    if (!st->entries) {
+        printf("Failed to allocate %u sessions on core %u\n", capacity, core_id);
+        goto fail;
+    }
+
+    /* Cold accounting, only written after the hot entry is resolved */
+    snprintf(name, sizeof(name), "nat_session_stats_%u", core_id);
+    st->stats = rte_zmalloc_socket(name,
+                                   (size_t)capacity * sizeof(struct nat_entry_stats),
+                                   RTE_CACHE_LINE_SIZE, socket_id);
+    if (!st->stats) {
+        printf("Failed to allocate session statistics on core %u\n", core_id);
+        goto fail;
+    }
+
+    snprintf(name, sizeof(name), "nat_session_free_%u", core_id);
+    st->free_list = rte_malloc_socket(name, (size_t)capacity * sizeof(uint32_t),
+                                      RTE_CACHE_LINE_SIZE, socket_id);
+    if (!st->free_list) {
+        printf("Failed to allocate session free list on core %u\n", core_id);
+        goto fail;
+    }
+
+    /* Low indices on top so a lightly loaded core stays cache-dense */
+    for (uint32_t i = 0; i < capacity; i++)
+        st->free_list[i] = capacity - 1 - i;
+    st->free_count = capacity;
+
+    return 0;
+
+fail:
+    session_table_free(st);
+    return -1;
+}
+
+void
+session_table_free(struct session_table *st)
+{
+    if (st->outbound_hash)
+        rte_hash_free(st->outbound_hash);
+    if (st->inbound_hash)
+        rte_hash_free(st->inbound_hash);
+    if (st->entries)
+        rte_free(st->entries);
+    if (st->stats)
+        rte_free(st->stats);
+    if (st->free_list)
+        rte_free(st->free_list);
+
+    memset(st, 0, sizeof(*st));
+}
+
+int
+session_table_attach_rcu(struct session_table *st, struct rte_rcu_qsbr *rcu)
+{
+    /* Deferred mode: the worker never waits on a reader in a delete */
+    struct rte_hash_rcu_config rcu_cfg = {
+        .v = rcu,
+        .mode = RTE_HASH_QSBR_MODE_DQ,
+    };
+
+    if (rte_hash_rcu_qsbr_add(st->outbound_hash, &rcu_cfg) != 0 ||
+        rte_hash_rcu_qsbr_add(st->inbound_hash, &rcu_cfg) != 0)
+        return -1;
+
+    return 0;
+}
+
+size_t
+session_table_footprint(const struct session_table *st)
+{
+    return (size_t)st->capacity * (sizeof(struct nat_entry) +
+                                   sizeof(struct nat_entry_stats) +
+                                   sizeof(uint32_t)) +
+           2 * hash_footprint(st->capacity);
+}
+
+int
+session_table_insert(struct session_table *st, uint32_t idx,
+                     const struct flow_key *out_key,
+                     const struct flow_key *in_key)
+{
+    if (rte_hash_add_key_data(st->outbound_hash, out_key, index_to_data(idx)) < 0)
+        return -1;
+
+    if (rte_hash_add_key_data(st->inbound_hash, in_key, index_to_data(idx)) < 0) {
+        rte_hash_del_key(st->outbound_hash, out_key);
+        return -1;
+    }
+
+    return 0;
+}
+
+void
+session_table_remove(struct session_table *st, const struct flow_key *out_key,
+                     const struct flow_key *in_key)
+{
+    rte_hash_del_key(st->outbound_hash, out_key);
+    rte_hash_del_key(st->inbound_hash, in_key);
+}
+
+struct nat_entry *
+session_table_lookup(const struct session_table *st,
+                     const struct rte_hash *hash, const struct flow_key *key)
+{
+    void *data;
+
+    if (rte_hash_lookup_data(hash, key, &data) < 0)
+        return NULL;
+
+    return &st->entries[data_to_index(data)];
+}
+
+void
+session_table_lookup_bulk(const struct session_table *st,
+                          const struct rte_hash *hash,
+                          const void **keys, uint32_t nb_keys,
+                          uint64_t *hit_mask, struct nat_entry **entries)
+{
+    void *data[RX_BURST_SIZE];
+    uint64_t hits = 0;
+
+    rte_hash_lookup_bulk_data(hash, keys, nb_keys, &hits, data);
+
+    for (uint32_t i = 0; i < nb_keys; i++)
+        if (hits & (1ULL << i))
+            entries[i] = &st->entries[data_to_index(data[i])];
+
+    *hit_mask = hits;
+}
+
+int
+session_table_walk(const struct session_table *st, uint32_t *pos,
+                   unsigned int max, session_walk_fn fn, void *arg)
+{
+    for (unsigned int i = 0; i < max; i++) {
+        const struct flow_key *key;
+        struct nat_entry_stats stats;
+        struct nat_entry entry;
+        void *data;
+        uint32_t idx;
+
+        if (rte_hash_iterate(st->outbound_hash, (const void **)&key,
+                             &data, pos) < 0)
+            return 0;
+
+        idx = data_to_index(data);
+        if (idx >= st->capacity)
+            continue;
+        entry = st->entries[idx];
+        stats = st->stats[idx];
+
+        /* The key slot outlives the grace period, the session slot may not */
+        if (entry.private_ip != key->src_ip || entry.remote_ip != key->dst_ip ||
+            entry.private_port != key->src_port ||
+            entry.remote_port != key->dst_port ||
+            entry.protocol != key->protocol)
+            continue;
+
+        fn(arg, &entry, &stats);
+    }
+
+    return 1;
+}
@@ -0,0 +1,269 @@
+/* SPDX-License-Identifier: MIT */
+/**
+ * @file params.c
+ * @brief Reloadable worker parameters (timeouts, limits, public IP pool)
+ *
+ * The control plane builds a complete, immutable parameter generation and
+ * publishes it with one pointer exchange. Each worker notices the new
+ * generation right after its RCU quiescent point and copies it into its
+ * own context, so the fast path keeps reading plain per-core fields. New
+ * public IPs need new port pools; those are allocated here, on the
+ * worker's node, and the worker only swaps table pointers.
+ */
+
+#include "nat_engine.h"
+#include "cgnat_types.h"
+#include <rte_common.h>
+#include <rte_cycles.h>
+#include <rte_malloc.h>
+#include <rte_rcu_qsbr.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+uint8_t
+nat_session_clock_shift(uint64_t hz)
+{
+    uint8_t shift = 0;
+
+    while ((hz >> (shift + 1)) >= SESSION_CLOCK_HZ)
+        shift++;
+    return shift;
+}
+
+void
+nat_params_derive(struct nat_params *params, const struct cgnat_config *config)
+{
+    uint64_t hz = rte_get_tsc_hz();
+    uint8_t clock_shift = nat_session_clock_shift(hz);
+
+    /* Session timeouts, converted to TSC cycles */
+    params->timeout_cycles[NAT_STATE_CLOSED] = TIMEOUT_TCP_RST * hz;
+    params->timeout_cycles[NAT_STATE_SYN_SENT] = config->timeout_tcp_syn * hz;
+    params->timeout_cycles[NAT_STATE_ESTABLISHED] = config->timeout_tcp_established * hz;
+    params->timeout_cycles[NAT_STATE_FIN_WAIT] = config->timeout_tcp_fin * hz;
+    params->timeout_cycles[NAT_STATE_CLOSING] = config->timeout_tcp_fin * hz;
+    params->timeout_cycles[NAT_STATE_TIME_WAIT] = config->timeout_tcp_fin * hz;
+    params->timeout_cycles[NAT_STATE_UDP_ACTIVE] = config->timeout_udp * hz;
+    params->timeout_cycles[NAT_STATE_ICMP_ACTIVE] = config->timeout_icmp * hz;
+
+    params->max_sessions_per_subscriber = config->max_sessions_per_customer;
+    params->policer_mark = config->bandwidth_mark;
+
+    /* Policer: Mbit/s to bytes per session clock unit */
+    params->policer_rate = 0;
+    params->policer_depth = 0;
+    if (config->max_bandwidth_mbps != 0) {
+        uint64_t bytes_per_sec = (uint64_t)config->max_bandwidth_mbps * 1000000 / 8;
+
+        params->policer_rate = RTE_MAX(bytes_per_sec / (hz >> clock_shift), 1);
+        params->policer_depth = RTE_MIN(bytes_per_sec * POLICER_BURST_MS / 1000,
+                                        (uint64_t)UINT32_MAX);
+    }
+}
+
+/* Helper: Index of a public IP in the first n slots, or -1 */
+static int
+find_public_ip(const uint32_t *ips, int n, uint32_t ip)
+{
+    for (int i = 0; i < n; i++)
+        if (ips[i] == ip)
+            return i;
+    return -1;
+}
+
+/* Helper: Give each worker a pool table extended by the added addresses */
+static int
+build_pool_sets(struct nat_params *params, const struct cgnat_config *config,
+                const struct nat_core_ctx *cores)
+{
+    bool symmetric = (config->rss.mode == RSS_MODE_SYMMETRIC);
+    int n = params->num_public_ips;
+
+    params->pools = calloc(params->num_workers, sizeof(*params->pools));
+    if (!params->pools)
+        return -1;
+
+    for (unsigned int w = 0; w < params->num_workers; w++) {
+        const struct nat_core_ctx *ctx = &cores[w];
+        struct nat_pool_set *set = &params->pools[w];
+
+        set->port_pools = rte_zmalloc_socket("port_pool_table",
+                                             n * sizeof(struct port_pool *),
+                                             RTE_CACHE_LINE_SIZE, ctx->socket_id);
+        set->public_ips = rte_malloc_socket("public_ips", n * sizeof(uint32_t),
+                                            RTE_CACHE_LINE_SIZE, ctx->socket_id);
+        if (!set->port_pools || !set->public_ips)
+            return -1;
+
+        /* Existing pools are shared: only the worker ever writes them */
+        memcpy(set->port_pools, ctx->port_pools,
+               params->first_added * sizeof(struct port_pool *));
+        memcpy(set->public_ips, params->public_ips, n * sizeof(uint32_t));
+
+        for (int i = params->first_added; i < n; i++) {
+            set->port_pools[i] = port_pool_create(params->public_ips[i],
+                                                  config->port_block_size,
+                                                  symmetric ? NULL :
+                                                  &config->port_partition,
+                                                  w, ctx->socket_id);
+            if (!set->port_pools[i])
+                return -1;
+        }
+    }
+
+    return 0;
+}
+
+struct nat_params *
+nat_params_create(const struct cgnat_config *config,
+                  const struct nat_params *prev,
+                  const struct nat_core_ctx *cores, uint32_t generation)
+{
+    int max = (prev ? prev->num_public_ips : 0) + config->num_public_ips;
+    struct nat_params *params = calloc(1, sizeof(*params));
+    int n = 0;
+
+    if (!params)
+        return NULL;
+
+    params->generation = generation;
+    params->num_workers = config->num_workers;
+    params->public_ips = malloc(max * sizeof(uint32_t));
+    params->draining = calloc(max, sizeof(bool));
+    params->ip_pools = calloc(max, sizeof(uint16_t));
+    if (!params->public_ips || !params->draining || !params->ip_pools)
+        goto fail;
+
+    nat_params_derive(params, config);
+
+    /* Known addresses keep their pool index; removed ones drain */
+    if (prev) {
+        memcpy(params->public_ips, prev->public_ips,
+               prev->num_public_ips * sizeof(uint32_t));
+        n = prev->num_public_ips;
+        for (int i = 0; i < n; i++) {
+            int j = find_public_ip(config->public_ips, config->num_public_ips,
+                                   params->public_ips[i]);
+
+            params->draining[i] = (j < 0);
+            params->ip_pools[i] = (j < 0) ? prev->ip_pools[i] :
+                                            config->public_ip_pools[j];
+        }
+    }
+    params->first_added = n;
+
+    for (int i = 0; i < config->num_public_ips; i++) {
+        if (find_public_ip(params->public_ips, n, config->public_ips[i]) < 0) {
+            params->public_ips[n] = config->public_ips[i];
+            params->ip_pools[n++] = config->public_ip_pools[i];
+        }
+    }
+    params->num_public_ips = n;
+
+    if (n > MAX_PUBLIC_IPS) {
+        fprintf(stderr, "Error: %d public IPs including draining ones (max %d); "
+                "restart to drop removed addresses\n", n, MAX_PUBLIC_IPS);
+        goto fail;
+    }
+
+    if (prev && n > params->first_added &&
+        build_pool_sets(params, config, cores) < 0) {
+        fprintf(stderr, "Error: Cannot allocate port pools for %d new public IPs\n",
+                n - params->first_added);
+        goto fail;
+    }
+
+    return params;
+
+fail:
+    nat_params_free(params);
+    return NULL;
+}
+
+void
+nat_params_free(struct nat_params *params)
+{
+    if (!params)
+        return;
+
+    if (params->pools) {
+        for (unsigned int w = 0; w < params->num_workers; w++) {
+            struct nat_pool_set *set = &params->pools[w];
+
+            /* Never adopted: the added pools are still ours */
+            if (!set->adopted && set->port_pools)
+                for (int i = params->first_added; i < params->num_public_ips; i++)
+                    rte_free(set->port_pools[i]);
+            rte_free(set->port_pools);
+            rte_free(set->public_ips);
+        }
+        free(params->pools);
+    }
+
+    free(params->public_ips);
+    free(params->draining);
+    free(params->ip_pools);
+    free(params);
+}
+
+void
+nat_params_apply(struct nat_core_ctx *ctx, struct nat_params *params)
+{
+    if (params->pools) {
+        struct nat_pool_set *set = &params->pools[ctx->worker_id];
+        struct port_pool **pools = set->port_pools;
+        uint32_t *ips = set->public_ips;
+
+        /* Old tables go back to params; the pools themselves carry over */
+        set->port_pools = ctx->port_pools;
+        set->public_ips = ctx->public_ips;
+        set->adopted = true;
+        ctx->port_pools = pools;
+        ctx->public_ips = ips;
+        ctx->num_public_ips = params->num_public_ips;
+    }
+
+    /* Customer pools follow the new layout */
+    if (params->draining) {
+        for (int i = 0; i < ctx->num_public_ips; i++) {
+            ctx->port_pools[i]->draining = params->draining[i];
+            ctx->port_pools[i]->ip_pool = params->ip_pools[i];
+        }
+        nat_ip_pools_build(ctx);
+    }
+
+    /* Shortened timeouts apply when a session's wheel slot next fires */
+    memcpy(ctx->timeout_cycles, params->timeout_cycles,
+           sizeof(ctx->timeout_cycles));
+    ctx->max_sessions_per_subscriber = params->max_sessions_per_subscriber;
+    ctx->policer_rate = params->policer_rate;
+    ctx->policer_depth = params->policer_depth;
+    ctx->policer_mark = params->policer_mark;
+
+    ctx->params_generation = params->generation;
+
+    /* Before the next quiescent point: the old table is not read after it */
+    nat_stats_publish(ctx);
+}
+
+void
+nat_params_swap(struct nat_params_stage *stage, struct nat_params *params,
+                struct rte_rcu_qsbr *rcu)
+{
+    struct nat_params *old;
+
+    old = __atomic_exchange_n(&stage->active, params, __ATOMIC_ACQ_REL);
+
+    /*
+     * After one grace period every worker's next check sees the new
+     * pointer; after the second, that check and the adoption it started
+     * have completed, so nothing references old and the next generation
+     * may be built from the workers' pool tables.
+     */
+    if (rcu) {
+        rte_rcu_qsbr_synchronize(rcu, RTE_QSBR_THRID_INVALID);
+        rte_rcu_qsbr_synchronize(rcu, RTE_QSBR_THRID_INVALID);
+    }
+    nat_params_free(old);
+}
@@ -0,0 +1,222 @@
+/* SPDX-License-Identifier: MIT */
+/**
+ * @file port_pool.c
+ * @brief Public port allocation (per-session bitmap or per-customer blocks)
+ *
+ * In dynamic mode every session scans the bitmap for a free port. In block
+ * mode a customer leases a contiguous block of ports on one public IP and
+ * its sessions are served from that block's slice of the same bitmap, so
+ * allocation touches at most block_size / 64 words and compliance logging
+ * needs one record per block instead of one per session.
+ *
+ * Each worker only ever hands out ports from its own slices of the range
+ * (see struct port_partition), so pools on different cores never collide.
+ */
+
+#include "nat_engine.h"
+#include "cgnat_types.h"
+#include <rte_malloc.h>
+#include <string.h>
+
+void
+port_partition_init(struct port_partition *part, uint16_t block_size,
+                    unsigned int num_workers)
+{
+    /* Slices are whole blocks in block mode, one bitmap word otherwise */
+    part->shift = block_size ? __builtin_ctz(block_size) : 6;
+    part->num_slices = 1;
+    while (part->num_slices < num_workers)
+        part->num_slices <<= 1;
+    part->num_workers = num_workers;
+}
+
+void
+port_pool_init(struct port_pool *pool, uint32_t public_ip, uint16_t block_size,
+               const struct port_partition *part, unsigned int worker_id)
+{
+    memset(pool, 0, sizeof(*pool));
+    pool->public_ip = public_ip;
+    pool->cursor = PORT_RANGE_START;
+    rte_atomic32_init(&pool->exhaustion_events);
+    
+    /* Ports owned by other workers are marked permanently allocated */
+    for (uint32_t w = 0; w < PORTS_PER_IP / 64; w++) {
+        uint16_t port = PORT_RANGE_START + w * 64;
+        if (part == NULL || port_partition_owner(part, port) == worker_id)
+            pool->ports_owned += 64;
+        else
+            pool->bitmap[w] = ~0ULL;
+    }
+    
+    if (block_size == 0)
+        return;
+    
+    /* Trailing ports that do not fill a whole block are never handed out */
+    pool->block_size = block_size;
+    pool->num_blocks = PORTS_PER_IP / block_size;
+    
+    /* Stack of free owned blocks, lowest port range on top */
+    for (int b = pool->num_blocks - 1; b >= 0; b--) {
+        pool->blocks[b].owner = 0;
+        pool->blocks[b].in_use = 0;
+        if (part == NULL ||
+            port_partition_owner(part, PORT_RANGE_START + b * block_size) == worker_id)
+            pool->free_blocks[pool->free_block_count++] = b;
+    }
+}
+
+struct port_pool *
+port_pool_create(uint32_t public_ip, uint16_t block_size,
+                 const struct port_partition *part, unsigned int worker_id,
+                 unsigned int socket_id)
+{
+    struct port_pool *pool = rte_malloc_socket("port_pool", sizeof(*pool),
+                                               RTE_CACHE_LINE_SIZE, socket_id);
+    
+    if (pool)
+        port_pool_init(pool, public_ip, block_size, part, worker_id);
+    return pool;
+}
+
+/* Port pool management */
+uint16_t
+port_pool_alloc(struct port_pool *pool)
+{
+    if (pool->draining)
+        return 0;
+    
+    const uint16_t words = PORTS_PER_IP / 64;
+    uint16_t start = pool->cursor - PORT_RANGE_START;
+    uint16_t start_word = start / 64;
+    uint64_t free_bits;
+    uint16_t w = start_word;
+    
+    /* Scan whole words from the cursor with wraparound */
+    free_bits = ~pool->bitmap[w] & (~0ULL << (start % 64));
+    for (uint16_t i = 0; free_bits == 0 && i < words; i++) {
+        w = (w + 1 == words) ? 0 : w + 1;
+        free_bits = ~pool->bitmap[w];
+        if (w == start_word)
+            free_bits &= (1ULL << (start % 64)) - 1;
+    }
+    
+    if (free_bits == 0) {
+        /* Pool exhausted */
+        rte_atomic32_inc(&pool->exhaustion_events);
+        return 0;
+    }
+    
+    uint16_t bit_idx = __builtin_ctzll(free_bits);
+    uint16_t idx = w * 64 + bit_idx;
+    
+    pool->bitmap[w] |= (1ULL << bit_idx);
+    pool->ports_allocated++;
+    pool->cursor = (idx + 1 == PORTS_PER_IP) ? PORT_RANGE_START
+                                              : PORT_RANGE_START + idx + 1;
+    return PORT_RANGE_START + idx;
+}
+
+void
+port_pool_free(struct port_pool *pool, uint16_t port)
+{
+    if (port < PORT_RANGE_START || port > PORT_RANGE_END)
+        return;
+    
+    uint16_t idx = port - PORT_RANGE_START;
+    uint16_t word_idx = idx / 64;
+    uint16_t bit_idx = idx % 64;
+    
+    pool->bitmap[word_idx] &= ~(1ULL << bit_idx);
+    pool->ports_allocated--;
+    
+    if (pool->block_size)
+        pool->blocks[idx / pool->block_size].in_use--;
+}
+
+bool
+port_pool_claim(struct port_pool *pool, uint16_t port)
+{
+    uint16_t idx = port - PORT_RANGE_START;
+    uint16_t word_idx = idx / 64;
+    uint16_t bit_idx = idx % 64;
+    
+    if (pool->bitmap[word_idx] & (1ULL << bit_idx))
+        return false;
+    
+    pool->bitmap[word_idx] |= (1ULL << bit_idx);
+    pool->ports_allocated++;
+    return true;
+}
+
+bool
+port_pool_is_allocated(const struct port_pool *pool, uint16_t port)
+{
+    if (port < PORT_RANGE_START || port > PORT_RANGE_END)
+        return false;
+    
+    uint16_t idx = port - PORT_RANGE_START;
+    uint16_t word_idx = idx / 64;
+    uint16_t bit_idx = idx % 64;
+    
+    return (pool->bitmap[word_idx] & (1ULL << bit_idx)) != 0;
+}
+
+/* Port block management */
+int
+port_block_lease(struct port_pool *pool, uint32_t owner)
+{
+    if (pool->draining)
+        return -1;
+    
+    if (pool->free_block_count == 0) {
+        rte_atomic32_inc(&pool->exhaustion_events);
+        return -1;
+    }
+    
+    uint16_t block = pool->free_blocks[--pool->free_block_count];
+    
+    pool->blocks[block].owner = owner;
+    pool->blocks[block].in_use = 0;
+    return block;
+}
+
+uint16_t
+port_block_alloc(struct port_pool *pool, uint16_t block)
+{
+    uint16_t words = pool->block_size / 64;
+    uint16_t first_word = (block * pool->block_size) / 64;
+    
+    for (uint16_t w = first_word; w < first_word + words; w++) {
+        uint64_t free_bits = ~pool->bitmap[w];
+        if (free_bits == 0)
+            continue;
+        
+        uint16_t bit_idx = __builtin_ctzll(free_bits);
+        pool->bitmap[w] |= (1ULL << bit_idx);
+        pool->ports_allocated++;
+        pool->blocks[block].in_use++;
+        return PORT_RANGE_START + w * 64 + bit_idx;
+    }
+    
+    /* Block exhausted */
+    return 0;
+}
+
+void
+port_block_release(struct port_pool *pool, uint16_t block)
+{
+    pool->blocks[block].owner = 0;
+    pool->free_blocks[pool->free_block_count++] = block;
+}
+
+uint16_t
+port_block_index(const struct port_pool *pool, uint16_t port)
+{
+    return (port - PORT_RANGE_START) / pool->block_size;
+}
+
+uint16_t
+port_block_first(const struct port_pool *pool, uint16_t block)
+{
+    return PORT_RANGE_START + block * pool->block_size;
+}
@@ -0,0 +1,212 @@
+/* SPDX-License-Identifier: MIT */
+/**
+ * @file timer_wheel.c
+ * @brief Hierarchical timer wheel for NAT session aging
+ *
+ * Level 0 has TW_L0_SLOTS slots of one tick each, level 1 has TW_L1_SLOTS
+ * slots of TW_L0_SLOTS ticks each. When level 0 wraps, the matching level 1
+ * slot is cascaded down. Entries are re-evaluated lazily when their slot
+ * fires, so refreshing a session never touches the wheel. Slots are doubly
+ * linked chains of session indices (nat_entry.next/prev), which lets a
+ * session whose timeout shrinks be moved to an earlier slot in O(1).
+ */
+
+#include "nat_engine.h"
+#include "cgnat_types.h"
+#include <string.h>
+
+#define TW_L0_MASK  (TW_L0_SLOTS - 1)
+#define TW_L1_MASK  (TW_L1_SLOTS - 1)
+
+void
+timer_wheel_init(struct timer_wheel *tw, struct nat_entry *entries,
+                 uint64_t cycles_per_tick, uint64_t now_tsc)
+{
+    memset(tw, 0, sizeof(*tw));
+    tw->entries = entries;
+    tw->cascade = SESSION_INDEX_NONE;
+    tw->pending = SESSION_INDEX_NONE;
+    for (uint32_t i = 0; i < TW_L0_SLOTS; i++)
+        tw->l0[i] = SESSION_INDEX_NONE;
+    for (uint32_t i = 0; i < TW_L1_SLOTS; i++)
+        tw->l1[i] = SESSION_INDEX_NONE;
+    tw->cycles_per_tick = cycles_per_tick;
+    tw->current_tick = now_tsc / cycles_per_tick;
+    tw->next_tick_tsc = (tw->current_tick + 1) * cycles_per_tick;
+}
+
+uint64_t
+timer_wheel_tsc_to_tick(const struct timer_wheel *tw, uint64_t tsc)
+{
+    return (tsc + tw->cycles_per_tick - 1) / tw->cycles_per_tick;
+}
+
+/* Helper: Link field that a back-link reference points at */
+static inline uint32_t *
+tw_link(struct timer_wheel *tw, uint32_t ref)
+{
+    if (ref < TW_REF_BASE)
+        return &tw->entries[ref].next;
+    if (ref == TW_REF_PENDING)
+        return &tw->pending;
+    if (ref == TW_REF_CASCADE)
+        return &tw->cascade;
+    if (ref & (1U << TW_L0_BITS))
+        return &tw->l1[ref & TW_L1_MASK];
+    return &tw->l0[ref & TW_L0_MASK];
+}
+
+/* Helper: Push session onto the list headed by *head (reference ref) */
+static inline void
+tw_push(struct timer_wheel *tw, uint32_t *head, uint32_t ref, uint32_t idx)
+{
+    struct nat_entry *entry = &tw->entries[idx];
+
+    entry->next = *head;
+    entry->prev = ref;
+    if (*head != SESSION_INDEX_NONE)
+        tw->entries[*head].prev = idx;
+    *head = idx;
+}
+
+/* Helper: Pop the first session of a non-empty list */
+static inline uint32_t
+tw_pop(struct timer_wheel *tw, uint32_t *head, uint32_t ref)
+{
+    uint32_t idx = *head;
+
+    *head = tw->entries[idx].next;
+    if (*head != SESSION_INDEX_NONE)
+        tw->entries[*head].prev = ref;
+    return idx;
+}
+
+/* Helper: Take over a whole slot list under a new head */
+static inline void
+tw_splice(struct timer_wheel *tw, uint32_t *from, uint32_t *to, uint32_t ref)
+{
+    *to = *from;
+    *from = SESSION_INDEX_NONE;
+    if (*to != SESSION_INDEX_NONE)
+        tw->entries[*to].prev = ref;
+}
+
+/* Helper: Link session into the slot covering its deadline */
+static inline void
+tw_insert(struct timer_wheel *tw, uint32_t idx, uint64_t deadline)
+{
+    uint32_t slot;
+
+    if (deadline <= tw->current_tick) {
+        /* Already due: current slot if not yet pulled, else this pass */
+        if (tw->pull_pending) {
+            slot = tw->current_tick & TW_L0_MASK;
+            tw_push(tw, &tw->l0[slot], TW_REF_SLOT(0, slot), idx);
+        } else {
+            tw_push(tw, &tw->pending, TW_REF_PENDING, idx);
+        }
+        return;
+    }
+
+    if (deadline - tw->current_tick < TW_L0_SLOTS) {
+        slot = deadline & TW_L0_MASK;
+        tw_push(tw, &tw->l0[slot], TW_REF_SLOT(0, slot), idx);
+        return;
+    }
+
+    /* Clamp to the wheel horizon; the entry is re-evaluated on cascade */
+    if ((deadline >> TW_L0_BITS) - (tw->current_tick >> TW_L0_BITS) >= TW_L1_SLOTS)
+        deadline = ((tw->current_tick >> TW_L0_BITS) + TW_L1_SLOTS - 1) << TW_L0_BITS;
+
+    slot = (deadline >> TW_L0_BITS) & TW_L1_MASK;
+    tw_push(tw, &tw->l1[slot], TW_REF_SLOT(1, slot), idx);
+}
+
+void
+timer_wheel_add(struct timer_wheel *tw, uint32_t idx, uint64_t deadline_tick)
+{
+    tw_insert(tw, idx, deadline_tick);
+    tw->num_timers++;
+}
+
+void
+timer_wheel_reschedule(struct timer_wheel *tw, uint32_t idx,
+                       uint64_t deadline_tick)
+{
+    struct nat_entry *entry = &tw->entries[idx];
+
+    /* Unlink from whichever list holds it */
+    *tw_link(tw, entry->prev) = entry->next;
+    if (entry->next != SESSION_INDEX_NONE)
+        tw->entries[entry->next].prev = entry->prev;
+
+    tw_insert(tw, idx, deadline_tick);
+}
+
+int
+timer_wheel_advance(struct timer_wheel *tw, uint64_t now_tsc,
+                    unsigned int budget,
+                    timer_wheel_deadline_fn deadline_fn,
+                    timer_wheel_expire_fn expire_fn, void *arg)
+{
+    struct nat_entry *entry;
+    uint32_t idx;
+    int expired = 0;
+
+    /* Fast exit: nothing in progress and next tick not due yet */
+    if (tw->cascade == SESSION_INDEX_NONE &&
+        tw->pending == SESSION_INDEX_NONE && !tw->pull_pending &&
+        now_tsc < tw->next_tick_tsc)
+        return 0;
+
+    while (budget > 0) {
+        /* Redistribute level 1 slot before evaluating level 0 */
+        if (tw->cascade != SESSION_INDEX_NONE) {
+            idx = tw_pop(tw, &tw->cascade, TW_REF_CASCADE);
+            tw_insert(tw, idx, deadline_fn(&tw->entries[idx], arg));
+            budget--;
+            continue;
+        }
+
+        if (tw->pull_pending) {
+            uint32_t slot = tw->current_tick & TW_L0_MASK;
+            tw_splice(tw, &tw->l0[slot], &tw->pending, TW_REF_PENDING);
+            tw->pull_pending = false;
+        }
+
+        if (tw->pending != SESSION_INDEX_NONE) {
+            idx = tw_pop(tw, &tw->pending, TW_REF_PENDING);
+            entry = &tw->entries[idx];
+            budget--;
+
+            uint64_t deadline = deadline_fn(entry, arg);
+            if (deadline > tw->current_tick) {
+                /* Refreshed since it was scheduled */
+                tw_insert(tw, idx, deadline);
+                continue;
+            }
+
+            entry->next = SESSION_INDEX_NONE;
+            entry->prev = SESSION_INDEX_NONE;
+            tw->num_timers--;
+            expire_fn(entry, arg);
+            expired++;
+            continue;
+        }
+
+        /* Current tick fully processed - step to the next if due */
+        if (now_tsc < tw->next_tick_tsc)
+            break;
+
+        tw->current_tick++;
+        tw->next_tick_tsc += tw->cycles_per_tick;
+
+        if ((tw->current_tick & TW_L0_MASK) == 0) {
+            uint32_t slot = (tw->current_tick >> TW_L0_BITS) & TW_L1_MASK;
+            tw_splice(tw, &tw->l1[slot], &tw->cascade, TW_REF_CASCADE);
+        }
+        tw->pull_pending = true;
+    }
+
+    return expired;
+}
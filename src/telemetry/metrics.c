@@ -5,13 +5,57 @@
  */
 
 #include "telemetry.h"
+#include "nat_engine.h"
+#include <rte_common.h>
 #include <rte_cycles.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
 
 static uint64_t tsc_hz = 0;
 
+/* core_stats counters exported per core as cgnat_core_<name>{core="N"} */
+static const struct {
+    const char *name;
+    const char *help;
+    size_t offset;
+} core_counters[] = {
+#define CORE_COUNTER(name, field, help) { name, help, offsetof(struct core_stats, field) }
+    CORE_COUNTER("packets_received_total", packets_rx, "Packets received"),
+    CORE_COUNTER("packets_transmitted_total", packets_tx, "Packets transmitted"),
+    CORE_COUNTER("packets_dropped_total", packets_dropped, "Packets dropped"),
+    CORE_COUNTER("bytes_received_total", bytes_rx, "Bytes received"),
+    CORE_COUNTER("bytes_transmitted_total", bytes_tx, "Bytes transmitted"),
+    CORE_COUNTER("nat_sessions_created_total", nat_created, "NAT sessions created"),
+    CORE_COUNTER("nat_sessions_expired_total", nat_expired, "NAT sessions expired"),
+    CORE_COUNTER("nat_lookup_hits_total", nat_lookup_hit, "Session lookups that hit"),
+    CORE_COUNTER("nat_lookup_misses_total", nat_lookup_miss, "Session lookups that missed"),
+    CORE_COUNTER("port_allocations_total", port_alloc_success, "Public ports allocated"),
+    CORE_COUNTER("port_allocation_failures_total", port_alloc_fail, "Port allocation failures"),
+    CORE_COUNTER("ports_freed_total", port_freed, "Public ports freed"),
+    CORE_COUNTER("port_blocks_allocated_total", port_blocks_allocated, "Port blocks leased"),
+    CORE_COUNTER("port_blocks_freed_total", port_blocks_freed, "Port blocks released"),
+    CORE_COUNTER("handoff_transmitted_total", handoff_tx, "Packets handed to the owning core"),
+    CORE_COUNTER("handoff_received_total", handoff_rx, "Packets handed over by other cores"),
+    CORE_COUNTER("handoff_dropped_total", handoff_dropped, "Handoffs dropped, owner's ring full"),
+    CORE_COUNTER("icmp_errors_translated_total", icmp_errors_translated, "ICMP errors translated"),
+    CORE_COUNTER("fragment_hits_total", frag_hits, "Later fragments matched to their first"),
+    CORE_COUNTER("fragment_misses_total", frag_misses, "Later fragments that arrived first"),
+    CORE_COUNTER("fragment_evictions_total", frag_evictions, "Fragment cache evictions"),
+    CORE_COUNTER("errors_no_memory_total", errors_no_memory, "Session allocation failures"),
+    CORE_COUNTER("errors_invalid_packet_total", errors_invalid_packet, "Unparsable or unclassified packets"),
+    CORE_COUNTER("errors_no_ports_total", errors_no_ports, "Sessions refused for lack of ports"),
+    CORE_COUNTER("errors_session_limit_total", errors_session_limit, "Sessions refused by the per-customer limit"),
+    CORE_COUNTER("policer_dropped_total", policer_dropped, "Over-rate packets dropped"),
+    CORE_COUNTER("policer_marked_total", policer_marked, "Over-rate packets marked"),
+    CORE_COUNTER("acl_denied_total", acl_denied, "Outbound packets denied by the ACL"),
+    CORE_COUNTER("neighbor_unresolved_total", neighbor_unresolved, "Packets dropped, next hop unresolved"),
+    CORE_COUNTER("log_events_total", events_logged, "NAT events queued for the event log"),
+    CORE_COUNTER("log_events_dropped_total", events_dropped, "NAT events dropped, event ring full"),
+#undef CORE_COUNTER
+};
+
 int
 telemetry_init(const struct cgnat_config *config)
 {
@@ -20,20 +64,97 @@ telemetry_init(const struct cgnat_config *config)
     return 0;
 }
 
+/* Helper: Exclusive upper bound of a latency bucket in cycles, 0 if none */
+static uint64_t
+latency_bucket_limit(unsigned int b)
+{
+    unsigned int e, s;
+    
+    if (b == 0)
+        return 1ULL << LAT_HIST_MIN_SHIFT;
+    if (b >= LAT_HIST_BUCKETS - 1)
+        return 0;
+    
+    e = LAT_HIST_MIN_SHIFT + ((b - 1) >> LAT_HIST_SUB_BITS);
+    s = (b - 1) & ((1U << LAT_HIST_SUB_BITS) - 1);
+    return (1ULL << e) + ((uint64_t)(s + 1) << (e - LAT_HIST_SUB_BITS));
+}
+
+/* Helper: Upper bound in cycles of the bucket holding quantile q, 0 if none */
+static uint64_t
+latency_quantile(const struct latency_hist *hists, int n, double q)
+{
+    uint64_t total = 0, seen = 0, rank;
+    
+    for (int d = 0; d < n; d++)
+        for (unsigned int b = 0; b < LAT_HIST_BUCKETS; b++)
+            total += hists[d].buckets[b];
+    if (total == 0)
+        return 0;
+    
+    rank = (uint64_t)(q * total);
+    for (unsigned int b = 0; b < LAT_HIST_BUCKETS; b++) {
+        for (int d = 0; d < n; d++)
+            seen += hists[d].buckets[b];
+        if (seen > rank)
+            return b < LAT_HIST_BUCKETS - 1 ? latency_bucket_limit(b) :
+                                              1ULL << LAT_HIST_MAX_SHIFT;
+    }
+    return 0;
+}
+
+/* Helper: Sum one worker's port pools into the per-public-IP detail */
+static void
+aggregate_port_pools(const struct nat_core_ctx *ctx,
+                     struct cgnat_detail_stats *detail)
+{
+    struct port_pool *const *pools;
+    int n = nat_get_port_pools(ctx, &pools);
+    
+    /* Pool indices are the same on every worker */
+    for (int i = 0; i < n && i < MAX_PUBLIC_IPS; i++) {
+        const struct port_pool *pool = pools[i];
+        struct public_ip_stats *ip = &detail->public_ips[i];
+        
+        /* Written by the worker as it runs: a recent value, not a snapshot */
+        ip->public_ip = pool->public_ip;
+        ip->ports_allocated += __atomic_load_n(&pool->ports_allocated,
+                                               __ATOMIC_RELAXED);
+        ip->exhaustion_events += rte_atomic32_read(&pool->exhaustion_events);
+        ip->draining = __atomic_load_n(&pool->draining, __ATOMIC_RELAXED);
+    }
+    if (n > detail->num_public_ips)
+        detail->num_public_ips = RTE_MIN(n, MAX_PUBLIC_IPS);
+}
+
 void
 telemetry_aggregate_stats(const struct nat_core_ctx *cores,
                           unsigned int num_cores,
-                          struct cgnat_global_stats *global_stats)
+                          struct cgnat_global_stats *global_stats,
+                          struct cgnat_detail_stats *detail)
 {
     memset(global_stats, 0, sizeof(*global_stats));
+    if (detail) {
+        uint32_t threshold = detail->port_alert_threshold;
+        
+        memset(detail, 0, sizeof(*detail));
+        detail->port_alert_threshold = threshold;
+        detail->num_cores = RTE_MIN(num_cores, MAX_CORES);
+    }
     
     uint64_t total_latency_sum = 0;
     uint64_t total_latency_count = 0;
-    uint64_t max_latency_cycles = 0;
     
-    /* Aggregate from all cores */
+    /* Aggregate the snapshots the workers published */
     for (unsigned int i = 0; i < num_cores; i++) {
-        const struct core_stats *stats = &cores[i].stats;
+        struct core_stats snapshot;
+        const struct core_stats *stats = &snapshot;
+        
+        nat_get_stats(&cores[i], &snapshot);
+        if (detail && i < MAX_CORES) {
+            detail->cores[i] = snapshot;
+            aggregate_port_pools(&cores[i], detail);
+        }
         
         global_stats->total_packets_rx += stats->packets_rx;
         global_stats->total_packets_tx += stats->packets_tx;
@@ -45,11 +166,17 @@ telemetry_aggregate_stats(const struct nat_core_ctx *cores,
         global_stats->total_nat_expired += stats->nat_expired;
         global_stats->total_port_alloc_fail += stats->port_alloc_fail;
         
-        total_latency_sum += stats->latency_sum;
-        total_latency_count += stats->latency_count;
-        
-        if (stats->latency_max > max_latency_cycles)
-            max_latency_cycles = stats->latency_max;
+        /* Histograms of all cores add up bucket by bucket */
+        for (int d = 0; d < NAT_DIRS; d++) {
+            struct latency_hist *h = &global_stats->latency[d];
+            
+            for (unsigned int b = 0; b < LAT_HIST_BUCKETS; b++) {
+                h->buckets[b] += stats->latency[d].buckets[b];
+                total_latency_count += stats->latency[d].buckets[b];
+            }
+            h->sum += stats->latency[d].sum;
+            total_latency_sum += stats->latency[d].sum;
+        }
     }
     
     /* Calculate active sessions (created - expired) */
@@ -59,8 +186,10 @@ telemetry_aggregate_stats(const struct nat_core_ctx *cores,
     /* Convert latency from TSC cycles to microseconds */
     if (total_latency_count > 0 && tsc_hz > 0) {
         double avg_cycles = (double)total_latency_sum / total_latency_count;
+        uint64_t p99_cycles = latency_quantile(global_stats->latency, NAT_DIRS, 0.99);
+        
         global_stats->avg_latency_us = (avg_cycles * 1000000.0) / tsc_hz;
-        global_stats->max_latency_us = (max_latency_cycles * 1000000) / tsc_hz;
+        global_stats->p99_latency_us = (p99_cycles * 1000000.0) / tsc_hz;
     }
     
     global_stats->timestamp = time(NULL);
@@ -68,12 +197,15 @@ telemetry_aggregate_stats(const struct nat_core_ctx *cores,
 
 int
 telemetry_export_prometheus(const struct cgnat_global_stats *global_stats,
+                            const struct cgnat_detail_stats *detail,
                             char *buffer, size_t buf_size)
 {
     int offset = 0;
     
+    /* Once the buffer is full, only the length keeps growing */
     #define APPEND(fmt, ...) do { \
-        int n = snprintf(buffer + offset, buf_size - offset, fmt, ##__VA_ARGS__); \
+        size_t room = (size_t)offset < buf_size ? buf_size - offset : 0; \
+        int n = snprintf(room ? buffer + offset : NULL, room, fmt, ##__VA_ARGS__); \
         if (n > 0) offset += n; \
     } while (0)
     
@@ -113,14 +245,105 @@ telemetry_export_prometheus(const struct cgnat_global_stats *global_stats,
     APPEND("# TYPE cgnat_port_allocation_failures_total counter\n");
     APPEND("cgnat_port_allocation_failures_total %lu\n", global_stats->total_port_alloc_fail);
     
-    APPEND("# HELP cgnat_packet_latency_microseconds_avg Average packet processing latency\n");
-    APPEND("# TYPE cgnat_packet_latency_microseconds_avg gauge\n");
-    APPEND("cgnat_packet_latency_microseconds_avg %.2f\n", global_stats->avg_latency_us);
+    /* Cumulative buckets; bounds are converted from cycles to seconds */
+    APPEND("# HELP cgnat_packet_latency_seconds Packet processing latency (per burst)\n");
+    APPEND("# TYPE cgnat_packet_latency_seconds histogram\n");
+    for (int d = 0; d < NAT_DIRS; d++) {
+        const struct latency_hist *h = &global_stats->latency[d];
+        const char *dir = (d == NAT_DIR_OUTBOUND) ? "outbound" : "inbound";
+        uint64_t count = 0;
+        
+        for (unsigned int b = 0; b < LAT_HIST_BUCKETS - 1; b++) {
+            count += h->buckets[b];
+            APPEND("cgnat_packet_latency_seconds_bucket{direction=\"%s\",le=\"%.9g\"} %lu\n",
+                   dir, tsc_hz ? (double)latency_bucket_limit(b) / tsc_hz : 0.0,
+                   count);
+        }
+        count += h->buckets[LAT_HIST_BUCKETS - 1];
+        APPEND("cgnat_packet_latency_seconds_bucket{direction=\"%s\",le=\"+Inf\"} %lu\n",
+               dir, count);
+        APPEND("cgnat_packet_latency_seconds_sum{direction=\"%s\"} %.9f\n",
+               dir, tsc_hz ? (double)h->sum / tsc_hz : 0.0);
+        APPEND("cgnat_packet_latency_seconds_count{direction=\"%s\"} %lu\n",
+               dir, count);
+    }
+    
+    if (detail == NULL)
+        goto out;
+    
+    /* One series per core, to spot a saturated worker or queue */
+    for (size_t c = 0; c < RTE_DIM(core_counters); c++) {
+        APPEND("# HELP cgnat_core_%s %s, per core\n",
+               core_counters[c].name, core_counters[c].help);
+        APPEND("# TYPE cgnat_core_%s counter\n", core_counters[c].name);
+        for (unsigned int i = 0; i < detail->num_cores; i++) {
+            const uint64_t *v = (const uint64_t *)((const char *)&detail->cores[i] +
+                                                   core_counters[c].offset);
+            APPEND("cgnat_core_%s{core=\"%u\"} %lu\n", core_counters[c].name, i, *v);
+        }
+    }
+    
+    /* Per-core latency as a summary without quantiles: the mean per core */
+    APPEND("# HELP cgnat_core_packet_latency_seconds Packet processing latency, per core\n");
+    APPEND("# TYPE cgnat_core_packet_latency_seconds summary\n");
+    for (unsigned int i = 0; i < detail->num_cores; i++) {
+        for (int d = 0; d < NAT_DIRS; d++) {
+            const struct latency_hist *h = &detail->cores[i].latency[d];
+            const char *dir = (d == NAT_DIR_OUTBOUND) ? "outbound" : "inbound";
+            uint64_t count = 0;
+            
+            for (unsigned int b = 0; b < LAT_HIST_BUCKETS; b++)
+                count += h->buckets[b];
+            APPEND("cgnat_core_packet_latency_seconds_sum{core=\"%u\",direction=\"%s\"} %.9f\n",
+                   i, dir, tsc_hz ? (double)h->sum / tsc_hz : 0.0);
+            APPEND("cgnat_core_packet_latency_seconds_count{core=\"%u\",direction=\"%s\"} %lu\n",
+                   i, dir, count);
+        }
+    }
+    
+    /* Port usage per public IP, summed over the workers' pools */
+    #define IP_LABEL "public_ip=\"%u.%u.%u.%u\""
+    #define IP_LABEL_ARGS(ip) ((ip) >> 24) & 0xFF, ((ip) >> 16) & 0xFF, \
+                              ((ip) >> 8) & 0xFF, (ip) & 0xFF
+    
+    APPEND("# HELP cgnat_public_ip_ports_allocated Public ports in use\n");
+    APPEND("# TYPE cgnat_public_ip_ports_allocated gauge\n");
+    for (int i = 0; i < detail->num_public_ips; i++)
+        APPEND("cgnat_public_ip_ports_allocated{" IP_LABEL "} %u\n",
+               IP_LABEL_ARGS(detail->public_ips[i].public_ip),
+               detail->public_ips[i].ports_allocated);
+    
+    APPEND("# HELP cgnat_public_ip_port_utilization Fraction of public ports in use\n");
+    APPEND("# TYPE cgnat_public_ip_port_utilization gauge\n");
+    for (int i = 0; i < detail->num_public_ips; i++)
+        APPEND("cgnat_public_ip_port_utilization{" IP_LABEL "} %.4f\n",
+               IP_LABEL_ARGS(detail->public_ips[i].public_ip),
+               (double)detail->public_ips[i].ports_allocated / PORTS_PER_IP);
+    
+    APPEND("# HELP cgnat_public_ip_exhaustion_events_total Allocations that found no free port\n");
+    APPEND("# TYPE cgnat_public_ip_exhaustion_events_total counter\n");
+    for (int i = 0; i < detail->num_public_ips; i++)
+        APPEND("cgnat_public_ip_exhaustion_events_total{" IP_LABEL "} %lu\n",
+               IP_LABEL_ARGS(detail->public_ips[i].public_ip),
+               detail->public_ips[i].exhaustion_events);
+    
+    APPEND("# HELP cgnat_public_ip_draining Removed by a reload, serving existing sessions only\n");
+    APPEND("# TYPE cgnat_public_ip_draining gauge\n");
+    for (int i = 0; i < detail->num_public_ips; i++)
+        APPEND("cgnat_public_ip_draining{" IP_LABEL "} %d\n",
+               IP_LABEL_ARGS(detail->public_ips[i].public_ip),
+               detail->public_ips[i].draining);
+    
+    #undef IP_LABEL
+    #undef IP_LABEL_ARGS
     
-    APPEND("# HELP cgnat_packet_latency_microseconds_max Maximum packet processing latency\n");
-    APPEND("# TYPE cgnat_packet_latency_microseconds_max gauge\n");
-    APPEND("cgnat_packet_latency_microseconds_max %lu\n", global_stats->max_latency_us);
+    /* For alert rules: utilization > threshold */
+    APPEND("# HELP cgnat_port_utilization_alert_threshold policy.port_exhaustion.alert_threshold\n");
+    APPEND("# TYPE cgnat_port_utilization_alert_threshold gauge\n");
+    APPEND("cgnat_port_utilization_alert_threshold %.2f\n",
+           detail->port_alert_threshold / 100.0);
     
+out:
     #undef APPEND
     
     return offset;
@@ -144,6 +367,6 @@ telemetry_log_metrics(const struct cgnat_global_stats *global_stats)
     printf("Sessions Expired: %lu\n", global_stats->total_nat_expired);
     printf("Port Alloc Fails: %lu\n", global_stats->total_port_alloc_fail);
     printf("Avg Latency:      %.2f μs\n", global_stats->avg_latency_us);
-    printf("Max Latency:      %lu μs\n", global_stats->max_latency_us);
+    printf("P99 Latency:      %.2f μs\n", global_stats->p99_latency_us);
     printf("=======================================\n\n");
 }
@@ -0,0 +1,165 @@
+/* SPDX-License-Identifier: MIT */
+/**
+ * @file stats_collector.c
+ * @brief Periodic aggregation of per-core statistics for the exporters
+ *
+ * Workers publish their counters under a per-core sequence count; this
+ * thread sums those snapshots every STATS_COLLECT_S and publishes the
+ * total the same way. The Prometheus and API threads copy the aggregate
+ * without a lock, so no reader ever waits on another or on a worker.
+ *
+ * Port usage is read from the workers' pools directly. A reload may free
+ * a worker's old pool table, so the collector reads them as a data plane
+ * RCU reader, online only for the duration of one pass.
+ */
+
+#include "telemetry.h"
+#include <rte_rcu_qsbr.h>
+#include <rte_seqcount.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+/* Latest aggregate: written by the collector thread only */
+static struct {
+    rte_seqcount_t seq;
+    struct cgnat_global_stats stats;
+    struct cgnat_detail_stats detail;
+} collected;
+
+/* Collector's working copy; too large for the thread's stack */
+static struct cgnat_detail_stats pass_detail;
+static bool ip_alerted[MAX_PUBLIC_IPS];
+
+static const struct nat_core_ctx *collector_cores;
+static unsigned int collector_num_cores;
+static struct rte_rcu_qsbr *collector_rcu;
+static uint32_t collector_alert_threshold;     /* Atomic access only */
+static volatile bool collector_running;
+static pthread_t collector_thread;
+
+/* Helper: Log public IPs crossing the utilization threshold, once each way */
+static void
+check_port_alerts(const struct cgnat_detail_stats *detail)
+{
+    for (int i = 0; i < detail->num_public_ips; i++) {
+        const struct public_ip_stats *ip = &detail->public_ips[i];
+        uint32_t pct = (uint64_t)ip->ports_allocated * 100 / PORTS_PER_IP;
+        bool over = pct >= detail->port_alert_threshold;
+
+        if (over == ip_alerted[i])
+            continue;
+        ip_alerted[i] = over;
+
+        printf("[STATS] Public IP %u.%u.%u.%u: %u of %u ports in use (%u%%), "
+               "%s alert threshold %u%%\n",
+               (ip->public_ip >> 24) & 0xFF, (ip->public_ip >> 16) & 0xFF,
+               (ip->public_ip >> 8) & 0xFF, ip->public_ip & 0xFF,
+               ip->ports_allocated, PORTS_PER_IP, pct,
+               over ? "above" : "back below", detail->port_alert_threshold);
+    }
+}
+
+static void *
+collector_main(void *arg __rte_unused)
+{
+    struct cgnat_global_stats stats;
+    unsigned int thread_id = collector_num_cores;
+
+    printf("[STATS] Statistics thread started\n");
+
+    while (collector_running) {
+        sleep(STATS_COLLECT_S);
+
+        /* Pool tables stay valid until we are offline again */
+        if (collector_rcu)
+            rte_rcu_qsbr_thread_online(collector_rcu, thread_id);
+        telemetry_aggregate_stats(collector_cores, collector_num_cores,
+                                  &stats, &pass_detail);
+        if (collector_rcu)
+            rte_rcu_qsbr_thread_offline(collector_rcu, thread_id);
+
+        pass_detail.port_alert_threshold =
+            __atomic_load_n(&collector_alert_threshold, __ATOMIC_RELAXED);
+
+        rte_seqcount_write_begin(&collected.seq);
+        memcpy(&collected.stats, &stats, sizeof(stats));
+        memcpy(&collected.detail, &pass_detail, sizeof(pass_detail));
+        rte_seqcount_write_end(&collected.seq);
+
+        telemetry_log_metrics(&stats);
+        check_port_alerts(&pass_detail);
+    }
+
+    printf("[STATS] Statistics thread stopped\n");
+    return NULL;
+}
+
+int
+stats_collector_start(const struct nat_core_ctx *cores, unsigned int num_cores,
+                      struct rte_rcu_qsbr *rcu, uint32_t alert_threshold)
+{
+    rte_seqcount_init(&collected.seq);
+    memset(&collected.stats, 0, sizeof(collected.stats));
+    memset(&collected.detail, 0, sizeof(collected.detail));
+    collected.detail.port_alert_threshold = alert_threshold;
+    collector_cores = cores;
+    collector_num_cores = num_cores;
+    collector_rcu = rcu;
+    collector_alert_threshold = alert_threshold;
+
+    if (rcu && rte_rcu_qsbr_thread_register(rcu, num_cores) != 0) {
+        fprintf(stderr, "Failed to register statistics thread with RCU\n");
+        return -1;
+    }
+
+    collector_running = true;
+
+    if (pthread_create(&collector_thread, NULL, collector_main, NULL) != 0) {
+        fprintf(stderr, "Failed to create statistics thread\n");
+        collector_running = false;
+        return -1;
+    }
+    return 0;
+}
+
+void
+stats_collector_set_alert_threshold(uint32_t alert_threshold)
+{
+    __atomic_store_n(&collector_alert_threshold, alert_threshold,
+                     __ATOMIC_RELAXED);
+}
+
+void
+stats_collector_stop(void)
+{
+    if (!collector_running)
+        return;
+    collector_running = false;
+    pthread_join(collector_thread, NULL);
+}
+
+void
+stats_collector_read(struct cgnat_global_stats *stats)
+{
+    uint32_t sn;
+
+    do {
+        sn = rte_seqcount_read_begin(&collected.seq);
+        memcpy(stats, &collected.stats, sizeof(*stats));
+    } while (rte_seqcount_read_retry(&collected.seq, sn));
+}
+
+void
+stats_collector_read_detail(struct cgnat_global_stats *stats,
+                            struct cgnat_detail_stats *detail)
+{
+    uint32_t sn;
+
+    do {
+        sn = rte_seqcount_read_begin(&collected.seq);
+        memcpy(stats, &collected.stats, sizeof(*stats));
+        memcpy(detail, &collected.detail, sizeof(*detail));
+    } while (rte_seqcount_read_retry(&collected.seq, sn));
+}